@@ -0,0 +1,189 @@
+#!/usr/bin/tclsh
+
+# Throughput of the dbf package on a dbf such as gendbf writes.
+#
+# tclsh bench.tcl path [-only list] [-open options] [-repeat n]
+#	[-random n] [-inserts n] [-updates n]
+#
+# Runs the benchmarks named in -only (all by default): open, record,
+# values, random, insert, update and strings.  -open gives options for
+# dbf d -open, such as -mmap or {-cachesize 64M}.  Each benchmark writes
+# one line, a Tcl dict: the benchmark, the rows it went through (opens
+# for open), its seconds, rows_per_s, the megabytes of records it read
+# or wrote, mb_per_s, and the stats of the handle it used.
+
+package require dbf
+
+set benchmarks {open record values random insert update strings}
+
+proc usage {} {
+	puts stderr "usage: tclsh bench.tcl path \[-only list\] \[-open options\] \[-repeat n\] \[-random n\] \[-inserts n\] \[-updates n\]"
+	exit 2
+	}
+
+if {$argc < 1 || $argc % 2 == 0} usage
+set path [lindex $argv 0]
+array set option {-only {} -open {} -repeat 20 -random 100000 -inserts 100000 -updates 100000}
+foreach {name value} [lrange $argv 1 end] {
+	if {![info exists option($name)]} usage
+	set option($name) $value
+	}
+if {$option(-only) eq ""} {
+	set option(-only) $benchmarks
+	}
+foreach name $option(-only) {
+	if {$name ni $benchmarks} usage
+	}
+
+proc open_dbf {path} {
+	global option
+	if {![dbf d -open $path {*}$option(-open)]} {
+		puts stderr "cannot open $path"
+		exit 1
+		}
+	return $d
+	}
+
+# Time script in the caller; report rows and bytes with the stats of d
+
+proc measure {benchmark d rows bytes script} {
+	$d stats -reset
+	set started [clock microseconds]
+	uplevel 1 $script
+	set seconds [expr {([clock microseconds] - $started) / 1e6}]
+	if {$seconds <= 0} {
+		set seconds 1e-6
+		}
+	set mb [expr {$bytes / 1048576.0}]
+	puts [list benchmark $benchmark rows $rows seconds [format %.3f $seconds] \
+		rows_per_s [format %.0f [expr {$rows / $seconds}]] \
+		mb [format %.1f $mb] mb_per_s [format %.1f [expr {$mb / $seconds}]] \
+		{*}[$d stats]]
+	flush stdout
+	}
+
+set d [open_dbf $path]
+lassign [$d info] rc fc
+set fields [$d fields]
+set length 1
+foreach field $fields {
+	incr length [lindex $field 3]
+	}
+set names [lmap field $fields {lindex $field 0}]
+puts [list file $path rows $rc fields $fc record_length $length bytes [file size $path] codepage [$d codepage] open $option(-open)]
+expr {srand(1)}
+
+if {"open" in $option(-only)} {
+	set n $option(-repeat)
+	measure open $d $n 0 {
+		for {set i 0} {$i < $n} {incr i} {
+			[open_dbf $path] forget
+			}
+		}
+	}
+
+if {"record" in $option(-only)} {
+	measure record $d $rc [expr {wide($rc) * $length}] {
+		for {set i 0} {$i < $rc} {incr i} {
+			$d record $i
+			}
+		}
+	}
+
+if {"values" in $option(-only)} {
+	measure values $d [expr {wide($rc) * $fc}] [expr {wide($rc) * $length * $fc}] {
+		foreach name $names {
+			$d values $name
+			}
+		}
+	}
+
+if {"random" in $option(-only) && $rc > 0} {
+	set n $option(-random)
+	set rows [lmap i [lrepeat $n 0] {expr {int(rand() * $rc)}}]
+	measure random $d $n [expr {wide($n) * $length}] {
+		foreach i $rows {
+			$d record $i
+			}
+		}
+	}
+
+# insert and update work on a scratch dbf with the same fields
+
+if {("insert" in $option(-only) || "update" in $option(-only)) && $rc > 0} {
+	set scratch [file join [file dirname $path] scratch.dbf]
+	file delete $scratch [file rootname $scratch].cpg
+	if {![dbf s -create $scratch -codepage [$d codepage]]} {
+		puts stderr "cannot create $scratch"
+		exit 1
+		}
+	foreach field $fields {
+		lassign $field name type native width prec
+		$s add $name $type $width $prec
+		}
+	set n $option(-inserts)
+	set records {}
+	for {set i 0} {$i < min($n,$rc)} {incr i} {
+		lappend records [$d record $i]
+		}
+	while {[llength $records] < $n} {
+		lappend records {*}[lrange $records 0 [expr {$n - [llength $records] - 1}]]
+		}
+	$s forget
+
+	# The scratch dbf is written, so it is neither mapped nor read only
+
+	if {![dbf s -open $scratch {*}[lsearch -all -inline -not -regexp $option(-open) {^-(mmap|readonly)$}]]} {
+		puts stderr "cannot open $scratch"
+		exit 1
+		}
+
+	if {"insert" in $option(-only)} {
+		measure insert $s $n [expr {wide($n) * $length}] {
+			foreach record $records {
+				$s insert end {*}$record
+				}
+			$s sync
+			}
+		} \
+	else {
+		$s insertmany end $records
+		$s sync
+		}
+
+	if {"update" in $option(-only)} {
+		set n $option(-updates)
+		set count [lindex [$s info] 0]
+		set name [lindex $names 0]
+		set values [$s values $name]
+		set updates [lmap i [lrepeat $n 0] {list [expr {int(rand() * $count)}] [lindex $values [expr {int(rand() * $count)}]]}]
+		measure update $s $n [expr {wide($n) * $length}] {
+			foreach update $updates {
+				$s update [lindex $update 0] $name [lindex $update 1]
+				}
+			$s sync
+			}
+		}
+	$s forget
+	file delete $scratch [file rootname $scratch].cpg
+	}
+
+# strings reads the text fields, which go through the codepage
+
+if {"strings" in $option(-only)} {
+	set text {}
+	set width 0
+	foreach field $fields {
+		if {[lindex $field 2] eq "C"} {
+			lappend text [lindex $field 0]
+			incr width [lindex $field 3]
+			}
+		}
+	measure strings $d [expr {wide($rc) * [llength $text]}] [expr {wide($rc) * $width}] {
+		foreach name $text {
+			$d column $name
+			}
+		}
+	}
+
+$d forget
@@ -0,0 +1,225 @@
+/*----------------------------------------------------------------------*\
+ | gendbf: write a dbf of synthetic records for the benchmarks.			|
+ |																		|
+ | gendbf [-rows n | -size bytes] [-columns n] [-types CNFLD]			|
+ |	[-codepage codepage] [-text ascii|high] [-seed n] path				|
+ |																		|
+ | -rows gives the number of records (100000 by default); -size gives	|
+ | the size of the file instead, with an optional K, M or G suffix, so	|
+ | -size 2G writes as many records as fit in two gigabytes.  The		|
+ | fields, -columns of them (10 by default), take their types in turn	|
+ | from -types: C text of up to 24 characters, N integers of 10			|
+ | digits, F numbers of 15 with 4 decimals, L logical and D dates.		|
+ | -codepage is as dbf d -create takes it.  With -text high, a third	|
+ | of the characters of the text fields are bytes 0xC0 to 0xFF,			|
+ | letters in the common codepages, so that reading them converts		|
+ | every value instead of passing plain ASCII through.					|
+ |																		|
+ | The records are built raw and appended through the append buffer		|
+ | of the library, one large write at a time.  On success one line		|
+ | describing the file is written to stdout, as a Tcl dict.				|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <shapefil.h>
+
+#define TEXT_WIDTH 24
+#define APPEND_BUFFER_SIZE (8 * 1024 * 1024)
+
+static unsigned long long state = 88172645463325252ULL;
+
+static unsigned long long next_random (void) {
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return (state);
+	}
+
+static int usage (void) {
+	fprintf (stderr,"usage: gendbf [-rows n | -size bytes] [-columns n] [-types CNFLD] [-codepage codepage] [-text ascii|high] [-seed n] path\n");
+	return (2);
+	}
+
+/*----------------------------------------------------------------------*\
+ | A size such as 512K, 64M or 2G in bytes, or -1 if it is not one.		|
+\*----------------------------------------------------------------------*/
+
+static double get_size (const char *s) {
+	char *end;
+	double size = strtod (s,&end);
+
+	if (end == s || size < 0)
+		return (-1);
+	if (*end == 'K' || *end == 'k') { size *= 1024; end++; }
+	else if (*end == 'M' || *end == 'm') { size *= 1024 * 1024; end++; }
+	else if (*end == 'G' || *end == 'g') { size *= 1024.0 * 1024 * 1024; end++; }
+	return (*end ? -1 : size);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Write v, scaled by 10 to the decimals, right aligned in width bytes	|
+ | at p; snprintf would take most of the time of a large file.			|
+\*----------------------------------------------------------------------*/
+
+static void put_number (char *p, int width, long long v, int decimals) {
+	unsigned long long u = v < 0 ? 0 - (unsigned long long) v : (unsigned long long) v;
+	int k = width, digits = 0;
+
+	while (k > 0 && (u || digits <= decimals)) {
+		if (decimals && digits == decimals)
+			p[--k] = '.';
+		if (k > 0)
+			p[--k] = (char) ('0' + u % 10);
+		u /= 10;
+		digits++;
+		}
+	if (v < 0 && k > 0)
+		p[--k] = '-';
+	memset (p,' ',k);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Fill the width bytes of one field at p with a value of its type.		|
+\*----------------------------------------------------------------------*/
+
+static void fill_field (char *p, char type, int width, int high) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	unsigned long long r = next_random ();
+	int k, n;
+
+	switch (type) {
+		case 'C':
+			n = 4 + (int) (r % (width - 3));
+			for (k=0; k < n; k++) {
+				unsigned int c;
+				if (k % 8 == 0)
+					r = next_random ();
+				c = (unsigned int) (r & 0xFF);
+				r >>= 8;
+				if (high && c % 3 == 0)
+					p[k] = (char) (0xC0 + c / 3 % 64);
+				else
+					p[k] = letters[c % (sizeof (letters) - 1)];
+				}
+			memset (p + n,' ',width - n);
+			break;
+		case 'N':
+			put_number (p,width,(long long) (r % 1000000000ULL) - 500000000LL,0);
+			break;
+		case 'F':
+			put_number (p,width,(long long) (r % 20000000000ULL) - 10000000000LL,4);
+			break;
+		case 'L':
+			*p = r & 1 ? 'T' : 'F';
+			break;
+		case 'D':
+			put_number (p,8,(1950 + (long long) (r % 100)) * 10000 + (1 + (r >> 8) % 12) * 100 + 1 + (r >> 16) % 28,0);
+			break;
+		}
+	}
+
+int main (int argc, char *argv[]) {
+	const char *path = NULL, *types = "CNFLD", *codepage = "LDID/87";
+	double size = -1;
+	long long rows = 100000;
+	int columns = 10, high = 0;
+	DBFHandle df;
+	char *record;
+	int i, j, length;
+	long long r, bytes;
+	struct timespec started, finished;
+
+	clock_gettime (CLOCK_MONOTONIC,&started);
+
+	for (i=1; i < argc; i++) {
+		if (i + 1 < argc && strcmp (argv[i],"-rows") == 0)
+			rows = atoll (argv[++i]);
+		else if (i + 1 < argc && strcmp (argv[i],"-size") == 0) {
+			if ((size = get_size (argv[++i])) < 0)
+				return (usage ());
+			}
+		else if (i + 1 < argc && strcmp (argv[i],"-columns") == 0)
+			columns = atoi (argv[++i]);
+		else if (i + 1 < argc && strcmp (argv[i],"-types") == 0)
+			types = argv[++i];
+		else if (i + 1 < argc && strcmp (argv[i],"-codepage") == 0)
+			codepage = argv[++i];
+		else if (i + 1 < argc && strcmp (argv[i],"-text") == 0) {
+			i++;
+			if (strcmp (argv[i],"high") == 0)
+				high = 1;
+			else if (strcmp (argv[i],"ascii") != 0)
+				return (usage ());
+			}
+		else if (i + 1 < argc && strcmp (argv[i],"-seed") == 0)
+			state = strtoull (argv[++i],NULL,10) * 2654435761ULL + 1;
+		else if (argv[i][0] != '-' && !path)
+			path = argv[i];
+		else
+			return (usage ());
+		}
+	if (!path || columns < 1 || rows < 0 || !*types || strspn (types,"CNFLD") != strlen (types))
+		return (usage ());
+
+	if (!(df = DBFCreateEx (path,codepage))) {
+		fprintf (stderr,"gendbf: cannot create %s\n",path);
+		return (1);
+		}
+	for (j=0; j < columns; j++) {
+		char type = types[j % strlen (types)];
+		char name[12];
+		int ok;
+
+		snprintf (name,sizeof (name),"%c%d",type,j + 1);
+		switch (type) {
+			case 'C': ok = DBFAddNativeFieldType (df,name,'C',TEXT_WIDTH,0); break;
+			case 'N': ok = DBFAddNativeFieldType (df,name,'N',10,0); break;
+			case 'F': ok = DBFAddNativeFieldType (df,name,'F',15,4); break;
+			case 'L': ok = DBFAddNativeFieldType (df,name,'L',1,0); break;
+			default:  ok = DBFAddNativeFieldType (df,name,'D',8,0); break;
+			}
+		if (ok < 0) {
+			fprintf (stderr,"gendbf: cannot add field %s; records are at most 65535 bytes\n",name);
+			DBFClose (df);
+			return (1);
+			}
+		}
+
+	length = df->nRecordLength;
+	if (size >= 0) {
+		rows = (long long) ((size - df->nHeaderLength) / length);
+		if (rows < 0)
+			rows = 0;
+		}
+	if (rows > 2147483647LL) {
+		fprintf (stderr,"gendbf: a dbf holds at most 2147483647 records\n");
+		DBFClose (df);
+		return (1);
+		}
+
+	DBFSetAppendBufferSize (df,APPEND_BUFFER_SIZE);
+	record = malloc (length);
+	for (r=0; r < rows; r++) {
+		record[0] = ' ';
+		for (j=0; j < columns; j++)
+			fill_field (record + df->panFieldOffset[j],df->pachFieldType[j],df->panFieldSize[j],high);
+		if (!DBFWriteTuple (df,(int) r,record)) {
+			fprintf (stderr,"gendbf: cannot write record %lld of %s\n",r,path);
+			free (record);
+			DBFClose (df);
+			return (1);
+			}
+		}
+	free (record);
+	bytes = df->nHeaderLength + rows * length + 1;
+	DBFClose (df);
+
+	clock_gettime (CLOCK_MONOTONIC,&finished);
+	printf ("file %s rows %lld columns %d record_length %d bytes %lld seconds %.3f\n",path,rows,columns,length,bytes,
+		(double) (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9);
+	return (0);
+	}
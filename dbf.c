@@ -5,9 +5,23 @@
  |																		|
  | What do I want to do with dbf files in Tcl?							|
  |																		|
- | dbf d -open $input_file [-readonly]									|
+ | dbf d -open $input_file [-readonly] [-mmap] [-cachesize $size]		|
+ |		[-append | -bulkload] [-share $name]							|
  |		opens dbase file, returns a handle.								|
- | dbf d -create $input_file [-codepage $codepage]						|
+ |		-mmap maps the file into memory (read only) and reads records	|
+ |		in place instead of seeking and reading each one; commands		|
+ |		that write are errors on it										|
+ |		-cachesize keeps up to $size bytes (e.g. 512K, 64M) of records	|
+ |		in memory, read and written back in blocks of many records		|
+ |		-append or -bulkload buffers records added at the end and		|
+ |		writes them in large chunks; the record count and end of file	|
+ |		mark are written by sync or when the file is closed				|
+ |		-share, with -readonly or -mmap, opens the file once for all	|
+ |		the interpreters and threads of the process: opening it again	|
+ |		by the same $name gives another command on the open handle,		|
+ |		and its commands run one thread at a time.  forget deletes one	|
+ |		command; the file is closed with the last of them				|
+ | dbf d -create $input_file [-codepage $codepage] [-bulkload]			|
  |		creates dbase file, returns a handle							|
  |																		|
  | $d info																|
@@ -26,18 +40,90 @@
  | $d values $name														|
  |		returns a list of values of the field $name						|
  |																		|
+ | $d column $name [-typed] [-from $rowid] [-count $n]					|
+ |		returns a list of values of the field $name in one pass; with	|
+ |		-typed, N and F values are integers or doubles and L values	|
+ |		are booleans													|
+ |																		|
+ | $d foreach $varList | -array $name | -dict $name [-fields $list]		|
+ |		[-rowid $name] [-where $predicate] [-typed] $body				|
+ |		sets the variables, array elements or dict entries to the		|
+ |		values of each record (all fields or those in $list) and		|
+ |		evaluates $body, which may use break and continue				|
+ |																		|
+ | $d select [-where $predicate] [-fields $list] [-typed] [-limit $n]	|
+ |		returns the numbers of the records matching $predicate or, with	|
+ |		-fields, a list of their values for the fields in $list.  The	|
+ |		predicate is a list: {field op value} with op one of == != <	|
+ |		<= > >=, {field between low high}, {field in list},				|
+ |		{field prefix text}, {field glob pattern}, {field null},		|
+ |		{field notnull}, {deleted}, {and pred ...}, {or pred ...} or	|
+ |		{not pred}.  foreach also takes -where $predicate.				|
+ |																		|
+ | $d aggregate [-groupby $list] [-where $predicate] [-typed] $agg ...	|
+ |		returns one row per group of records with the same values in	|
+ |		the fields of $list: those values followed by each aggregate,	|
+ |		{count}, {count field}, {sum field}, {avg field}, {min field}	|
+ |		or {max field}, computed in one pass over the records			|
+ |																		|
+ | $d columnize [-file $path]											|
+ |		writes a column-major sidecar of the dbf ($dbfroot.dbfc) that	|
+ |		column, select and aggregate read instead while it is current	|
+ |																		|
+ | $d index create|open|close $field [-file $path]						|
+ |		builds, loads or closes a sorted index of the values of $field,	|
+ |		kept in a file next to the dbf ($dbfroot.$field.idx) and kept	|
+ |		current as records are written while it is open				|
+ |																		|
+ | $d lookup $field $value												|
+ | $d range $field $low $high											|
+ |		return the numbers of the records with $value, or with values	|
+ |		from $low to $high, using the index open on $field				|
+ |																		|
  | $d record $rowid														|
  |		returns a list of cell values (as strings) for the given row	|
  |																		|
  | $d insert $rowid | end value0 [... value1 value2 ...]				|
  |		inserts the specified values into the given record 				|
  |																		|
+ | $d insertmany $rowid | end $rows									|
+ |		inserts each list of values in $rows as insert would, into		|
+ |		consecutive records starting at the given one; returns the		|
+ |		first record number												|
+ |																		|
  | $d update $rowid $field $value										|
  |		replaces the specified values of a single field in the record 	|
  |																		|
  | $d deleted $rowid [true|false]										|
  |		returns or sets the deleted flag for the given rowid			|
  |																		|
+ | $d pack [-output $path]												|
+ |		removes the records marked deleted, or copies the others to		|
+ |		$path; returns the number of records removed					|
+ |																		|
+ | $d restructure [-drop $list] [-order $list] [-alter $list]			|
+ |		[-output $path]													|
+ |		drops, reorders and alters fields in one pass over the records,	|
+ |		or writes the result to $path; -alter takes field names, each	|
+ |		followed by {type width [prec]}.  Returns the number of values	|
+ |		that did not fit their new field								|
+ |																		|
+ | $d optimize [-fields] [-output $path]								|
+ |		narrows each field to what its values need and drops fields		|
+ |		that are NULL throughout, in place or in a copy at $path;		|
+ |		returns the fields of the result, which -fields only reports	|
+ |																		|
+ | $d stats [-reset]													|
+ |		returns a dict of the work done on the handle since it was		|
+ |		opened or last reset: seeks, reads and writes of the file and	|
+ |		the bytes they moved, records read from the file or served		|
+ |		from memory, buffered changes written out, and strings			|
+ |		converted to or from the codepage								|
+ |																		|
+ | $d sync																|
+ |		writes buffered records, the record count and end of file mark	|
+ |		(nothing on a handle opened -readonly or -mmap)					|
+ |																		|
  | $d forget															|
  |		closes dbase file												|
  |																		|
@@ -52,6 +138,7 @@
 #include <tcl.h>
 
 #include "dbf.h"
+#include "dbf_private.h"
 
 #include <shapefil.h>
 
@@ -63,12 +150,7 @@ struct field_info {
 	int precision;
 	};
 
-struct dbf_info {
-	DBFHandle df;
-	Tcl_Encoding enc;
-	};
-
-static char *type_of (DBFFieldType t) {
+char *dbf_type_of (DBFFieldType t) {
 	if (t == FTString ) return ("String" );
 	if (t == FTInteger) return ("Integer");
 	if (t == FTDouble ) return ("Double" );
@@ -78,7 +160,7 @@ static char *type_of (DBFFieldType t) {
 	return ("Unknown");
 	}
 
-static DBFFieldType get_type (char *name) {
+DBFFieldType dbf_get_type (char *name) {
 	DBFFieldType result = FTInvalid;
 	if (name && *name) {
 		if (name[1] == '\0') {
@@ -186,7 +268,7 @@ static char * codepages[] = {
 	NULL,NULL,NULL
 	};
 
-static char *get_encoding (char *codepage) {
+char *get_encoding (char *codepage) {
 	int result = 0; 
     if (codepage && strncmp(codepage,"LDID/",5) == 0) {
         result = atoi(codepage + 5);
@@ -205,16 +287,823 @@ static SHPDate *get_date (SHPDate *date, char *str) {
     return date;	
 }
 
+/*----------------------------------------------------------------------*\
+ | Byte count such as 4096, 512K, 64M or 1G; returns 0 if malformed.	|
+\*----------------------------------------------------------------------*/
+
+static int get_size (char *str, SAOffset *size) {
+	char *end;
+	double d = strtod (str,&end);
+
+	if (end == str || d < 0)
+		return (0);
+	if (*end == 'K' || *end == 'k') { d *= 1024.0; end++; }
+	else if (*end == 'M' || *end == 'm') { d *= 1024.0 * 1024.0; end++; }
+	else if (*end == 'G' || *end == 'g') { d *= 1024.0 * 1024.0 * 1024.0; end++; }
+	if (*end != '\0' || d > 1e15)
+		return (0);
+	*size = (SAOffset) d;
+	return (1);
+	}
+
 static char *empty = "";
+
+/*----------------------------------------------------------------------*\
+ | Text of field j taken straight from a raw record, or from a copy of	|
+ | the bytes of the field alone, trimmed of blanks as					|
+ | DBFReadStringAttribute would return it.								|
+\*----------------------------------------------------------------------*/
+
+static const char *cell_text (DBFHandle df, const char *s, int j, int *length) {
+	const char *z = memchr (s,'\0',df->panFieldSize[j]);
+	int n = z ? (int) (z - s) : df->panFieldSize[j];
+	int lead = DBFSpanChar (s,n,' ');
+
+	s += lead;
+	n -= lead;
+	*length = n - DBFSpanCharReverse (s,n,' ');
+	return (s);
+	}
+
+const char *field_text (DBFHandle df, const char *record, int j, int *length) {
+	return (cell_text (df,record + df->panFieldOffset[j],j,length));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Tcl object for field j of a raw record: an empty string for NULL,	|
+ | otherwise the decoded text or, if typed, an integer, double or		|
+ | boolean object for N, F and L fields.  cell_obj takes the bytes of	|
+ | the field alone.														|
+\*----------------------------------------------------------------------*/
+
+static Tcl_Obj *cell_obj (struct dbf_info *di, const char *cell, int j, int typed) {
+	DBFHandle df = di->df;
+	char type = df->pachFieldType[j];
+	int n;
+	const char *t = cell_text (df,cell,j,&n);
+
+	if (DBFIsFieldValueNULL (type,t,n,df->panFieldSize[j]))
+		return (Tcl_NewStringObj (empty,0));
+
+	if (typed && (type == 'N' || type == 'F')) {
+		int64_t w;
+		double d;
+
+		if (df->panFieldDecimals[j] == 0 && DBFParseInteger (t,n,&w))
+			return (Tcl_NewWideIntObj ((Tcl_WideInt) w));
+		/* d - d is 0 unless d is infinite or not a number */
+		if (DBFParseDouble (t,n,&d) && d - d == 0)
+			return (Tcl_NewDoubleObj (d));
+		}
+
+	if (typed && type == 'L' && n > 0) {
+		if (strchr ("TtYy",*t))
+			return (Tcl_NewBooleanObj (1));
+		if (strchr ("FfNn",*t))
+			return (Tcl_NewBooleanObj (0));
+		}
+
+	return (external_to_obj (di,t,n));
+	}
+
+Tcl_Obj *field_obj (struct dbf_info *di, const char *record, int j, int typed) {
+	if (!record)
+		return (Tcl_NewStringObj (empty,0));
+	return (cell_obj (di,record + di->df->panFieldOffset[j],j,typed));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Typed values of N or F field j of count records from from, parsed	|
+ | a block at a time.  Cells that are NULL or hold no plain number go	|
+ | through field_obj, which gives them the same object as ever.		|
+\*----------------------------------------------------------------------*/
+
+#define NUMBER_BLOCK 1024
+
+static void number_column (struct dbf_info *di, int j, int from, int count, Tcl_Obj **values) {
+	DBFHandle df = di->df;
+	int integer = df->panFieldDecimals[j] == 0;
+	int64_t w[NUMBER_BLOCK];
+	double d[NUMBER_BLOCK];
+	unsigned char none[NUMBER_BLOCK];
+	int i, k, n;
+
+	for (i=0; i < count; i += n) {
+		n = count - i < NUMBER_BLOCK ? count - i : NUMBER_BLOCK;
+		if (!(integer ? DBFReadInteger64Column (df,j,from + i,n,w,none) : DBFReadDoubleColumn (df,j,from + i,n,d,none)))
+			memset (none,1,n);
+		for (k=0; k < n; k++)
+			if (none[k] || (!integer && d[k] - d[k] != 0))
+				values[i + k] = field_obj (di,DBFReadTuple (df,from + i + k),j,1);
+			else if (integer)
+				values[i + k] = Tcl_NewWideIntObj ((Tcl_WideInt) w[k]);
+			else
+				values[i + k] = Tcl_NewDoubleObj (d[k]);
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | column -threads: the threads copy the bytes of the field of their	|
+ | records, and parse them if they are typed numbers, into arrays		|
+ | shared by all of them; this thread then makes the objects.  Records	|
+ | go a round at a time so the copies stay small.						|
+\*----------------------------------------------------------------------*/
+
+#define COLUMN_ROUND 262144
+
+enum cell_state { CELL_UNREAD, CELL_TEXT, CELL_WIDE, CELL_DOUBLE };
+
+struct column_scan {
+	DBFHandle df;
+	int field;
+	int numbers;			/* parse N and F values */
+	int from;				/* first record of the round */
+	char *cells;
+	unsigned char *state;
+	Tcl_WideInt *wides;
+	double *doubles;
+	};
+
+static int column_kernel (void *data, int i, const char *record) {
+	struct column_scan *c = (struct column_scan *) data;
+	DBFHandle df = c->df;
+	int j = c->field, k = i - c->from, n;
+	const char *t;
+
+	memcpy (c->cells + (size_t) k * df->panFieldSize[j],record + df->panFieldOffset[j],df->panFieldSize[j]);
+	c->state[k] = CELL_TEXT;
+	if (!c->numbers)
+		return (1);
+
+	t = field_text (df,record,j,&n);
+	if (DBFIsFieldValueNULL (df->pachFieldType[j],t,n,df->panFieldSize[j]))
+		return (1);
+	if (df->panFieldDecimals[j] == 0) {
+		int64_t w;
+		if (DBFParseInteger (t,n,&w)) {
+			c->wides[k] = (Tcl_WideInt) w;
+			c->state[k] = CELL_WIDE;
+			return (1);
+			}
+		}
+	if (DBFParseDouble (t,n,c->doubles + k) && c->doubles[k] - c->doubles[k] == 0)
+		c->state[k] = CELL_DOUBLE;
+	return (1);
+	}
+
+static int column_threaded (Tcl_Interp *interp, struct dbf_info *di, int j, int from, int count, int typed, int threads, Tcl_Obj **values) {
+	DBFHandle df = di->df;
+	struct column_scan c;
+	void **data = (void **) ckalloc (threads * sizeof (void *));
+	int round = count < COLUMN_ROUND ? count : COLUMN_ROUND;
+	int result = TCL_OK;
+	int i, k, n;
+
+	c.df = df;
+	c.field = j;
+	c.numbers = typed && (df->pachFieldType[j] == 'N' || df->pachFieldType[j] == 'F');
+	c.cells = ckalloc ((round > 0 ? round : 1) * df->panFieldSize[j]);
+	c.state = (unsigned char *) ckalloc (round > 0 ? round : 1);
+	c.wides = c.numbers ? (Tcl_WideInt *) ckalloc ((round > 0 ? round : 1) * sizeof (Tcl_WideInt)) : NULL;
+	c.doubles = c.numbers ? (double *) ckalloc ((round > 0 ? round : 1) * sizeof (double)) : NULL;
+	for (k=0; k < threads; k++)
+		data[k] = &c;
+
+	for (i=0; i < count; i += n) {
+		n = count - i < round ? count - i : round;
+		c.from = from + i;
+		memset (c.state,CELL_UNREAD,n);
+		if (scan_records (interp,di,threads,c.from,n,column_kernel,data) < 0) {
+			while (i-- > 0)
+				Tcl_DecrRefCount (values[i]);
+			result = TCL_ERROR;
+			break;
+			}
+		for (k=0; k < n; k++) {
+			switch (c.state[k]) {
+				case CELL_UNREAD: values[i + k] = Tcl_NewStringObj (empty,0); break;
+				case CELL_WIDE: values[i + k] = Tcl_NewWideIntObj (c.wides[k]); break;
+				case CELL_DOUBLE: values[i + k] = Tcl_NewDoubleObj (c.doubles[k]); break;
+				default: values[i + k] = cell_obj (di,c.cells + (size_t) k * df->panFieldSize[j],j,typed); break;
+				}
+			}
+		}
+
+	if (c.doubles)
+		ckfree ((char *) c.doubles);
+	if (c.wides)
+		ckfree ((char *) c.wides);
+	ckfree ((char *) c.state);
+	ckfree (c.cells);
+	ckfree ((char *) data);
+	return (result);
+	}
+
+/*----------------------------------------------------------------------*\
+ | select -threads: each thread keeps the numbers of its matching		|
+ | records and, for -fields, copies of the records, up to the limit.	|
+\*----------------------------------------------------------------------*/
+
+struct select_scan {
+	struct where *where;
+	int limit;				/* 0 for no limit */
+	int length;				/* of a record copy, 0 for none */
+	int count;
+	int size;
+	int *rows;
+	char *records;
+	};
+
+static int select_kernel (void *data, int i, const char *record) {
+	struct select_scan *s = (struct select_scan *) data;
+
+	if (s->where && !where_match (s->where,record))
+		return (1);
+	if (s->count == s->size) {
+		s->size = s->size ? 2 * s->size : 256;
+		s->rows = (int *) ckrealloc ((char *) s->rows,s->size * sizeof (int));
+		if (s->length)
+			s->records = ckrealloc (s->records,(size_t) s->size * s->length);
+		}
+	s->rows[s->count] = i;
+	if (s->length)
+		memcpy (s->records + (size_t) s->count * s->length,record,s->length);
+	s->count++;
+	return (s->limit == 0 || s->count < s->limit);
+	}
+
+static int select_threaded (Tcl_Interp *interp, struct dbf_info *di, struct where *where, int *index, int count, int typed, int limit, int threads, Tcl_Obj *obj) {
+	DBFHandle df = di->df;
+	struct select_scan *scans = (struct select_scan *) ckalloc (threads * sizeof (struct select_scan));
+	void **data = (void **) ckalloc (threads * sizeof (void *));
+	int used, t, k, j;
+
+	for (t=0; t < threads; t++) {
+		struct select_scan *s = scans + t;
+		s->where = where;
+		s->limit = limit > 0 ? limit : 0;
+		s->length = index ? df->nRecordLength : 0;
+		s->count = s->size = 0;
+		s->rows = NULL;
+		s->records = NULL;
+		data[t] = s;
+		}
+
+	used = scan_records (interp,di,threads,0,DBFGetRecordCount (df),select_kernel,data);
+
+	for (t=0; t < used; t++) {
+		struct select_scan *s = scans + t;
+		for (k=0; k < s->count && limit != 0; k++) {
+			if (index) {
+				Tcl_Obj *row = Tcl_NewListObj (0,NULL);
+				for (j=0; j < count; j++)
+					Tcl_ListObjAppendElement (NULL,row,field_obj (di,s->records + (size_t) k * s->length,index[j],typed));
+				Tcl_ListObjAppendElement (NULL,obj,row);
+				}
+			else
+				Tcl_ListObjAppendElement (NULL,obj,Tcl_NewIntObj (s->rows[k]));
+			if (limit > 0)
+				limit--;
+			}
+		}
+
+	for (t=0; t < threads; t++) {
+		if (scans[t].rows)
+			ckfree ((char *) scans[t].rows);
+		if (scans[t].records)
+			ckfree (scans[t].records);
+		}
+	ckfree ((char *) data);
+	ckfree ((char *) scans);
+	return (used < 0 ? TCL_ERROR : TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Field name arguments remember the field index they were resolved to	|
+ | in their internal representation, together with the field tag of	|
+ | the handle, so that repeated commands on the same field name object	|
+ | skip the lookup entirely.  The tags are unique across the threads of	|
+ | the process, since a shared handle meets the objects of all of them.	|
+\*----------------------------------------------------------------------*/
+
+static Tcl_ObjType field_index_type = {"dbf-field", NULL, NULL, NULL, NULL};
+static size_t field_tags = 0;
+TCL_DECLARE_MUTEX(field_tags_mutex)
+
+void new_field_tag (struct dbf_info *di) {
+	Tcl_MutexLock (&field_tags_mutex);
+	di->field_tag = ++field_tags;
+	Tcl_MutexUnlock (&field_tags_mutex);
+	}
+
+int get_field_index (struct dbf_info *di, Tcl_Obj *obj) {
+	char *name;
+	int j;
+
+	if (obj->typePtr == &field_index_type && (size_t) obj->internalRep.twoPtrValue.ptr1 == di->field_tag)
+		return ((int) (size_t) obj->internalRep.twoPtrValue.ptr2);
+
+	name = Tcl_GetString(obj);
+	if ((j = DBFGetFieldIndex (di->df,name)) >= 0) {
+		if (obj->typePtr && obj->typePtr->freeIntRepProc)
+			obj->typePtr->freeIntRepProc (obj);
+		obj->internalRep.twoPtrValue.ptr1 = (void *) di->field_tag;
+		obj->internalRep.twoPtrValue.ptr2 = (void *) (size_t) j;
+		obj->typePtr = &field_index_type;
+		}
+	return (j);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Writes on a handle opened -mmap would never reach the file: its		|
+ | hooks write nothing, and shapelib only warns on stderr.  Commands	|
+ | that write call this first.											|
+\*----------------------------------------------------------------------*/
+
+int check_writable (Tcl_Interp *interp, struct dbf_info *di, const char *command) {
+	if (!di->mapped)
+		return (TCL_OK);
+	Tcl_ResetResult (interp);
+	Tcl_AppendResult (interp,command,": the dbf is mapped read only by -mmap",NULL);
+	return (TCL_ERROR);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Handles keep their paths as strings: a shared handle is used by		|
+ | several threads, and a Tcl_Obj belongs to the thread that made it.	|
+ | This makes an object of the path for the calling thread, with a		|
+ | reference the caller releases.										|
+\*----------------------------------------------------------------------*/
+
+Tcl_Obj *path_obj (const char *path) {
+	Tcl_Obj *obj = Tcl_NewStringObj (path,-1);
+	Tcl_IncrRefCount (obj);
+	return (obj);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Cut the file to the length of the header and records of the handle,	|
+ | after pack or restructure moved them down; shapelib cannot.			|
+\*----------------------------------------------------------------------*/
+
+int truncate_dbf (Tcl_Interp *interp, struct dbf_info *di, const char *command) {
+	DBFHandle df = di->df;
+	Tcl_WideInt length = (Tcl_WideInt) df->nHeaderLength + (Tcl_WideInt) DBFGetRecordCount (df) * df->nRecordLength + (df->bWriteEndOfFileChar ? 1 : 0);
+	Tcl_Obj *path = path_obj (di->path);
+	Tcl_Channel channel = Tcl_FSOpenFileChannel (interp,path,"r+",0);
+
+	Tcl_DecrRefCount (path);
+	if (!channel)
+		return (TCL_ERROR);
+	if (Tcl_TruncateChannel (channel,length) != TCL_OK) {
+		Tcl_Close (NULL,channel);
+		Tcl_AppendResult (interp,command,": could not truncate ",di->path,NULL);
+		return (TCL_ERROR);
+		}
+	Tcl_Close (NULL,channel);
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Field plan for insertmany: what is needed to format a value into	|
+ | each field of a record buffer, resolved once for all the rows.		|
+\*----------------------------------------------------------------------*/
+
+struct field_plan {
+	char name[XBASE_FLDNAME_LEN_READ + 1];
+	int index;
+	DBFFieldType type;
+	char null_char;
+	int offset;
+	int width;
+	int decimals;
+	};
+
+static struct field_plan *make_plan (DBFHandle df) {
+	int fc = DBFGetFieldCount (df);
+	struct field_plan *plan = (struct field_plan *) ckalloc (sizeof (struct field_plan) * (fc > 0 ? fc : 1));
+	int j;
+
+	for (j=0; j < fc; j++) {
+		struct field_plan *p = plan + j;
+		p->index = j;
+		p->type = DBFGetFieldInfo (df,j,p->name,&p->width,&p->decimals);
+		p->offset = df->panFieldOffset[j];
+		switch (df->pachFieldType[j]) {
+			case 'N':
+			case 'F': p->null_char = '*'; break;
+			case 'D': p->null_char = '0'; break;
+			case 'L': p->null_char = '?'; break;
+			default:  p->null_char = ' '; break;
+			}
+		}
+	return (plan);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Format one value into its field of a record buffer, with the same	|
+ | results and warnings as writing it with insert.					|
+\*----------------------------------------------------------------------*/
+
+static int format_cell (Tcl_Interp *interp, struct dbf_info *di, struct field_plan *p, char *record, Tcl_Obj *cell) {
+	char *field = record + p->offset;
+	int length;
+	char *value = Tcl_GetStringFromObj (cell,&length);
+
+	if (length == 0) {
+		memset (field,p->null_char,p->width);
+		return (TCL_OK);
+		}
+
+	switch (p->type) {
+		case FTString:
+			{
+			Tcl_DString e;
+			char *t;
+			Tcl_DStringInit(&e);
+			t = utf_to_external (di,value,length,&e);
+			length = (int) strlen (t);
+			if (length > p->width) {
+				length = p->width;
+				fprintf (stderr,"Warning: value truncated when writing to field %s\n",p->name);
+				fprintf (stderr,"         value is \"%s\"\n",value);
+				}
+			else
+				memset (field,' ',p->width);
+			memcpy (field,t,length);
+			Tcl_DStringFree(&e);
+			}
+			break;
+		case FTInteger:
+		case FTDouble:
+			{
+			char number[XBASE_FLD_MAX_WIDTH + 1];
+			double double_value;
+			int integer_value;
+
+			if (p->type == FTInteger) {
+				if (Tcl_GetIntFromObj(interp,cell,&integer_value) == TCL_ERROR) {
+					Tcl_SetResult (interp,"insertmany: cannot interpret integer value",TCL_STATIC);
+					Tcl_AppendResult(interp, " for field ", p->name, NULL);
+					return (TCL_ERROR);
+					}
+				double_value = integer_value;
+				}
+			else if (Tcl_GetDoubleFromObj(interp,cell,&double_value) == TCL_ERROR) {
+				Tcl_SetResult (interp,"insertmany: cannot interpret double value",TCL_STATIC);
+				Tcl_AppendResult(interp, " for field ", p->name, NULL);
+				return (TCL_ERROR);
+				}
+
+			/* as DBFWriteAttribute formats numbers */
+			length = DBFFormatDouble (number,p->width,p->decimals,double_value);
+			if (length > p->width) {
+				length = p->width;
+				fprintf (stderr,"Warning: failed to write number %lf to field %s\n",double_value,p->name);
+				}
+			memcpy (field,number,length);
+			}
+			break;
+		case FTLogical:
+			if (*value == 'F' || *value == 'T')
+				*field = *value;
+			else {
+				fprintf (stderr,"Warning: logical value unrecognized for field %s\n",p->name);
+				fprintf (stderr,"         value is \"%s\"\n",value);
+				}
+			break;
+		case FTDate:
+			{
+			SHPDate date;
+			char number[16];
+
+			get_date (&date,value);
+			if (date.year < 0 || date.year > 9999 || date.month < 0 || date.month > 99 || date.day < 0 || date.day > 99) {
+				fprintf (stderr,"Warning: date value unrecognized for field %s\n",p->name);
+				fprintf (stderr,"         value is \"%s\"\n",value);
+				break;
+				}
+			DBFFormatDate (number,&date);
+			if (p->width < 8)
+				memcpy (field,number,p->width);
+			else {
+				memset (field,' ',p->width);
+				memcpy (field,number,8);
+				}
+			}
+			break;
+		case FTInvalid:
+		default:
+			fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",p->index,dbf_type_of(p->type));
+			break;
+		}
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | foreach: bind the chosen fields of each record to variables, to an	|
+ | array or to a dict, and evaluate the body for it.					|
+\*----------------------------------------------------------------------*/
+
+static int foreach_record (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	Tcl_Obj *vars = NULL, *array = NULL, *dict = NULL, *fields = NULL, *rowid = NULL, *predicate = NULL;
+	struct where *where = NULL;
+	Tcl_Obj *body = objv[objc-1];
+	Tcl_Obj **var_objv = NULL, **names = NULL;
+	int *index = NULL;
+	int typed = 0, var_objc = 0, count, rc, i, j, k;
+	int result = TCL_OK;
+
+	for (k=2; k < objc-1; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-array") == 0 && k+1 < objc-1)
+			array = objv[++k];
+		else if (strcmp (option,"-dict") == 0 && k+1 < objc-1)
+			dict = objv[++k];
+		else if (strcmp (option,"-fields") == 0 && k+1 < objc-1)
+			fields = objv[++k];
+		else if (strcmp (option,"-rowid") == 0 && k+1 < objc-1)
+			rowid = objv[++k];
+		else if (strcmp (option,"-where") == 0 && k+1 < objc-1)
+			predicate = objv[++k];
+		else if (strcmp (option,"-typed") == 0)
+			typed = 1;
+		else if (!vars)
+			vars = objv[k];
+		else {
+			Tcl_SetResult (interp,"foreach: expected varList, -array name, -dict name, -fields list, -rowid name, -where predicate or -typed",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		}
+
+	if ((vars != NULL) + (array != NULL) + (dict != NULL) != 1) {
+		Tcl_SetResult (interp,"foreach expects one of varList, -array name or -dict name, and a body",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+
+	/* Resolve the fields once: those given, or all of them */
+
+	if (fields) {
+		Tcl_Obj **field_objv;
+		if (Tcl_ListObjGetElements (interp,fields,&count,&field_objv) == TCL_ERROR)
+			return (TCL_ERROR);
+		index = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+		for (j=0; j < count; j++)
+			if ((index[j] = get_field_index (di,field_objv[j])) == -1) {
+				Tcl_SetResult (interp,"foreach: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(field_objv[j])," does not match a field name in this dbf file",NULL);
+				ckfree ((char *) index);
+				return (TCL_ERROR);
+				}
+		}
+	else {
+		count = DBFGetFieldCount (df);
+		index = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+		for (j=0; j < count; j++)
+			index[j] = j;
+		}
+
+	if (vars) {
+		/* A copy, as the body could shimmer a shared varList away from being a list */
+		vars = Tcl_DuplicateObj (vars);
+		Tcl_IncrRefCount (vars);
+		if (Tcl_ListObjGetElements (interp,vars,&var_objc,&var_objv) == TCL_ERROR || var_objc > count) {
+			if (var_objc > count)
+				Tcl_SetResult (interp,"foreach: more variables than fields",TCL_STATIC);
+			Tcl_DecrRefCount (vars);
+			ckfree ((char *) index);
+			return (TCL_ERROR);
+			}
+		count = var_objc;
+		}
+	else {
+		char name[XBASE_FLDNAME_LEN_READ + 1];
+		names = (Tcl_Obj **) ckalloc ((count > 0 ? count : 1) * sizeof (Tcl_Obj *));
+		for (j=0; j < count; j++) {
+			DBFGetFieldInfo (df,index[j],name,NULL,NULL);
+			names[j] = Tcl_NewStringObj (name,-1);
+			Tcl_IncrRefCount (names[j]);
+			}
+		}
+
+	if (predicate && where_compile (interp,di,predicate,&where) == TCL_ERROR)
+		result = TCL_ERROR;
+
+	/* Records added by the body are not visited */
+
+	rc = result == TCL_OK ? DBFGetRecordCount (df) : 0;
+	di->iterating++;
+	for (i=0; i < rc; i++) {
+		const char *record = DBFReadTuple (df,i);
+		Tcl_Obj *row = NULL;
+
+		if (where && !(record && where_match (where,record)))
+			continue;
+
+		if (dict) {
+			row = Tcl_NewDictObj ();
+			Tcl_IncrRefCount (row);
+			}
+
+		if (rowid && !Tcl_ObjSetVar2 (interp,rowid,NULL,Tcl_NewIntObj (i),TCL_LEAVE_ERR_MSG))
+			result = TCL_ERROR;
+		for (j=0; j < count && result == TCL_OK; j++) {
+			Tcl_Obj *value = field_obj (di,record,index[j],typed);
+			if (row)
+				Tcl_DictObjPut (NULL,row,names[j],value);
+			else if (!Tcl_ObjSetVar2 (interp,vars ? var_objv[j] : array,vars ? NULL : names[j],value,TCL_LEAVE_ERR_MSG))
+				result = TCL_ERROR;
+			}
+		if (row) {
+			if (result == TCL_OK && !Tcl_ObjSetVar2 (interp,dict,NULL,row,TCL_LEAVE_ERR_MSG))
+				result = TCL_ERROR;
+			Tcl_DecrRefCount (row);
+			}
+		if (result != TCL_OK)
+			break;
+
+		result = Tcl_EvalObjEx (interp,body,0);
+		if (result == TCL_CONTINUE)
+			result = TCL_OK;
+		else if (result == TCL_BREAK) {
+			result = TCL_OK;
+			break;
+			}
+		else if (result != TCL_OK) {
+			if (result == TCL_ERROR) {
+				char line[64];
+				sprintf (line,"\n    (\"foreach\" body line %d)",Tcl_GetErrorLine (interp));
+				Tcl_AddErrorInfo (interp,line);
+				}
+			break;
+			}
+		}
+	di->iterating--;
+
+	where_free (where);
+	if (vars)
+		Tcl_DecrRefCount (vars);
+	if (names) {
+		for (j=0; j < count; j++)
+			Tcl_DecrRefCount (names[j]);
+		ckfree ((char *) names);
+		}
+	ckfree ((char *) index);
+	if (result == TCL_OK)
+		Tcl_ResetResult (interp);
+	return (result);
+	}
+
 static char *failure = "0";
 static char *success = "1";
-static int record_count = 0;
-static char message[512];
+
+/*----------------------------------------------------------------------*\
+ | What the package keeps for each interpreter, with Tcl_SetAssocData,	|
+ | so that interpreters in different threads share nothing mutable.	|
+\*----------------------------------------------------------------------*/
+
+struct dbf_interp {
+	int handles;		/* commands made for handles, to name the next */
+	};
+
+static void free_dbf_interp (ClientData clientData, Tcl_Interp *interp) {
+	(void) interp;
+	ckfree ((char *) clientData);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Handles opened with -share, by name.  Each interpreter that opens	|
+ | one by its name gets a command of its own on the same dbf_info.		|
+\*----------------------------------------------------------------------*/
+
+static Tcl_HashTable shared_handles;
+static int shared_handles_ready = 0;
+TCL_DECLARE_MUTEX(shared_handles_mutex)
+
+/*----------------------------------------------------------------------*\
+ | Commands on a shared handle run one thread at a time.  The lock is	|
+ | held by a thread rather than a command, since the scripts of foreach	|
+ | run commands on the handle inside one of their own.					|
+\*----------------------------------------------------------------------*/
+
+static void lock_handle (struct dbf_info *di) {
+	Tcl_ThreadId self = Tcl_GetCurrentThread ();
+
+	Tcl_MutexLock (&di->lock);
+	while (di->depth > 0 && di->owner != self)
+		Tcl_ConditionWait (&di->unlocked,&di->lock,NULL);
+	di->owner = self;
+	di->depth++;
+	Tcl_MutexUnlock (&di->lock);
+	}
+
+static void unlock_handle (struct dbf_info *di) {
+	Tcl_MutexLock (&di->lock);
+	if (--di->depth == 0)
+		Tcl_ConditionNotify (&di->unlocked);
+	Tcl_MutexUnlock (&di->lock);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Close the dbf of a handle and free it.  interp, for the errors of	|
+ | writing its indexes, is NULL when the handle goes with the last		|
+ | interpreter that used it.											|
+\*----------------------------------------------------------------------*/
+
+static int close_handle (Tcl_Interp *interp, struct dbf_info *di) {
+	DBFHandle df = di->df;
+	int changed = df->bUpdated, rc, result;
+
+	/* Indexes are written once the dbf is closed, to match it on disk */
+
+	index_settle (di);
+	columnar_check (di);
+	rc = DBFGetRecordCount (df);
+	codepage_free (di->codepage);
+	Tcl_FreeEncoding(di->enc);
+	DBFClose (df);
+	columnar_restamp (di);
+	columnar_forget (di);
+	result = index_save_all (interp,di,rc,changed);
+	index_free_all (di);
+	ckfree (di->path);
+	if (di->share)
+		ckfree (di->share);
+	Tcl_ConditionFinalize (&di->unlocked);
+	Tcl_MutexFinalize (&di->lock);
+	free (di);
+	return (result);
+	}
+
+/*----------------------------------------------------------------------*\
+ | One command less on a shared handle; the last one closes it.			|
+\*----------------------------------------------------------------------*/
+
+static int release_handle (Tcl_Interp *interp, struct dbf_info *di) {
+	int last;
+
+	Tcl_MutexLock (&shared_handles_mutex);
+	if ((last = --di->users == 0))
+		Tcl_DeleteHashEntry (Tcl_FindHashEntry (&shared_handles,di->share));
+	Tcl_MutexUnlock (&shared_handles_mutex);
+	return (last ? close_handle (interp,di) : TCL_OK);
+	}
+
+/* The command of a shared handle was deleted, or its interpreter */
+
+static void release_command (ClientData clientData) {
+	release_handle (NULL,(struct dbf_info *) clientData);
+	}
+
+static int handle_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CONST objv[]);
 
 int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CONST objv[]) {
+	struct dbf_info *di = (struct dbf_info *) clientData;
+	int result;
+
+	if (!di || !di->share)
+		return (handle_cmd (clientData,interp,objc,objv));
+
+	/*------------------------------------------------------------------*\
+	 | forget on a shared handle deletes the command of this interpreter
+	 | only; other threads may be using the handle, so it does not keep
+	 | the lock.
+	\*------------------------------------------------------------------*/
+
+	if (objc > 1 && (strcmp (Tcl_GetString(objv[1]),"forget") == 0 || strcmp (Tcl_GetString(objv[1]),"close") == 0)) {
+		Tcl_CmdInfo info;
+		const char *name = Tcl_GetString(objv[0]);
+		int iterating;
+
+		lock_handle (di);
+		iterating = di->iterating;
+		unlock_handle (di);
+		if (iterating) {
+			Tcl_SetResult (interp,"forget: cannot close the dbf inside its foreach",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		if (Tcl_GetCommandInfo (interp,name,&info)) {
+			info.deleteProc = NULL;
+			Tcl_SetCommandInfo (interp,name,&info);
+			}
+		Tcl_DeleteCommand (interp,name);
+		if (release_handle (interp,di) == TCL_ERROR)
+			return (TCL_ERROR);
+		Tcl_SetResult (interp,success,TCL_STATIC);
+		return (TCL_OK);
+		}
+
+	lock_handle (di);
+	result = handle_cmd (clientData,interp,objc,objv);
+	unlock_handle (di);
+	return (result);
+	}
+
+static int handle_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CONST objv[]) {
 	int i,j,k;
+	struct dbf_info *di = (struct dbf_info *) clientData;
 	DBFHandle df;
-	Tcl_Encoding enc;
 	Tcl_Obj *obj;
 	int fc,rc;
 
@@ -224,7 +1113,6 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 		}
 
 	df = ((struct dbf_info *) clientData)->df;
-	enc = ((struct dbf_info *) clientData)->enc;
 
 	if (objc > 1) {
 		const char *command = Tcl_GetString(objv[1]);
@@ -281,6 +1169,8 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 				Tcl_SetResult (interp,"add: cannot find this dbf; no dbf has been created",TCL_STATIC);
 				return (TCL_ERROR);
 				}
+			if (check_writable (interp,di,"add") == TCL_ERROR)
+				return (TCL_ERROR);
 
 			if (objc > 2) {
 				char *field_name = Tcl_GetString(objv[2]);
@@ -301,7 +1191,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					}
 
 				if (objc > 3) {
-					DBFFieldType field_type = get_type (Tcl_GetString(objv[3]));
+					DBFFieldType field_type = dbf_get_type (Tcl_GetString(objv[3]));
 
 					if (field_type != FTInvalid) {
 						if (objc > 4) {
@@ -337,6 +1227,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 
 							if (j >= 0) {
 								char number[16];
+								new_field_tag (di);
 								sprintf (number,"%d",j);
 								Tcl_AppendResult (interp,number,TCL_STATIC);
 								return (TCL_OK);
@@ -394,9 +1285,9 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					char number[16];
 					char *t;
 
-					if ((j = DBFGetFieldIndex (df,field)) == -1) {
-						sprintf (message,"fields %s does not match a field name in this dbf file",field);
-						Tcl_SetResult (interp,message,TCL_STATIC);
+					if ((j = get_field_index (di,objv[2])) == -1) {
+						Tcl_SetResult (interp,"fields ",TCL_STATIC);
+						Tcl_AppendResult (interp,field," does not match a field name in this dbf file",NULL);
 						return (TCL_ERROR);
 						}
 
@@ -404,7 +1295,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					obj = Tcl_NewListObj (0,NULL);
 					t = info[j].name;
 					Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (t,-1));
-					t = type_of (info[j].type);
+					t = dbf_type_of (info[j].type);
 					Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (t,-1));
 					t = &info[j].native;
 					Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (t,1));
@@ -423,7 +1314,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 						sub = Tcl_NewListObj (0,NULL);
 						t = info[j].name;
 						Tcl_ListObjAppendElement (interp,sub,Tcl_NewStringObj (t,-1));
-						t = type_of (info[j].type);
+						t = dbf_type_of (info[j].type);
 						Tcl_ListObjAppendElement (interp,sub,Tcl_NewStringObj (t,-1));
 						t = &info[j].native;
 						Tcl_ListObjAppendElement (interp,sub,Tcl_NewStringObj (t,1));
@@ -432,58 +1323,307 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 						sprintf (number,"%d",info[j].precision);
 						Tcl_ListObjAppendElement (interp,sub,Tcl_NewStringObj (number,-1));
 
-						Tcl_ListObjAppendElement (interp,obj,sub);
-						}
+						Tcl_ListObjAppendElement (interp,obj,sub);
+						}
+					}
+				free (info);
+				Tcl_SetObjResult (interp,obj);
+				return (TCL_OK);
+				}
+			else {
+				Tcl_SetResult (interp,"fields: cannot get field information",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			}
+
+		/*--------------------------------------------------------------*\
+		 | values <field>
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"values") == 0)
+			if (objc > 2) {
+				char *field = Tcl_GetString(objv[2]);
+
+				if (!df) {
+					Tcl_SetResult (interp,"values: cannot find; no dbf has been read",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+
+				if ((j = get_field_index (di,objv[2])) == -1) {
+					Tcl_SetResult (interp,"values ",TCL_STATIC);
+					Tcl_AppendResult (interp,field," does not match a field name in this dbf file",NULL);
+					return (TCL_ERROR);
+					}
+
+				rc = DBFGetRecordCount(df);
+				obj = Tcl_NewListObj (0,NULL);
+				for (i=0; i < rc; i++)
+					Tcl_ListObjAppendElement (interp,obj,field_obj (di,DBFReadTuple (df,i),j,0));
+				Tcl_SetObjResult (interp,obj);
+				return (TCL_OK);
+				}
+			else {
+				Tcl_SetResult (interp,"values expects the name of a field",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+
+		/*--------------------------------------------------------------*\
+		 | column <field> [-typed] [-from <number>] [-count <number>] [-threads <n>]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"column") == 0)
+			if (objc > 2) {
+				char *field = Tcl_GetString(objv[2]);
+				Tcl_Obj **values;
+				int typed = 0;
+				int from = 0;
+				int count = -1;
+				int threads = 1;
+
+				if (!df) {
+					Tcl_SetResult (interp,"column: cannot find; no dbf has been read",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+
+				if ((j = get_field_index (di,objv[2])) == -1) {
+					Tcl_SetResult (interp,"column ",TCL_STATIC);
+					Tcl_AppendResult (interp,field," does not match a field name in this dbf file",NULL);
+					return (TCL_ERROR);
+					}
+
+				for (k=3; k < objc; k++) {
+					char *option = Tcl_GetString(objv[k]);
+					if (strcmp (option,"-typed") == 0)
+						typed = 1;
+					else if (strcmp (option,"-from") == 0 && k+1 < objc) {
+						if (Tcl_GetIntFromObj(interp,objv[++k],&from) == TCL_ERROR) {
+							Tcl_SetResult (interp,"column: cannot interpret the number of the record",TCL_STATIC);
+							return (TCL_ERROR);
+							}
+						}
+					else if (strcmp (option,"-count") == 0 && k+1 < objc) {
+						if (Tcl_GetIntFromObj(interp,objv[++k],&count) == TCL_ERROR || count < 0) {
+							Tcl_SetResult (interp,"column: cannot interpret the count of records",TCL_STATIC);
+							return (TCL_ERROR);
+							}
+						}
+					else if (strcmp (option,"-threads") == 0 && k+1 < objc) {
+						if (scan_threads (interp,"column",objv[++k],&threads) == TCL_ERROR)
+							return (TCL_ERROR);
+						}
+					else {
+						Tcl_SetResult (interp,"column: expected -typed, -from number, -count number or -threads number",TCL_STATIC);
+						return (TCL_ERROR);
+						}
+					}
+
+				rc = DBFGetRecordCount(df);
+				if (from < 0 || from > rc) {
+					Tcl_SetResult (interp,"column: record number out of range",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+				if (count < 0 || count > rc - from)
+					count = rc - from;
+
+				/* Take the column from the sidecar of the dbf, or walk the	*/
+				/* records once, filling a list of known size				*/
+
+				values = (Tcl_Obj **) ckalloc ((count > 0 ? count : 1) * sizeof (Tcl_Obj *));
+				if (!columnar_column (di,j,from,count,typed,values)) {
+					if (threads > 1) {
+						if (column_threaded (interp,di,j,from,count,typed,threads,values) == TCL_ERROR) {
+							ckfree ((char *) values);
+							return (TCL_ERROR);
+							}
+						}
+					else if (typed && (df->pachFieldType[j] == 'N' || df->pachFieldType[j] == 'F'))
+						number_column (di,j,from,count,values);
+					else
+						for (i=0; i < count; i++)
+							values[i] = field_obj (di,DBFReadTuple (df,from + i),j,typed);
+					}
+				Tcl_SetObjResult (interp,Tcl_NewListObj (count,values));
+				ckfree ((char *) values);
+				return (TCL_OK);
+				}
+			else {
+				Tcl_SetResult (interp,"column expects the name of a field",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+
+		/*--------------------------------------------------------------*\
+		 | foreach <varList> | -array <name> | -dict <name> [options] <body>
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"foreach") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"foreach: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			if (objc < 4) {
+				Tcl_SetResult (interp,"foreach expects one of varList, -array name or -dict name, and a body",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			return (foreach_record (interp,di,objc,objv));
+			}
+
+		/*--------------------------------------------------------------*\
+		 | select [-where <predicate>] [-fields <list>] [-typed] [-limit <n>] [-threads <n>]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"select") == 0) {
+			Tcl_Obj *predicate = NULL, *fields = NULL;
+			struct where *where = NULL;
+			struct dbf_columnar *columnar;
+			int *index = NULL;
+			int typed = 0, limit = -1, count = 0, threads = 1;
+
+			if (!df) {
+				Tcl_SetResult (interp,"select: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+
+			for (k=2; k < objc; k++) {
+				char *option = Tcl_GetString(objv[k]);
+				if (strcmp (option,"-where") == 0 && k+1 < objc)
+					predicate = objv[++k];
+				else if (strcmp (option,"-fields") == 0 && k+1 < objc)
+					fields = objv[++k];
+				else if (strcmp (option,"-typed") == 0)
+					typed = 1;
+				else if (strcmp (option,"-limit") == 0 && k+1 < objc) {
+					if (Tcl_GetIntFromObj(interp,objv[++k],&limit) == TCL_ERROR) {
+						Tcl_SetResult (interp,"select: cannot interpret the limit",TCL_STATIC);
+						return (TCL_ERROR);
+						}
+					}
+				else if (strcmp (option,"-threads") == 0 && k+1 < objc) {
+					if (scan_threads (interp,"select",objv[++k],&threads) == TCL_ERROR)
+						return (TCL_ERROR);
+					}
+				else {
+					Tcl_SetResult (interp,"select: expected -where predicate, -fields list, -typed, -limit number or -threads number",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+				}
+
+			if (fields) {
+				Tcl_Obj **field_objv;
+				if (Tcl_ListObjGetElements (interp,fields,&count,&field_objv) == TCL_ERROR)
+					return (TCL_ERROR);
+				index = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+				for (j=0; j < count; j++)
+					if ((index[j] = get_field_index (di,field_objv[j])) == -1) {
+						Tcl_SetResult (interp,"select: ",TCL_STATIC);
+						Tcl_AppendResult (interp,Tcl_GetString(field_objv[j])," does not match a field name in this dbf file",NULL);
+						ckfree ((char *) index);
+						return (TCL_ERROR);
+						}
+				}
+
+			if (predicate && where_compile (interp,di,predicate,&where) == TCL_ERROR) {
+				if (index)
+					ckfree ((char *) index);
+				return (TCL_ERROR);
+				}
+
+			/* Matching record numbers, or the chosen fields of matching records */
+
+			rc = DBFGetRecordCount (df);
+			obj = Tcl_NewListObj (0,NULL);
+			if (threads > 1 && limit != 0 && select_threaded (interp,di,where,index,count,typed,limit,threads,obj) == TCL_ERROR) {
+				Tcl_DecrRefCount (obj);
+				where_free (where);
+				if (index)
+					ckfree ((char *) index);
+				return (TCL_ERROR);
+				}
+			columnar = where && threads == 1 ? columnar_fresh (di) : NULL;
+			for (i=0; i < rc && limit != 0 && threads == 1; i++) {
+				const char *record;
+				if (columnar && (k = columnar_skip (columnar,where,i)) > 0) {
+					i += k - 1;
+					continue;
 					}
-				free (info);
-				Tcl_SetObjResult (interp,obj);
-				return (TCL_OK);
+				record = DBFReadTuple (df,i);
+				if (!record || (where && !where_match (where,record)))
+					continue;
+				if (fields) {
+					Tcl_Obj *row = Tcl_NewListObj (0,NULL);
+					for (j=0; j < count; j++)
+						Tcl_ListObjAppendElement (NULL,row,field_obj (di,record,index[j],typed));
+					Tcl_ListObjAppendElement (NULL,obj,row);
+					}
+				else
+					Tcl_ListObjAppendElement (NULL,obj,Tcl_NewIntObj (i));
+				if (limit > 0)
+					limit--;
 				}
-			else {
-				Tcl_SetResult (interp,"fields: cannot get field information",TCL_STATIC);
+
+			where_free (where);
+			if (index)
+				ckfree ((char *) index);
+			Tcl_SetObjResult (interp,obj);
+			return (TCL_OK);
+			}
+
+		/*--------------------------------------------------------------*\
+		 | aggregate [-groupby <list>] [-where <predicate>] [-typed] <agg> ...
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"aggregate") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"aggregate: cannot find; no dbf has been read",TCL_STATIC);
 				return (TCL_ERROR);
 				}
+			return (aggregate_records (interp,di,objc,objv));
 			}
 
 		/*--------------------------------------------------------------*\
-		 | values <field>
+		 | export csv [-channel <chan> | -file <path>] [-fields <list>] ...
+		 | export arrow <path> [-fields <list>] [-batchsize <n>]
 		\*--------------------------------------------------------------*/
 
-		if (strcmp (command,"values") == 0)
-			if (objc > 2) {
-				char *field = Tcl_GetString(objv[2]);
-
-				if (!df) {
-					Tcl_SetResult (interp,"values: cannot find; no dbf has been read",TCL_STATIC);
-					return (TCL_ERROR);
-					}
+		if (strcmp (command,"export") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"export: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			if (objc > 2 && strcmp (Tcl_GetString(objv[2]),"csv") == 0)
+				return (csv_export (interp,di,objc,objv));
+			if (objc > 2 && strcmp (Tcl_GetString(objv[2]),"arrow") == 0)
+				return (arrow_export (interp,di,objc,objv));
+			Tcl_SetResult (interp,"export: expected a format, csv or arrow",TCL_STATIC);
+			return (TCL_ERROR);
+			}
 
-				if ((j = DBFGetFieldIndex (df,field)) == -1) {
-					sprintf (message,"values %s does not match a field name in this dbf file",field);
-					Tcl_SetResult (interp,message,TCL_STATIC);
-					return (TCL_ERROR);
-					}
+		/*--------------------------------------------------------------*\
+		 | columnize [-file <path>]
+		\*--------------------------------------------------------------*/
 
-				rc = DBFGetRecordCount(df);
-				obj = Tcl_NewListObj (0,NULL);
-				for (i=0; i < rc; i++)
-					if (DBFIsAttributeNULL (df,i,j))
-						Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (empty,0));
-					else {
-						const char *t;
-						Tcl_DString e;
-						Tcl_DStringInit(&e);
-						t = DBFReadStringAttribute (df,i,j);
-						Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (Tcl_ExternalToUtfDString(enc, t, -1, &e),-1));
-						Tcl_DStringFree(&e);
-						}
-				Tcl_SetObjResult (interp,obj);
-				return (TCL_OK);
+		if (strcmp (command,"columnize") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"columnize: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
 				}
-			else {
-				Tcl_SetResult (interp,"values expects the name of a field",TCL_STATIC);
+			return (columnar_command (interp,di,objc,objv));
+			}
+
+		/*--------------------------------------------------------------*\
+		 | index create | open | close <field> [-file <path>]
+		 | lookup <field> <value>
+		 | range <field> <low> <high>
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"index") == 0 || strcmp (command,"lookup") == 0 || strcmp (command,"range") == 0) {
+			if (!df) {
+				Tcl_AppendResult (interp,command,": cannot find; no dbf has been read",NULL);
 				return (TCL_ERROR);
 				}
+			if (strcmp (command,"index") == 0)
+				return (index_command (interp,di,objc,objv));
+			return (lookup_command (interp,di,objc,objv));
+			}
 
 		/*--------------------------------------------------------------*\
 		 | record <number>
@@ -509,18 +1649,12 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					return (TCL_ERROR);
 					}
 
+				{
+				const char *record = DBFReadTuple (df,i);
 				obj = Tcl_NewListObj (0,NULL);
 				for (j=0; j < fc; j++)
-					if (DBFIsAttributeNULL (df,i,j))
-						Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (empty,0));
-					else {
-						const char *t;
-						Tcl_DString e;
-						Tcl_DStringInit(&e);
-						t = DBFReadStringAttribute (df,i,j);
-						Tcl_ListObjAppendElement (interp,obj,Tcl_NewStringObj (Tcl_ExternalToUtfDString(enc, t, -1, &e),-1));
-						Tcl_DStringFree(&e);
-						}
+					Tcl_ListObjAppendElement (interp,obj,field_obj (di,record,j,0));
+				}
 				Tcl_SetObjResult (interp,obj);
 				return (TCL_OK);
 				}
@@ -529,6 +1663,101 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 				return (TCL_ERROR);
 				}
 
+		/*--------------------------------------------------------------*\
+		 | insertmany <number> | end <rows>
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"insertmany") == 0)
+			if (objc == 4) {
+				char *rowid = Tcl_GetString(objv[2]);
+				struct field_plan *plan;
+				char *record;
+				int row_objc, first;
+				Tcl_Obj **row_objv;
+
+				if (!df) {
+					Tcl_SetResult (interp,"insertmany: cannot find dbf; no dbf has been created",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+				if (check_writable (interp,di,"insertmany") == TCL_ERROR)
+					return (TCL_ERROR);
+
+				fc = DBFGetFieldCount (df);
+				rc = DBFGetRecordCount(df);
+
+				if (strcmp (rowid,"end") == 0) i = rc;
+				else {
+					if (Tcl_GetIntFromObj(interp,objv[2],&i) == TCL_ERROR) {
+						Tcl_SetResult (interp,"insertmany: cannot interpret the number of the record",TCL_STATIC);
+						return (TCL_ERROR);
+						}
+					}
+
+				if (i < 0 || i > rc) {
+					Tcl_SetResult (interp,"insertmany: record number out of range",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+
+				if (Tcl_ListObjGetElements (interp,objv[3],&row_objc,&row_objv) == TCL_ERROR) {
+					Tcl_SetResult (interp,"insertmany: expected a Tcl list of rows",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+
+				plan = make_plan (df);
+				record = ckalloc (df->nRecordLength);
+				first = i;
+
+				for (k=0; k < row_objc; k++, i++) {
+					int value_objc;
+					Tcl_Obj **value_objv;
+
+					if (Tcl_ListObjGetElements (interp,row_objv[k],&value_objc,&value_objv) == TCL_ERROR) {
+						Tcl_SetResult (interp,"insertmany: expected each row to be a Tcl list",TCL_STATIC);
+						break;
+						}
+
+					/* New records start blank, existing ones keep fields not given */
+
+					if (i < DBFGetRecordCount(df)) {
+						const char *old = DBFReadTuple (df,i);
+						if (!old) {
+							char number[16];
+							sprintf (number,"%d",i);
+							Tcl_SetResult (interp,"insertmany: cannot read record ",TCL_STATIC);
+							Tcl_AppendResult (interp,number,NULL);
+							break;
+							}
+						memcpy (record,old,df->nRecordLength);
+						}
+					else
+						memset (record,' ',df->nRecordLength);
+					index_touch (di,i);
+					columnar_forget (di);
+
+					for (j=0; j < value_objc && j < fc; j++)
+						if (format_cell (interp,di,plan + j,record,value_objv[j]) == TCL_ERROR)
+							break;
+					if (j < value_objc && j < fc)
+						break;
+
+					if (!DBFWriteTuple (df,i,record)) {
+						Tcl_SetResult (interp,"insertmany: could not write record",TCL_STATIC);
+						break;
+						}
+					}
+
+				ckfree (record);
+				ckfree ((char *) plan);
+				if (k < row_objc)
+					return (TCL_ERROR);
+				Tcl_SetObjResult (interp,Tcl_NewIntObj (first));
+				return (TCL_OK);
+				}
+			else {
+				Tcl_SetResult (interp,"insertmany expects the number of a record or 'end' and a list of rows",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+
 		/*--------------------------------------------------------------*\
 		 | insert <number> | end  <values>
 		\*--------------------------------------------------------------*/
@@ -542,6 +1771,8 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					Tcl_SetResult (interp,"insert: cannot find dbf; no dbf has been created",TCL_STATIC);
 					return (TCL_ERROR);
 					}
+				if (check_writable (interp,di,"insert") == TCL_ERROR)
+					return (TCL_ERROR);
 
 				fc = DBFGetFieldCount (df);
 				rc = DBFGetRecordCount(df);
@@ -559,6 +1790,9 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					return (TCL_ERROR);
 					}
 
+				index_touch (di,i);
+				columnar_forget (di);
+
 				/* If the third argument is a list, get the values to be inserted from it */
 
 				if (objc == 4 && objv[3]->typePtr)
@@ -592,7 +1826,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 											{
 											Tcl_DString e;
 											Tcl_DStringInit(&e);
-											if (!DBFWriteStringAttribute (df,i,k,Tcl_UtfToExternalDString(enc, value, -1, &e))) {
+											if (!DBFWriteStringAttribute (df,i,k,utf_to_external (di,value,-1,&e))) {
 												fprintf (stderr,"Warning: value truncated when writing to field %s\n",field_name);
 												fprintf (stderr,"         value is \"%s\"\n",value);
 												}
@@ -631,14 +1865,13 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 											break;
 										case FTInvalid:
 										default:
-											fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,type_of(field_type));
+											fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,dbf_type_of(field_type));
 											break;
 										}
 									}
 								k++;
 								}
-							sprintf (message,"%d",i);
-							Tcl_SetResult (interp,message,TCL_STATIC);
+							Tcl_SetObjResult (interp,Tcl_NewIntObj (i));
 							return (TCL_OK);
 							}
 
@@ -662,7 +1895,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 								{
 								Tcl_DString e;
 								Tcl_DStringInit(&e);
-								if (!DBFWriteStringAttribute (df,i,k,Tcl_UtfToExternalDString(enc, value, -1, &e))) {
+								if (!DBFWriteStringAttribute (df,i,k,utf_to_external (di,value,-1,&e))) {
 									fprintf (stderr,"Warning: value truncated when writing to field %s\n",field_name);
 									}
 								Tcl_DStringFree(&e);
@@ -693,14 +1926,13 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 								break;
 							case FTInvalid:
 							default:
-								fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,type_of(field_type));
+								fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,dbf_type_of(field_type));
 								break;
 							}
 						}
 					k++;
 					}
-				sprintf (message,"%d",i);
-				Tcl_SetResult (interp,message,TCL_STATIC);
+				Tcl_SetObjResult (interp,Tcl_NewIntObj (i));
 				return (TCL_OK);
 				}
 			else {
@@ -721,6 +1953,8 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					Tcl_SetResult (interp,"update: cannot find dbf; no dbf has been created",TCL_STATIC);
 					return (TCL_ERROR);
 					}
+				if (check_writable (interp,di,command) == TCL_ERROR)
+					return (TCL_ERROR);
 
 				fc = DBFGetFieldCount (df);
 				rc = DBFGetRecordCount(df);
@@ -737,9 +1971,9 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 					}
 
 				if (objc > 3) {
-					char *field_name = Tcl_GetString(objv[3]);
+					char field_name[XBASE_FLDNAME_LEN_READ + 1];
 
-					k = DBFGetFieldIndex (df,field_name);
+					k = get_field_index (di,objv[3]);
 					if (k != -1) {
 						if (objc > 4) {
 							char *value = Tcl_GetString(objv[4]);
@@ -747,13 +1981,15 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 							double double_value;
 						    SHPDate date_value;
 
+							index_touch (di,i);
+							columnar_forget (di);
 							field_type = DBFGetFieldInfo (df,k,field_name,NULL,NULL);
 							switch (field_type) {
 								case FTString:
 									{
 									Tcl_DString e;
 									Tcl_DStringInit(&e);
-									if (!DBFWriteStringAttribute (df,i,k,Tcl_UtfToExternalDString(enc, value, -1, &e))) {
+									if (!DBFWriteStringAttribute (df,i,k,utf_to_external (di,value,-1,&e))) {
 										fprintf (stderr,"Warning: value truncated when writing to field %s\n",field_name);
 										}
 									Tcl_DStringFree(&e);
@@ -783,7 +2019,7 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 									break;
 								case FTInvalid:
 								default:
-									fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,type_of(field_type));
+									fprintf (stderr,"Warning: Field %d is an unwritable field of type %s\n",k,dbf_type_of(field_type));
 									break;
 								}
 							Tcl_SetResult (interp,success,TCL_STATIC);
@@ -839,10 +2075,14 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 
 				if (objc > 3) {
 					int b;
+					if (check_writable (interp,di,"deleted") == TCL_ERROR)
+						return (TCL_ERROR);
 					if (Tcl_GetBooleanFromObj(interp,objv[3],&b) != TCL_OK) {
 						fprintf (stderr,"Warning: invalid boolean value\n");
 						return (TCL_ERROR);
 						}
+					index_touch (di,i);
+					columnar_forget (di);
 					if (!DBFMarkRecordDeleted(df,i,b)) {
 						fprintf (stderr,"Warning: failed to change deleted mark\n");
 						return (TCL_ERROR);
@@ -855,6 +2095,136 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 				Tcl_SetResult (interp,"deleted expects the number of an existing record",TCL_STATIC);
 				return (TCL_ERROR);
 				}
+
+		/*--------------------------------------------------------------*\
+		 | pack [-output <path>]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"pack") == 0) {
+			int kept;
+
+			if (!df) {
+				Tcl_SetResult (interp,"pack: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			if (objc != 2 && !(objc == 4 && strcmp (Tcl_GetString(objv[2]),"-output") == 0)) {
+				Tcl_SetResult (interp,"pack expects optionally -output path",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			rc = DBFGetRecordCount (df);
+
+			/* A packed copy leaves the dbf and its record numbers as they are */
+
+			if (objc == 4) {
+				Tcl_Obj *output = Tcl_FSGetNormalizedPath (interp,objv[3]);
+				Tcl_DString native;
+
+				if (!output)
+					return (TCL_ERROR);
+				if (strcmp (Tcl_GetString(output),di->path) == 0) {
+					Tcl_SetResult (interp,"pack: -output must be another file than the dbf",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+				kept = DBFPack (df,Tcl_UtfToExternalDString (NULL,Tcl_GetString(output),-1,&native));
+				Tcl_DStringFree (&native);
+				if (kept < 0) {
+					Tcl_AppendResult (interp,"pack: could not write ",Tcl_GetString(output),NULL);
+					return (TCL_ERROR);
+					}
+				Tcl_SetObjResult (interp,Tcl_NewIntObj (rc - kept));
+				return (TCL_OK);
+				}
+
+			if (di->iterating) {
+				Tcl_SetResult (interp,"pack: cannot renumber the records inside a foreach",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			if (check_writable (interp,di,"pack") == TCL_ERROR)
+				return (TCL_ERROR);
+
+			/* Packed in place, the file is cut to its new length */
+
+			index_settle (di);
+			if ((kept = DBFPack (df,NULL)) < 0) {
+				Tcl_AppendResult (interp,"pack: could not write ",di->path,NULL);
+				return (TCL_ERROR);
+				}
+			if (kept < rc) {
+				columnar_forget (di);
+				index_rebuild_all (di);
+				if (truncate_dbf (interp,di,"pack") == TCL_ERROR)
+					return (TCL_ERROR);
+				}
+			Tcl_SetObjResult (interp,Tcl_NewIntObj (rc - kept));
+			return (TCL_OK);
+			}
+
+		/*--------------------------------------------------------------*\
+		 | restructure [-drop <list>] [-order <list>] [-alter <list>]
+		 |	[-output <path>]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"restructure") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"restructure: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			return (restructure_command (interp,di,objc,objv));
+			}
+
+		/*--------------------------------------------------------------*\
+		 | optimize [-fields] [-output <path>]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"optimize") == 0) {
+			if (!df) {
+				Tcl_SetResult (interp,"optimize: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			return (optimize_command (interp,di,objc,objv));
+			}
+
+		/*--------------------------------------------------------------*\
+		 | stats [-reset]
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"stats") == 0) {
+			static const char *names[] = {"seeks","reads","writes","bytes_read","bytes_written","records_loaded","records_buffered","flushes","conversions","tcl_conversions"};
+			Tcl_WideInt counts[10];
+			Tcl_Obj *result;
+
+			if (!df) {
+				Tcl_SetResult (interp,"stats: cannot find; no dbf has been read",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			if (objc != 2 && !(objc == 3 && strcmp (Tcl_GetString(objv[2]),"-reset") == 0)) {
+				Tcl_SetResult (interp,"stats expects optionally -reset",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			counts[0] = (Tcl_WideInt) df->sStats.nSeeks;
+			counts[1] = (Tcl_WideInt) df->sStats.nReads;
+			counts[2] = (Tcl_WideInt) df->sStats.nWrites;
+			counts[3] = (Tcl_WideInt) df->sStats.nBytesRead;
+			counts[4] = (Tcl_WideInt) df->sStats.nBytesWritten;
+			counts[5] = (Tcl_WideInt) df->sStats.nRecordsLoaded;
+			counts[6] = (Tcl_WideInt) df->sStats.nRecordsBuffered;
+			counts[7] = (Tcl_WideInt) df->sStats.nFlushes;
+			counts[8] = di->conversions;
+			counts[9] = di->tcl_conversions;
+			result = Tcl_NewDictObj ();
+			for (i=0; i < 10; i++)
+				Tcl_DictObjPut (NULL,result,Tcl_NewStringObj (names[i],-1),Tcl_NewWideIntObj (counts[i]));
+
+			/* The counts returned are those up to the reset */
+
+			if (objc == 3) {
+				memset (&df->sStats,0,sizeof (DBFStats));
+				di->conversions = 0;
+				di->tcl_conversions = 0;
+				}
+			Tcl_SetObjResult (interp,result);
+			return (TCL_OK);
+			}
 #ifdef TEST
 
 		/*--------------------------------------------------------------*\
@@ -909,16 +2279,43 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 			return (TCL_OK);
 			}
 #endif
+		/*--------------------------------------------------------------*\
+		 | sync: write pending records, the record count and end of file
+		\*--------------------------------------------------------------*/
+
+		if (strcmp (command,"sync") == 0) {
+			if (df) {
+				/* A read only handle has no header or indexes to write back */
+				if (!di->readonly) {
+					index_settle (di);
+					columnar_check (di);
+					DBFUpdateHeader (df);
+					columnar_restamp (di);
+					if (index_save_all (interp,di,DBFGetRecordCount (df),1) == TCL_ERROR)
+						return (TCL_ERROR);
+					}
+				Tcl_SetResult (interp,success,TCL_STATIC);
+				}
+			else
+				Tcl_SetResult (interp,failure,TCL_STATIC);
+			return (TCL_OK);
+			}
+
 		/*--------------------------------------------------------------*\
 		 | forget == close
 		\*--------------------------------------------------------------*/
 
 		if (strcmp (command,"forget") == 0 || strcmp (command,"close") == 0) {
+			if (di->iterating) {
+				Tcl_SetResult (interp,"forget: cannot close the dbf inside its foreach",TCL_STATIC);
+				return (TCL_ERROR);
+				}
 			if (df) {
-				Tcl_FreeEncoding(enc);
-				DBFClose (df);
-				free(clientData);
+				int result = close_handle (interp,di);
+
 				Tcl_DeleteCommand (interp,Tcl_GetString(objv[0]));
+				if (result == TCL_ERROR)
+					return (TCL_ERROR);
 				Tcl_SetResult (interp,success,TCL_STATIC);
 				}
 			else
@@ -930,14 +2327,123 @@ int process_dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_O
 	return (TCL_OK);
 	}
 
+/*----------------------------------------------------------------------*\
+ | A new command in this interpreter for a handle, its name set in		|
+ | variable_name.														|
+\*----------------------------------------------------------------------*/
+
+static void new_command (Tcl_Interp *interp, struct dbf_interp *state, char *variable_name, struct dbf_info *di) {
+	char id [64];
+
+	sprintf (id,"dbf.%04X",state->handles++);
+	Tcl_SetVar (interp,variable_name,id,0);
+	Tcl_CreateObjCommand (interp,id,(Tcl_ObjCmdProc *) process_dbf_cmd,(ClientData)di,di->share ? release_command : (Tcl_CmdDeleteProc *)NULL);
+	}
+
+/*----------------------------------------------------------------------*\
+ | A new handle for an open dbf, and its command.						|
+\*----------------------------------------------------------------------*/
+
+static struct dbf_info *new_handle (Tcl_Interp *interp, struct dbf_interp *state, char *variable_name, DBFHandle df, Tcl_Obj *path, int mapped, int readonly, const char *share) {
+	struct dbf_info * di = malloc (sizeof (struct dbf_info));
+	char *normalized = Tcl_GetString(Tcl_FSGetNormalizedPath (interp,path));
+
+	di->df = df;
+	di->iterating = 0;
+	di->path = strcpy (ckalloc (strlen (normalized) + 1),normalized);
+	di->mapped = mapped;
+	di->readonly = readonly;
+	di->indexes = NULL;
+	di->pending = -1;
+	di->columnar = NULL;
+	di->columnar_looked = 0;
+	di->conversions = 0;
+	di->tcl_conversions = 0;
+	di->enc = Tcl_GetEncoding(NULL,get_encoding(df->pszCodePage));
+	di->codepage = codepage_new (di->enc);
+	di->share = NULL;
+	di->users = 1;
+	di->lock = NULL;
+	di->unlocked = NULL;
+	di->owner = NULL;
+	di->depth = 0;
+	if (share) {
+		di->share = strcpy (ckalloc (strlen (share) + 1),share);
+		}
+	new_field_tag (di);
+	new_command (interp,state,variable_name,di);
+	return (di);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Open input_file as the handle shared by the name share, unless it is	|
+ | open already: then only make a command for it in this interpreter.	|
+\*----------------------------------------------------------------------*/
+
+static int open_shared (Tcl_Interp *interp, struct dbf_interp *state, char *variable_name, const char *share, Tcl_Obj *path, const char *input_file, int mapped, SAOffset cachesize) {
+	Tcl_Obj *normalized = Tcl_FSGetNormalizedPath (interp,path);
+	Tcl_HashEntry *entry;
+	struct dbf_info *di;
+	DBFHandle df;
+	int created;
+
+	if (!normalized)
+		return (TCL_ERROR);
+
+	Tcl_MutexLock (&shared_handles_mutex);
+	if (!shared_handles_ready) {
+		Tcl_InitHashTable (&shared_handles,TCL_STRING_KEYS);
+		shared_handles_ready = 1;
+		}
+	entry = Tcl_CreateHashEntry (&shared_handles,share,&created);
+	if (!created) {
+		di = (struct dbf_info *) Tcl_GetHashValue (entry);
+		if (strcmp (di->path,Tcl_GetString(normalized)) != 0) {
+			Tcl_MutexUnlock (&shared_handles_mutex);
+			Tcl_SetResult (interp,"Error: -share ",TCL_STATIC);
+			Tcl_AppendResult (interp,share," is the name of another file, ",di->path,NULL);
+			return (TCL_ERROR);
+			}
+		di->users++;
+		Tcl_MutexUnlock (&shared_handles_mutex);
+		new_command (interp,state,variable_name,di);
+		Tcl_SetResult (interp,success,TCL_STATIC);
+		return (TCL_OK);
+		}
+
+	if (mapped) {
+		SAHooks hooks;
+		SASetupMmapHooks (&hooks);
+		df = DBFOpenLL (input_file,"rb",&hooks);
+		}
+	else
+		df = DBFOpen (input_file,"rb");
+	if (!df) {
+		Tcl_DeleteHashEntry (entry);
+		Tcl_MutexUnlock (&shared_handles_mutex);
+		Tcl_SetResult (interp,"Error: could not open input file ",TCL_STATIC);
+		Tcl_AppendResult (interp,input_file,NULL);
+		return (TCL_ERROR);
+		}
+	if (cachesize > 0 && !mapped)
+		DBFSetCacheSize (df,cachesize);
+	Tcl_SetHashValue (entry,(ClientData) new_handle (interp,state,variable_name,df,path,mapped,1,share));
+	Tcl_MutexUnlock (&shared_handles_mutex);
+	Tcl_SetResult (interp,success,TCL_STATIC);
+	return (TCL_OK);
+	}
+
 int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CONST objv[]) {
+	struct dbf_interp *state = (struct dbf_interp *) clientData;
 	char *variable_name;
 	char *input_file = NULL;
 	char *output_file = NULL;
-	char id [64];
 	char *mode;
 	char *text_buffer = NULL;
 	DBFHandle df;
+	int k, mapped = 0, bulkload = 0;
+	SAOffset cachesize = 0;
+	char *share = NULL;
 
 	Tcl_ResetResult (interp);
 
@@ -959,36 +2465,77 @@ int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CON
 					input_file = Tcl_UtfToExternalDString(NULL, Tcl_TranslateFileName(interp, Tcl_GetString(objv[3]), &s), -1, &e);
 
 					mode = "rb+";
-					if (objc > 4)
-						if (strcmp (Tcl_GetString(objv[4]),"-readonly") == 0) mode = "rb";
+					for (k=4; k < objc; k++) {
+						char *option = Tcl_GetString(objv[k]);
+						if (strcmp (option,"-readonly") == 0) mode = "rb";
+						if (strcmp (option,"-mmap") == 0) {
+							mode = "rb";
+							mapped = 1;
+							}
+						if (strcmp (option,"-append") == 0 || strcmp (option,"-bulkload") == 0)
+							bulkload = 1;
+						if (strcmp (option,"-cachesize") == 0) {
+							if (k+1 >= objc || !get_size (Tcl_GetString(objv[k+1]),&cachesize)) {
+								Tcl_SetResult (interp,"Error: -cachesize expects a size such as 65536, 512K or 64M",TCL_STATIC);
+								Tcl_DStringFree(&e);
+								Tcl_DStringFree(&s);
+								return (TCL_ERROR);
+								}
+							k++;
+							}
+						if (strcmp (option,"-share") == 0 && k+1 < objc)
+							share = Tcl_GetString(objv[++k]);
+						}
+
+					/*--------------------------------------------------*\
+					 | A shared handle is read only, made once by name.	|
+					\*--------------------------------------------------*/
+
+					if (share) {
+						int result = TCL_ERROR;
+
+						if (strcmp (mode,"rb") != 0 || bulkload)
+							Tcl_SetResult (interp,"Error: -share needs -readonly or -mmap",TCL_STATIC);
+						else
+							result = open_shared (interp,state,variable_name,share,objv[3],input_file,mapped,cachesize);
+						Tcl_DStringFree(&e);
+						Tcl_DStringFree(&s);
+						return (result);
+						}
 
 					/*--------------------------------------------------*\
 					 | Open the input file creating a new command.		|
 					\*--------------------------------------------------*/
 
-					if (df = DBFOpen (input_file,mode)) {
-						struct dbf_info * di = malloc (sizeof (struct dbf_info));
-						di->df = df;
-						di->enc = Tcl_GetEncoding(NULL,get_encoding(df->pszCodePage));
-						sprintf (id,"dbf.%04X",record_count++);
-						Tcl_SetVar (interp,variable_name,id,0);
-						Tcl_CreateObjCommand (interp,id,(Tcl_ObjCmdProc *) process_dbf_cmd,(ClientData)di, (Tcl_CmdDeleteProc *)NULL);
+					if (mapped) {
+						SAHooks hooks;
+						SASetupMmapHooks (&hooks);
+						df = DBFOpenLL (input_file,mode,&hooks);
+						}
+					else
+						df = DBFOpen (input_file,mode);
+
+					if (df) {
+						if (cachesize > 0 && !mapped)
+							DBFSetCacheSize (df,cachesize);
+						if (bulkload && !mapped)
+							DBFSetAppendBufferSize (df,BULKLOAD_BUFFER_SIZE);
+						new_handle (interp,state,variable_name,df,objv[3],mapped,strcmp (mode,"rb") == 0,NULL);
 						Tcl_SetResult (interp,success,TCL_STATIC);
 						Tcl_DStringFree(&e);
 						Tcl_DStringFree(&s);
 						return (TCL_OK);
 						}
 					else {
-						sprintf (message,"Error: could not open input file %s",input_file);
-						Tcl_SetResult (interp,message,TCL_STATIC);
+						Tcl_SetResult (interp,"Error: could not open input file ",TCL_STATIC);
+						Tcl_AppendResult (interp,input_file,NULL);
 						Tcl_DStringFree(&e);
 						Tcl_DStringFree(&s);
 						return (TCL_ERROR);
 						}
 					}
 				else {
-					sprintf (message,"Error: no input file name given");
-					Tcl_SetResult (interp,message,TCL_STATIC);
+					Tcl_SetResult (interp,"Error: no input file name given",TCL_STATIC);
 					return (TCL_ERROR);
 					}
 				}
@@ -1007,8 +2554,13 @@ int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CON
 
 					output_file = Tcl_UtfToExternalDString(NULL, Tcl_TranslateFileName(interp, Tcl_GetString(objv[3]), &s), -1, &e);
 
-					if (objc > 5 && strcmp(Tcl_GetString(objv[4]),"-codepage") == 0)
-						codepage = Tcl_GetString(objv[5]);
+					for (k=4; k < objc; k++) {
+						char *option = Tcl_GetString(objv[k]);
+						if (strcmp (option,"-codepage") == 0 && k+1 < objc)
+							codepage = Tcl_GetString(objv[++k]);
+						else if (strcmp (option,"-bulkload") == 0)
+							bulkload = 1;
+						}
 
 					/*--------------------------------------------------*\
 					 | Open the input file creating a new command.		|
@@ -1016,12 +2568,9 @@ int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CON
 
 					if (output_file)
 						if (df = DBFCreateEx(output_file, codepage)) {
-							struct dbf_info * di = malloc (sizeof (struct dbf_info));
-							di->df = df;
-							di->enc = Tcl_GetEncoding(NULL,get_encoding(df->pszCodePage));
-							sprintf (id,"dbf.%04X",record_count++);
-							Tcl_SetVar (interp,variable_name,id,0);
-							Tcl_CreateObjCommand (interp,id,(Tcl_ObjCmdProc *) process_dbf_cmd,(ClientData)di, (Tcl_CmdDeleteProc *)NULL);
+							if (bulkload)
+								DBFSetAppendBufferSize (df,BULKLOAD_BUFFER_SIZE);
+							new_handle (interp,state,variable_name,df,objv[3],0,0,NULL);
 							Tcl_SetResult (interp,success,TCL_STATIC);
 							}
 						else
@@ -1034,15 +2583,32 @@ int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CON
 					return (TCL_OK);
 					}
 				else {
-					sprintf (message,"Error: no input file name given");
-					Tcl_SetResult (interp,message,TCL_STATIC);
+					Tcl_SetResult (interp,"Error: no input file name given",TCL_STATIC);
+					return (TCL_ERROR);
+					}
+				}
+
+			/*----------------------------------------------------------*\
+			 | -import csv input_file -output output_file ...
+			\*----------------------------------------------------------*/
+
+			if (strcmp (Tcl_GetString(objv[2]),"-import") == 0) {
+				Tcl_Obj *output;
+
+				if (objc < 5 || strcmp (Tcl_GetString(objv[3]),"csv") != 0) {
+					Tcl_SetResult (interp,"Error: expected -import csv and an input file name",TCL_STATIC);
 					return (TCL_ERROR);
 					}
+				if (!(df = csv_import (interp,objc,objv,&output)))
+					return (TCL_ERROR);
+				new_handle (interp,state,variable_name,df,output,0,0,NULL);
+				Tcl_SetResult (interp,success,TCL_STATIC);
+				return (TCL_OK);
 				}
 			}
 		else {
-			sprintf (message,"Error: got variable name %s, no -open or -create",Tcl_GetString(objv[1]));
-			Tcl_SetResult (interp,message,TCL_STATIC);
+			Tcl_SetResult (interp,"Error: got variable name ",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(objv[1]),", no -open or -create",NULL);
 			return (TCL_ERROR);
 			}
 		}
@@ -1055,11 +2621,18 @@ int dbf_cmd (ClientData clientData, Tcl_Interp *interp, int objc,  Tcl_Obj * CON
 
 
 int Dbf_Init (Tcl_Interp *interp) {
+	struct dbf_interp *state;
+
 	if (Tcl_InitStubs (interp,"8.1",0) == NULL) return (TCL_ERROR);
 	if (Tcl_PkgRequire (interp,"Tcl","8.0",0) == NULL) return (TCL_ERROR);
 	if (Tcl_PkgProvide (interp,PACKAGE_NAME,PACKAGE_VERSION) != TCL_OK) return (TCL_ERROR);
 
-	Tcl_CreateObjCommand (interp,"dbf",(Tcl_ObjCmdProc *) dbf_cmd,(ClientData) NULL,(Tcl_CmdDeleteProc *) NULL);
+	if (!(state = (struct dbf_interp *) Tcl_GetAssocData (interp,"dbf",NULL))) {
+		state = (struct dbf_interp *) ckalloc (sizeof (struct dbf_interp));
+		state->handles = 0;
+		Tcl_SetAssocData (interp,"dbf",free_dbf_interp,(ClientData) state);
+		}
+	Tcl_CreateObjCommand (interp,"dbf",(Tcl_ObjCmdProc *) dbf_cmd,(ClientData) state,(Tcl_CmdDeleteProc *) NULL);
 	return (TCL_OK);
 	}
 
@@ -0,0 +1,135 @@
+#ifndef _DBF_PRIVATE_H
+#define _DBF_PRIVATE_H
+
+#include <tcl.h>
+
+#include <shapefil.h>
+
+/*----------------------------------------------------------------------*\
+ | Declarations shared by the source files of the dbf package.			|
+ | Nothing here is exported from the library.							|
+\*----------------------------------------------------------------------*/
+
+#ifndef MODULE_SCOPE
+#if defined(__GNUC__) && !defined(_WIN32)
+#define MODULE_SCOPE extern __attribute__((__visibility__("hidden")))
+#else
+#define MODULE_SCOPE extern
+#endif
+#endif
+
+struct codepage;
+struct dbf_columnar;
+
+struct dbf_info {
+	DBFHandle df;
+	Tcl_Encoding enc;
+	struct codepage *codepage;	/* tables for enc */
+	size_t field_tag;	/* changes whenever the fields change */
+	int iterating;		/* foreach loops running on the handle */
+	char *path;			/* of the dbf file, normalized */
+	int mapped;			/* opened -mmap, so writes are refused */
+	int readonly;		/* opened -readonly or -mmap: sync has nothing to write */
+	struct dbf_index *indexes;
+	int pending;		/* record to put back into the indexes, or -1 */
+	struct dbf_columnar *columnar;	/* sidecar of the columns, if fresh */
+	int columnar_looked;	/* for the sidecar next to the dbf */
+	Tcl_WideInt conversions;	/* strings to or from the codepage */
+	Tcl_WideInt tcl_conversions;	/* of those, the ones Tcl's encoding did */
+	char *share;		/* name the handle is shared by across threads, or NULL */
+	int users;			/* commands on a shared handle, in all interpreters */
+	Tcl_Mutex lock;		/* guards owner and depth */
+	Tcl_Condition unlocked;
+	Tcl_ThreadId owner;	/* thread running commands on a shared handle, */
+	int depth;			/* and how many of them are nested */
+	};
+
+/* Records buffered by -bulkload before they are written */
+#define BULKLOAD_BUFFER_SIZE (8 * 1024 * 1024)
+
+/* dbf.c */
+
+MODULE_SCOPE char *dbf_type_of (DBFFieldType t);
+MODULE_SCOPE DBFFieldType dbf_get_type (char *name);
+MODULE_SCOPE char *get_encoding (char *codepage);
+MODULE_SCOPE int get_field_index (struct dbf_info *di, Tcl_Obj *obj);
+MODULE_SCOPE const char *field_text (DBFHandle df, const char *record, int j, int *length);
+MODULE_SCOPE Tcl_Obj *field_obj (struct dbf_info *di, const char *record, int j, int typed);
+MODULE_SCOPE void new_field_tag (struct dbf_info *di);
+MODULE_SCOPE Tcl_Obj *path_obj (const char *path);
+MODULE_SCOPE int truncate_dbf (Tcl_Interp *interp, struct dbf_info *di, const char *command);
+MODULE_SCOPE int check_writable (Tcl_Interp *interp, struct dbf_info *di, const char *command);
+
+/* dbfcodepage.c: text in the codepage of the dbf to and from Tcl strings */
+
+MODULE_SCOPE struct codepage *codepage_new (Tcl_Encoding enc);
+MODULE_SCOPE void codepage_free (struct codepage *cp);
+MODULE_SCOPE Tcl_Obj *external_to_obj (struct dbf_info *di, const char *s, int length);
+MODULE_SCOPE void external_to_utf (struct dbf_info *di, const char *s, int length, Tcl_DString *utf);
+MODULE_SCOPE char *utf_to_external (struct dbf_info *di, const char *s, int length, Tcl_DString *e);
+
+/* dbfwhere.c: predicates compiled from a Tcl list, tested on raw records */
+
+struct where;
+
+MODULE_SCOPE int where_compile (Tcl_Interp *interp, struct dbf_info *di, Tcl_Obj *predicate, struct where **where);
+MODULE_SCOPE int where_match (struct where *where, const char *record);
+MODULE_SCOPE void where_free (struct where *where);
+
+typedef int (where_zone) (void *data, int field, double *low, double *high);	/* 1 bounds, 0 no numbers, -1 unknown */
+
+MODULE_SCOPE int where_excludes (struct where *where, where_zone *zone, void *data);
+
+/* dbfindex.c: sidecar indexes of fields, kept current as records are written */
+
+struct dbf_index;
+
+MODULE_SCOPE int index_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+MODULE_SCOPE int lookup_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+MODULE_SCOPE void index_touch (struct dbf_info *di, int i);
+MODULE_SCOPE void index_settle (struct dbf_info *di);
+MODULE_SCOPE int index_save_all (Tcl_Interp *interp, struct dbf_info *di, int records, int changed);
+MODULE_SCOPE void index_rebuild_all (struct dbf_info *di);
+MODULE_SCOPE void index_restructure (struct dbf_info *di, const int *place);
+MODULE_SCOPE void index_free_all (struct dbf_info *di);
+
+/* dbfcolumnar.c: column-major sidecars, see columnize */
+
+typedef void (columnar_fn) (void *data, double value);
+
+MODULE_SCOPE int columnar_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+MODULE_SCOPE struct dbf_columnar *columnar_fresh (struct dbf_info *di);
+MODULE_SCOPE void columnar_forget (struct dbf_info *di);
+MODULE_SCOPE void columnar_check (struct dbf_info *di);
+MODULE_SCOPE void columnar_restamp (struct dbf_info *di);
+MODULE_SCOPE int columnar_column (struct dbf_info *di, int j, int from, int count, int typed, Tcl_Obj **values);
+MODULE_SCOPE int columnar_skip (struct dbf_columnar *c, struct where *where, int i);
+MODULE_SCOPE int columnar_numeric (struct dbf_columnar *c, int j);
+MODULE_SCOPE void columnar_fold (struct dbf_columnar *c, int j, columnar_fn *fold, void *data);
+
+/* dbfscan.c: record ranges scanned in threads, see -threads */
+
+typedef int (scan_kernel) (void *data, int i, const char *record);	/* 0 stops its range */
+
+MODULE_SCOPE int scan_threads (Tcl_Interp *interp, const char *command, Tcl_Obj *obj, int *threads);
+MODULE_SCOPE int scan_records (Tcl_Interp *interp, struct dbf_info *di, int threads, int from, int count, scan_kernel *kernel, void **data);
+
+/* dbfaggregate.c */
+
+MODULE_SCOPE int aggregate_records (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+
+/* dbfrestructure.c */
+
+MODULE_SCOPE int restructure_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+MODULE_SCOPE int optimize_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+
+/* dbfcsv.c */
+
+MODULE_SCOPE int csv_export (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+MODULE_SCOPE DBFHandle csv_import (Tcl_Interp *interp, int objc, Tcl_Obj * CONST objv[], Tcl_Obj **output);
+
+/* dbfarrow.c */
+
+MODULE_SCOPE int arrow_export (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]);
+
+#endif /* _DBF_PRIVATE_H */
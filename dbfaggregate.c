@@ -0,0 +1,505 @@
+/*----------------------------------------------------------------------*\
+ | Aggregates for $d aggregate, computed in one pass over the raw		|
+ | records.  Each aggregate is a list:									|
+ |																		|
+ | {count}				number of records								|
+ | {count field}		number of values that are not NULL				|
+ | {sum field}			sum of the values of an N or F field			|
+ | {avg field}			mean of the values of an N or F field			|
+ | {min field}			smallest value, as a number for N and F fields	|
+ | {max field}			largest value, as text for other fields			|
+ |																		|
+ | Records are grouped by the raw bytes of the -groupby fields, so		|
+ | memory grows with the number of groups, not of records.  NULL values	|
+ | and numbers that cannot be read are left out of every aggregate but	|
+ | {count}.																|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+enum agg_fn { A_COUNT, A_SUM, A_AVG, A_MIN, A_MAX };
+
+static char *fn_names[] = {"count", "sum", "avg", "min", "max", NULL};
+
+struct agg {
+	enum agg_fn fn;
+	int field;				/* -1 for {count} */
+	int numeric;			/* N or F field */
+	int text;				/* offset of the text of min and max in a group */
+	};
+
+struct acc {
+	Tcl_WideInt count;		/* values seen */
+	double value;			/* sum, min or max */
+	int length;				/* of the text of min and max */
+	};
+
+struct group {
+	struct group *next;
+	Tcl_HashEntry *entry;
+	struct acc *acc;
+	char *text;
+	};
+
+static int aggregate_error (Tcl_Interp *interp, const char *message, Tcl_Obj *spec) {
+	Tcl_SetResult (interp,"aggregate: ",TCL_STATIC);
+	Tcl_AppendResult (interp,message," in {",Tcl_GetString(spec),"}",NULL);
+	return (TCL_ERROR);
+	}
+
+static int aggregate_number (const char *t, int n, double *value) {
+	return (DBFParseDouble (t,n,value));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Sums of fields without decimals, and their minimum and maximum, are	|
+ | integers as long as a double holds them exactly.						|
+\*----------------------------------------------------------------------*/
+
+static Tcl_Obj *number_obj (DBFHandle df, int j, double d) {
+	if (df->panFieldDecimals[j] == 0 && d > -9007199254740992.0 && d < 9007199254740992.0 && d == (double) (Tcl_WideInt) d)
+		return (Tcl_NewWideIntObj ((Tcl_WideInt) d));
+	return (Tcl_NewDoubleObj (d));
+	}
+
+static void accumulate_number (struct agg *a, struct acc *c, double d) {
+	c->count++;
+	switch (a->fn) {
+		case A_SUM:
+		case A_AVG: c->value += d; break;
+		case A_MIN: if (c->count == 1 || d < c->value) c->value = d; break;
+		case A_MAX: if (c->count == 1 || d > c->value) c->value = d; break;
+		default: break;
+		}
+	}
+
+static void accumulate (DBFHandle df, struct agg *a, struct acc *c, char *text, const char *record) {
+	const char *t;
+	double d;
+	int n;
+
+	if (a->field < 0) {
+		c->count++;
+		return;
+		}
+
+	t = field_text (df,record,a->field,&n);
+	if (DBFIsFieldValueNULL (df->pachFieldType[a->field],t,n,df->panFieldSize[a->field]))
+		return;
+
+	if (a->numeric) {
+		if (aggregate_number (t,n,&d))
+			accumulate_number (a,c,d);
+		return;
+		}
+
+	c->count++;
+	if (a->fn == A_MIN || a->fn == A_MAX) {
+		char *s = text + a->text;
+		int m = c->length < n ? c->length : n;
+		int cmp = memcmp (t,s,m);
+		if (!cmp)
+			cmp = n - c->length;
+		if (c->count == 1 || (a->fn == A_MIN ? cmp < 0 : cmp > 0)) {
+			memcpy (s,t,n);
+			c->length = n;
+			}
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | Fold the accumulator of a group seen later, in another range of		|
+ | records, into c, as if its values had been accumulated after c's.	|
+\*----------------------------------------------------------------------*/
+
+static void merge (struct agg *a, struct acc *c, char *text, const struct acc *later, const char *later_text) {
+	if (later->count == 0)
+		return;
+	c->count += later->count;
+	if (a->field < 0 || a->fn == A_COUNT)
+		return;
+
+	if (a->numeric) {
+		switch (a->fn) {
+			case A_SUM:
+			case A_AVG: c->value += later->value; break;
+			case A_MIN: if (c->count == later->count || later->value < c->value) c->value = later->value; break;
+			case A_MAX: if (c->count == later->count || later->value > c->value) c->value = later->value; break;
+			default: break;
+			}
+		return;
+		}
+
+	if (a->fn == A_MIN || a->fn == A_MAX) {
+		char *s = text + a->text;
+		const char *t = later_text + a->text;
+		int m = c->length < later->length ? c->length : later->length;
+		int cmp = memcmp (t,s,m);
+		if (!cmp)
+			cmp = later->length - c->length;
+		if (c->count == later->count || (a->fn == A_MIN ? cmp < 0 : cmp > 0)) {
+			memcpy (s,t,later->length);
+			c->length = later->length;
+			}
+		}
+	}
+
+static Tcl_Obj *result_obj (struct dbf_info *di, struct agg *a, struct acc *c, char *text) {
+	DBFHandle df = di->df;
+
+	if (a->fn == A_COUNT)
+		return (Tcl_NewWideIntObj (c->count));
+	if (c->count == 0)
+		return (Tcl_NewStringObj ("",0));
+	if (a->fn == A_AVG)
+		return (Tcl_NewDoubleObj (c->value / (double) c->count));
+	if (a->numeric)
+		return (number_obj (df,a->field,c->value));
+
+	return (external_to_obj (di,text + a->text,c->length));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Parse one aggregate, e.g. {sum AMOUNT}, into a; text_size grows by	|
+ | the room min and max need for the text of other fields.				|
+\*----------------------------------------------------------------------*/
+
+static int parse_aggregate (Tcl_Interp *interp, struct dbf_info *di, Tcl_Obj *spec, struct agg *a, int *text_size) {
+	DBFHandle df = di->df;
+	Tcl_Obj **objv;
+	char *name;
+	int objc, i;
+
+	if (Tcl_ListObjGetElements (interp,spec,&objc,&objv) == TCL_ERROR)
+		return (TCL_ERROR);
+	if (objc < 1 || objc > 2)
+		return (aggregate_error (interp,"expected {count}, {count field}, {sum field}, {avg field}, {min field} or {max field}",spec));
+
+	name = Tcl_GetString(objv[0]);
+	for (i=0; fn_names[i]; i++)
+		if (strcmp (name,fn_names[i]) == 0)
+			break;
+	if (!fn_names[i])
+		return (aggregate_error (interp,"unknown function",spec));
+
+	a->fn = (enum agg_fn) i;
+	a->field = -1;
+	a->numeric = 0;
+	a->text = 0;
+
+	if (objc == 1) {
+		if (a->fn != A_COUNT)
+			return (aggregate_error (interp,"expected a field name",spec));
+		return (TCL_OK);
+		}
+
+	if ((a->field = get_field_index (di,objv[1])) == -1) {
+		Tcl_SetResult (interp,"aggregate: ",TCL_STATIC);
+		Tcl_AppendResult (interp,Tcl_GetString(objv[1])," does not match a field name in this dbf file",NULL);
+		return (TCL_ERROR);
+		}
+	a->numeric = (df->pachFieldType[a->field] == 'N' || df->pachFieldType[a->field] == 'F');
+	if ((a->fn == A_SUM || a->fn == A_AVG) && !a->numeric)
+		return (aggregate_error (interp,"sum and avg take only N and F fields",spec));
+	if ((a->fn == A_MIN || a->fn == A_MAX) && !a->numeric) {
+		a->text = *text_size;
+		*text_size += df->panFieldSize[a->field];
+		}
+	return (TCL_OK);
+	}
+
+static struct group *new_group (Tcl_HashEntry *entry, int agg_count, int text_size) {
+	struct group *g = (struct group *) ckalloc (sizeof (struct group) + agg_count * sizeof (struct acc) + text_size);
+	g->next = NULL;
+	g->entry = entry;
+	g->acc = (struct acc *) (g + 1);
+	g->text = (char *) (g->acc + agg_count);
+	memset (g->acc,0,agg_count * sizeof (struct acc));
+	Tcl_SetHashValue (entry,g);
+	return (g);
+	}
+
+/*----------------------------------------------------------------------*\
+ | The groups of one range of records, in the order they are first		|
+ | seen; aggregate -threads has one per thread.							|
+\*----------------------------------------------------------------------*/
+
+struct agg_scan {
+	DBFHandle df;
+	struct where *where;
+	struct agg *aggs;
+	int agg_count;
+	int *group_index;
+	int group_count;
+	int text_size;
+	int *key;
+	Tcl_HashTable groups;
+	struct group *first, *last;
+	};
+
+static void scan_init (struct agg_scan *s, int key_words) {
+	s->key = (int *) ckalloc (key_words * sizeof (int));
+	memset (s->key,0,key_words * sizeof (int));
+	Tcl_InitHashTable (&s->groups,key_words);
+	s->first = s->last = NULL;
+	}
+
+static void scan_free (struct agg_scan *s) {
+	struct group *g;
+	while (s->first) {
+		g = s->first->next;
+		ckfree ((char *) s->first);
+		s->first = g;
+		}
+	Tcl_DeleteHashTable (&s->groups);
+	ckfree ((char *) s->key);
+	}
+
+static struct group *find_group (struct agg_scan *s, const int *key) {
+	int isnew;
+	Tcl_HashEntry *entry = Tcl_CreateHashEntry (&s->groups,(const char *) key,&isnew);
+	struct group *g;
+
+	if (!isnew)
+		return ((struct group *) Tcl_GetHashValue (entry));
+	g = new_group (entry,s->agg_count,s->text_size);
+	if (s->last)
+		s->last->next = g;
+	else
+		s->first = g;
+	s->last = g;
+	return (g);
+	}
+
+static int aggregate_kernel (void *data, int i, const char *record) {
+	struct agg_scan *s = (struct agg_scan *) data;
+	DBFHandle df = s->df;
+	char *p = (char *) s->key;
+	struct group *g;
+	int j, k;
+	(void) i;
+
+	if (s->where && !where_match (s->where,record))
+		return (1);
+
+	for (j=0; j < s->group_count; j++) {
+		int w = df->panFieldSize[s->group_index[j]];
+		memcpy (p,record + df->panFieldOffset[s->group_index[j]],w);
+		p += w;
+		}
+
+	g = find_group (s,s->key);
+	for (k=0; k < s->agg_count; k++)
+		accumulate (df,s->aggs + k,g->acc + k,g->text,record);
+	return (1);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Without -where or -groupby, aggregates of numbers alone are folded	|
+ | straight from the sidecar of the dbf, if it has their columns, in	|
+ | record order as the scan would.  Returns 0 if it cannot be used.		|
+\*----------------------------------------------------------------------*/
+
+struct agg_fold {
+	struct agg *agg;
+	struct acc *acc;
+	};
+
+static void fold_number (void *data, double d) {
+	struct agg_fold *f = (struct agg_fold *) data;
+	accumulate_number (f->agg,f->acc,d);
+	}
+
+static int aggregate_columnar (struct dbf_info *di, struct agg_scan *s) {
+	struct dbf_columnar *c = columnar_fresh (di);
+	struct agg_fold f;
+	struct group *g;
+	int k;
+
+	if (!c)
+		return (0);
+	for (k=0; k < s->agg_count; k++)
+		if (s->aggs[k].field >= 0 && (!s->aggs[k].numeric || !columnar_numeric (c,s->aggs[k].field)))
+			return (0);
+
+	g = find_group (s,s->key);
+	for (k=0; k < s->agg_count; k++) {
+		f.agg = s->aggs + k;
+		f.acc = g->acc + k;
+		if (f.agg->field < 0)
+			f.acc->count = DBFGetRecordCount (di->df);
+		else
+			columnar_fold (c,f.agg->field,fold_number,&f);
+		}
+	return (1);
+	}
+
+/*----------------------------------------------------------------------*\
+ | aggregate [-groupby <list>] [-where <predicate>] [-typed] <agg> ...	|
+ | returns one row per group, in the order the groups are first seen:	|
+ | the values of the -groupby fields followed by the aggregates.		|
+ | Without -groupby there is exactly one row, even for no records.		|
+\*----------------------------------------------------------------------*/
+
+int aggregate_records (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	Tcl_Obj *groupby = NULL, *predicate = NULL, *obj;
+	Tcl_Obj **group_objv;
+	struct where *where = NULL;
+	struct agg *aggs;
+	struct agg_scan *scans;
+	struct group *g;
+	void **data;
+	int *group_index = NULL;
+	char *record_buffer;
+	int typed = 0, group_count = 0, agg_count = 0, key_length = 0, key_words, text_size = 0, threads = 1;
+	int result = TCL_OK;
+	int rc, used, i, j, k, t;
+
+	aggs = (struct agg *) ckalloc (objc * sizeof (struct agg));
+
+	for (k=2; k < objc && result == TCL_OK; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-groupby") == 0 && k+1 < objc)
+			groupby = objv[++k];
+		else if (strcmp (option,"-where") == 0 && k+1 < objc)
+			predicate = objv[++k];
+		else if (strcmp (option,"-typed") == 0)
+			typed = 1;
+		else if (strcmp (option,"-threads") == 0 && k+1 < objc)
+			result = scan_threads (interp,"aggregate",objv[++k],&threads);
+		else if ((result = parse_aggregate (interp,di,objv[k],aggs + agg_count,&text_size)) == TCL_OK)
+			agg_count++;
+		}
+
+	if (result == TCL_OK && agg_count == 0) {
+		Tcl_SetResult (interp,"aggregate expects at least one of {count}, {sum field}, {avg field}, {min field} or {max field}",TCL_STATIC);
+		result = TCL_ERROR;
+		}
+
+	if (result == TCL_OK && groupby) {
+		result = Tcl_ListObjGetElements (interp,groupby,&group_count,&group_objv);
+		if (result == TCL_OK)
+			group_index = (int *) ckalloc ((group_count > 0 ? group_count : 1) * sizeof (int));
+		for (j=0; j < group_count && result == TCL_OK; j++) {
+			if ((group_index[j] = get_field_index (di,group_objv[j])) == -1) {
+				Tcl_SetResult (interp,"aggregate: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(group_objv[j])," does not match a field name in this dbf file",NULL);
+				result = TCL_ERROR;
+				}
+			else
+				key_length += df->panFieldSize[group_index[j]];
+			}
+		}
+
+	if (result == TCL_OK && predicate)
+		result = where_compile (interp,di,predicate,&where);
+
+	if (result == TCL_ERROR) {
+		if (group_index)
+			ckfree ((char *) group_index);
+		ckfree ((char *) aggs);
+		return (TCL_ERROR);
+		}
+
+	/* Keys are arrays of ints; an array of one would be a one word key */
+
+	key_words = (key_length + sizeof (int) - 1) / sizeof (int);
+	if (key_words < 2)
+		key_words = 2;
+
+	scans = (struct agg_scan *) ckalloc (threads * sizeof (struct agg_scan));
+	data = (void **) ckalloc (threads * sizeof (void *));
+	for (t=0; t < threads; t++) {
+		struct agg_scan *s = scans + t;
+		s->df = df;
+		s->where = where;
+		s->aggs = aggs;
+		s->agg_count = agg_count;
+		s->group_index = group_index;
+		s->group_count = group_count;
+		s->text_size = text_size;
+		scan_init (s,key_words);
+		data[t] = s;
+		}
+
+	rc = DBFGetRecordCount (df);
+	if (!where && group_count == 0 && aggregate_columnar (di,scans))
+		used = 1;
+	else if (threads > 1)
+		used = scan_records (interp,di,threads,0,rc,aggregate_kernel,data);
+	else {
+		for (i=0; i < rc; i++) {
+			const char *record = DBFReadTuple (df,i);
+			if (record)
+				aggregate_kernel (scans,i,record);
+			}
+		used = 1;
+		}
+
+	/* Groups of later ranges fold into those of the first, keeping the	*/
+	/* order in which they were first seen								*/
+
+	for (t=1; t < used; t++)
+		for (g=scans[t].first; g; g=g->next) {
+			struct group *h = find_group (scans,(const int *) Tcl_GetHashKey (&scans[t].groups,g->entry));
+			for (k=0; k < agg_count; k++)
+				merge (aggs + k,h->acc + k,h->text,g->acc + k,g->text);
+			}
+	for (t=1; t < threads; t++)
+		scan_free (scans + t);
+
+	if (used < 0) {
+		scan_free (scans);
+		ckfree ((char *) data);
+		ckfree ((char *) scans);
+		where_free (where);
+		if (group_index)
+			ckfree ((char *) group_index);
+		ckfree ((char *) aggs);
+		return (TCL_ERROR);
+		}
+
+	/* Without -groupby there is always one row */
+
+	if (!scans->first && group_count == 0)
+		find_group (scans,scans->key);
+
+	/* The values of the group fields are read back from their keys */
+
+	record_buffer = ckalloc (df->nRecordLength + 1);
+	memset (record_buffer,' ',df->nRecordLength);
+	record_buffer[df->nRecordLength] = '\0';
+
+	obj = Tcl_NewListObj (0,NULL);
+	for (g=scans->first; g; g=g->next) {
+		Tcl_Obj *row = Tcl_NewListObj (0,NULL);
+		char *p = (char *) Tcl_GetHashKey (&scans->groups,g->entry);
+		for (j=0; j < group_count; j++) {
+			int w = df->panFieldSize[group_index[j]];
+			memcpy (record_buffer + df->panFieldOffset[group_index[j]],p,w);
+			p += w;
+			Tcl_ListObjAppendElement (NULL,row,field_obj (di,record_buffer,group_index[j],typed));
+			}
+		for (k=0; k < agg_count; k++)
+			Tcl_ListObjAppendElement (NULL,row,result_obj (di,aggs + k,g->acc + k,g->text));
+		Tcl_ListObjAppendElement (NULL,obj,row);
+		}
+
+	scan_free (scans);
+	ckfree ((char *) data);
+	ckfree ((char *) scans);
+	ckfree (record_buffer);
+	where_free (where);
+	if (group_index)
+		ckfree ((char *) group_index);
+	ckfree ((char *) aggs);
+	Tcl_SetObjResult (interp,obj);
+	return (TCL_OK);
+	}
@@ -0,0 +1,636 @@
+/*----------------------------------------------------------------------*\
+ | Arrow IPC files (Feather v2) for $d export arrow.  Records are read	|
+ | a batch at a time and their fields turned straight into Arrow		|
+ | columns: N and F fields without decimals become int64, other N and	|
+ | F fields float64, L bool, D date32 and the rest utf8, converted from	|
+ | the codepage of the dbf.  A value is null where DBFIsValueNULL says	|
+ | so, or where it cannot be read as its type.							|
+ |																		|
+ | The file is the magic, a schema message, one record batch message	|
+ | per batch, an end of stream marker and a footer listing the batches.	|
+ | The metadata of each message is a flatbuffer, built here back to		|
+ | front as the flatbuffers library builds them, so that nothing beyond	|
+ | Tcl is needed.  All numbers are little endian.						|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+#define ARROW_BATCH_SIZE 65536	/* records in each record batch */
+#define ARROW_BODY_LIMIT (1 << 29)	/* bytes of fixed width buffers, and again of text, in a batch */
+#define ARROW_VERSION 4			/* MetadataVersion V5 */
+
+/* Message headers and types, as numbered in Message.fbs and Schema.fbs */
+
+enum { H_SCHEMA = 1, H_RECORD_BATCH = 3 };
+enum { T_INT = 2, T_FLOATING_POINT = 3, T_UTF8 = 5, T_BOOL = 6, T_DATE = 8 };
+
+enum arrow_kind { K_INT64, K_DOUBLE, K_BOOL, K_DATE, K_UTF8 };
+
+static void put16 (unsigned char *p, unsigned int v) {
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+	}
+
+static void put32 (unsigned char *p, unsigned int v) {
+	put16 (p,v & 0xFFFF);
+	put16 (p + 2,v >> 16);
+	}
+
+static void put64 (unsigned char *p, Tcl_WideUInt v) {
+	put32 (p,(unsigned int) (v & 0xFFFFFFFF));
+	put32 (p + 4,(unsigned int) (v >> 32));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Flatbuffer builder.  The buffer fills from its end towards its		|
+ | start, so an object is finished before anything that refers to it	|
+ | and every reference points forward.  Offsets are counted from the	|
+ | end, which stays put when the buffer grows.							|
+\*----------------------------------------------------------------------*/
+
+struct fb {
+	unsigned char *buffer;
+	int capacity;
+	int head;				/* the data is buffer[head .. capacity) */
+	int minalign;
+	int fields[8];			/* of the open table, by id; 0 if not set */
+	int count;				/* fields the open table can have */
+	int start;
+	};
+
+#define FB_SIZE(b) ((b)->capacity - (b)->head)
+
+static void fb_init (struct fb *b) {
+	b->capacity = b->head = 1024;
+	b->buffer = (unsigned char *) ckalloc (b->capacity);
+	b->minalign = 1;
+	}
+
+static void fb_grow (struct fb *b, int n) {
+	while (b->head < n) {
+		int size = FB_SIZE(b);
+		unsigned char *buffer = (unsigned char *) ckalloc (2 * b->capacity);
+		memcpy (buffer + 2 * b->capacity - size,b->buffer + b->head,size);
+		ckfree ((char *) b->buffer);
+		b->buffer = buffer;
+		b->head += b->capacity;
+		b->capacity *= 2;
+		}
+	}
+
+static void fb_push (struct fb *b, const void *p, int n) {
+	fb_grow (b,n);
+	b->head -= n;
+	if (p)
+		memcpy (b->buffer + b->head,p,n);
+	else
+		memset (b->buffer + b->head,0,n);
+	}
+
+/* Pad so that size is aligned once additional more bytes are pushed */
+
+static void fb_prep (struct fb *b, int size, int additional) {
+	if (size > b->minalign)
+		b->minalign = size;
+	fb_push (b,NULL,(int) ((~((unsigned int) FB_SIZE(b) + additional) + 1) & (size - 1)));
+	}
+
+static void fb_scalar (struct fb *b, Tcl_WideUInt v, int size) {
+	unsigned char p[8];
+	put64 (p,v);
+	fb_prep (b,size,0);
+	fb_push (b,p,size);
+	}
+
+static int fb_offset (struct fb *b, int offset) {
+	fb_prep (b,4,0);
+	fb_scalar (b,(Tcl_WideUInt) (FB_SIZE(b) + 4 - offset),4);
+	return (FB_SIZE(b));
+	}
+
+static int fb_string (struct fb *b, const char *s, int n) {
+	fb_prep (b,4,n + 1);
+	fb_push (b,NULL,1);
+	fb_push (b,s,n);
+	fb_scalar (b,(Tcl_WideUInt) n,4);
+	return (FB_SIZE(b));
+	}
+
+static int fb_offsets (struct fb *b, const int *offsets, int n) {
+	int k;
+	fb_prep (b,4,4 * n);
+	for (k=n-1; k >= 0; k--)
+		fb_offset (b,offsets[k]);
+	fb_scalar (b,(Tcl_WideUInt) n,4);
+	return (FB_SIZE(b));
+	}
+
+/* A vector of n structs of size bytes, aligned to 8, laid out in p */
+
+static int fb_structs (struct fb *b, const unsigned char *p, int size, int n) {
+	fb_prep (b,4,size * n);
+	fb_prep (b,8,size * n);
+	fb_push (b,p,size * n);
+	fb_scalar (b,(Tcl_WideUInt) n,4);
+	return (FB_SIZE(b));
+	}
+
+static void fb_table (struct fb *b, int count) {
+	memset (b->fields,0,sizeof (b->fields));
+	b->count = count;
+	b->start = FB_SIZE(b);
+	}
+
+static void fb_field (struct fb *b, int id, Tcl_WideUInt v, int size) {
+	fb_scalar (b,v,size);
+	b->fields[id] = FB_SIZE(b);
+	}
+
+static void fb_field_offset (struct fb *b, int id, int offset) {
+	b->fields[id] = fb_offset (b,offset);
+	}
+
+static int fb_end (struct fb *b) {
+	int table, vtable, id;
+
+	fb_scalar (b,0,4);
+	table = FB_SIZE(b);
+	for (id=b->count-1; id >= 0; id--)
+		fb_scalar (b,(Tcl_WideUInt) (b->fields[id] ? table - b->fields[id] : 0),2);
+	fb_scalar (b,(Tcl_WideUInt) (table - b->start),2);
+	fb_scalar (b,(Tcl_WideUInt) (2 * (b->count + 2)),2);
+	vtable = FB_SIZE(b);
+	put32 (b->buffer + b->capacity - table,(unsigned int) (vtable - table));
+	return (table);
+	}
+
+static void fb_finish (struct fb *b, int root) {
+	fb_prep (b,b->minalign,4);
+	fb_offset (b,root);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Columns, with the buffers of the batch being built.					|
+\*----------------------------------------------------------------------*/
+
+struct arrow_column {
+	int field;
+	enum arrow_kind kind;
+	Tcl_DString name;		/* UTF-8 */
+	unsigned char *validity;
+	unsigned char *values;	/* 8 bytes a value, 4 for dates, bits for bool */
+	unsigned char *offsets;	/* utf8 only */
+	Tcl_DString text;		/* utf8 only */
+	int nulls;
+	};
+
+static void field_type (struct fb *b, struct arrow_column *c, int *type_type, int *type) {
+	switch (c->kind) {
+		case K_INT64:
+			fb_table (b,2);
+			fb_field (b,0,64,4);			/* bitWidth */
+			fb_field (b,1,1,1);				/* is_signed */
+			*type_type = T_INT;
+			break;
+		case K_DOUBLE:
+			fb_table (b,1);
+			fb_field (b,0,2,2);				/* precision DOUBLE */
+			*type_type = T_FLOATING_POINT;
+			break;
+		case K_BOOL:
+			fb_table (b,0);
+			*type_type = T_BOOL;
+			break;
+		case K_DATE:
+			fb_table (b,1);
+			fb_field (b,0,0,2);				/* unit DAY */
+			*type_type = T_DATE;
+			break;
+		default:
+			fb_table (b,0);
+			*type_type = T_UTF8;
+			break;
+		}
+	*type = fb_end (b);
+	}
+
+static int arrow_schema (struct fb *b, struct arrow_column *columns, int count) {
+	int *fields = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+	int k, vector;
+
+	for (k=0; k < count; k++) {
+		int name, type_type, type, children;
+		name = fb_string (b,Tcl_DStringValue(&columns[k].name),Tcl_DStringLength(&columns[k].name));
+		field_type (b,columns + k,&type_type,&type);
+		children = fb_offsets (b,NULL,0);
+		fb_table (b,7);
+		fb_field_offset (b,0,name);
+		fb_field_offset (b,3,type);
+		fb_field_offset (b,5,children);
+		fb_field (b,1,1,1);					/* nullable */
+		fb_field (b,2,(Tcl_WideUInt) type_type,1);
+		fields[k] = fb_end (b);
+		}
+	vector = fb_offsets (b,fields,count);
+	ckfree ((char *) fields);
+
+	fb_table (b,4);
+	fb_field_offset (b,1,vector);
+	fb_field (b,0,0,2);						/* endianness Little */
+	return (fb_end (b));
+	}
+
+static int arrow_message (struct fb *b, int header_type, int header, Tcl_WideInt body_length) {
+	fb_table (b,5);
+	fb_field (b,3,(Tcl_WideUInt) body_length,8);
+	fb_field_offset (b,2,header);
+	fb_field (b,0,ARROW_VERSION,2);
+	fb_field (b,1,(Tcl_WideUInt) header_type,1);
+	return (fb_end (b));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Writing, with the position in the file kept for the footer.			|
+\*----------------------------------------------------------------------*/
+
+struct arrow_file {
+	Tcl_Channel channel;
+	Tcl_WideInt position;
+	int failed;
+	Tcl_DString blocks;		/* Block structs of the record batches */
+	};
+
+static void arrow_write (struct arrow_file *f, const void *p, int n) {
+	static const char zeros[8] = {0};
+	if (!f->failed && n > 0 && Tcl_Write (f->channel,p ? (const char *) p : zeros,n) != n)
+		f->failed = 1;
+	f->position += n;
+	}
+
+/* An encapsulated message: marker, metadata length, metadata, body */
+
+static void write_message (struct arrow_file *f, struct fb *b, const char *body, int body_length, int block) {
+	int size = FB_SIZE(b), padded = (8 + size + 7) & ~7;
+	unsigned char prefix[8], p[24];
+
+	if (block) {
+		put64 (p,(Tcl_WideUInt) f->position);
+		put32 (p + 8,(unsigned int) padded);
+		put32 (p + 12,0);
+		put64 (p + 16,(Tcl_WideUInt) body_length);
+		Tcl_DStringAppend(&f->blocks,(char *) p,24);
+		}
+	put32 (prefix,0xFFFFFFFF);
+	put32 (prefix + 4,(unsigned int) (padded - 8));
+	arrow_write (f,prefix,8);
+	arrow_write (f,b->buffer + b->head,size);
+	arrow_write (f,NULL,padded - 8 - size);
+	arrow_write (f,body,body_length);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Days from 1970-01-01 to a date, for date32.							|
+\*----------------------------------------------------------------------*/
+
+static int days_from_civil (int y, int m, int d) {
+	int era, yoe, doy, doe;
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return (era * 146097 + doe - 719468);
+	}
+
+static int date_days (const char *t, int n, int *days) {
+	int k, y = 0, m, d;
+
+	if (n != 8)
+		return (0);
+	for (k=0; k < 8; k++)
+		if (t[k] < '0' || t[k] > '9')
+			return (0);
+	for (k=0; k < 4; k++)
+		y = y * 10 + t[k] - '0';
+	m = (t[4] - '0') * 10 + t[5] - '0';
+	d = (t[6] - '0') * 10 + t[7] - '0';
+	if (m < 1 || m > 12 || d < 1 || d > 31)
+		return (0);
+	*days = days_from_civil (y,m,d);
+	return (1);
+	}
+
+/* Value i of the batch of column c, from field f of a raw record */
+
+static void arrow_value (struct dbf_info *di, struct arrow_column *c, int i, const char *record) {
+	DBFHandle df = di->df;
+	int n, j = c->field, valid = 0, days;
+	const char *t = field_text (df,record,j,&n);
+	int64_t w;
+	double d;
+
+	if (!DBFIsFieldValueNULL (df->pachFieldType[j],t,n,df->panFieldSize[j]))
+		switch (c->kind) {
+			case K_INT64:
+				if ((valid = DBFParseInteger (t,n,&w)))
+					put64 (c->values + 8 * i,(Tcl_WideUInt) w);
+				break;
+			case K_DOUBLE:
+				if ((valid = DBFParseDouble (t,n,&d))) {
+					Tcl_WideUInt u;
+					memcpy (&u,&d,8);
+					put64 (c->values + 8 * i,u);
+					}
+				break;
+			case K_BOOL:
+				if (n > 0 && strchr ("TtYy",*t)) {
+					c->values[i / 8] |= (unsigned char) (1 << (i % 8));
+					valid = 1;
+					}
+				else if (n > 0 && strchr ("FfNn",*t))
+					valid = 1;
+				break;
+			case K_DATE:
+				if ((valid = date_days (t,n,&days)))
+					put32 (c->values + 4 * i,(unsigned int) days);
+				break;
+			case K_UTF8:
+				external_to_utf (di,t,n,&c->text);
+				valid = 1;
+				break;
+			}
+	if (valid)
+		c->validity[i / 8] |= (unsigned char) (1 << (i % 8));
+	else
+		c->nulls++;
+	if (c->kind == K_UTF8)
+		put32 (c->offsets + 4 * (i + 1),(unsigned int) Tcl_DStringLength(&c->text));
+	}
+
+/*----------------------------------------------------------------------*\
+ | One record batch of n records: the buffers of every column go into	|
+ | the body, each padded to 8 bytes, and the metadata says where.		|
+\*----------------------------------------------------------------------*/
+
+static void append_buffer (Tcl_DString *body, unsigned char *buffers, int *nbuffers, const void *p, int n) {
+	int offset = Tcl_DStringLength(body);
+	put64 (buffers + 16 * *nbuffers,(Tcl_WideUInt) offset);
+	put64 (buffers + 16 * *nbuffers + 8,(Tcl_WideUInt) n);
+	(*nbuffers)++;
+	Tcl_DStringAppend(body,(const char *) p,n);
+	Tcl_DStringSetLength(body,(offset + n + 7) & ~7);
+	memset (Tcl_DStringValue(body) + offset + n,0,Tcl_DStringLength(body) - offset - n);
+	}
+
+static void write_batch (struct arrow_file *f, struct arrow_column *columns, int count, int n, Tcl_DString *body) {
+	unsigned char *nodes = (unsigned char *) ckalloc ((count > 0 ? count : 1) * 16);
+	unsigned char *buffers = (unsigned char *) ckalloc ((count > 0 ? count : 1) * 3 * 16);
+	int bitmap = (n + 7) / 8, nbuffers = 0, k;
+	struct fb b;
+	int node_vector, buffer_vector, batch;
+
+	Tcl_DStringSetLength(body,0);
+	for (k=0; k < count; k++) {
+		struct arrow_column *c = columns + k;
+		put64 (nodes + 16 * k,(Tcl_WideUInt) n);
+		put64 (nodes + 16 * k + 8,(Tcl_WideUInt) c->nulls);
+		append_buffer (body,buffers,&nbuffers,c->validity,bitmap);
+		switch (c->kind) {
+			case K_BOOL: append_buffer (body,buffers,&nbuffers,c->values,bitmap); break;
+			case K_DATE: append_buffer (body,buffers,&nbuffers,c->values,4 * n); break;
+			case K_UTF8:
+				append_buffer (body,buffers,&nbuffers,c->offsets,4 * (n + 1));
+				append_buffer (body,buffers,&nbuffers,Tcl_DStringValue(&c->text),Tcl_DStringLength(&c->text));
+				break;
+			default: append_buffer (body,buffers,&nbuffers,c->values,8 * n); break;
+			}
+		}
+
+	fb_init (&b);
+	node_vector = fb_structs (&b,nodes,16,count);
+	buffer_vector = fb_structs (&b,buffers,16,nbuffers);
+	fb_table (&b,3);
+	fb_field (&b,0,(Tcl_WideUInt) n,8);
+	fb_field_offset (&b,1,node_vector);
+	fb_field_offset (&b,2,buffer_vector);
+	batch = fb_end (&b);
+	fb_finish (&b,arrow_message (&b,H_RECORD_BATCH,batch,Tcl_DStringLength(body)));
+	write_message (f,&b,Tcl_DStringValue(body),Tcl_DStringLength(body),1);
+	ckfree ((char *) b.buffer);
+	ckfree ((char *) buffers);
+	ckfree ((char *) nodes);
+	}
+
+static void reset_columns (struct arrow_column *columns, int count, int batch) {
+	int k, bitmap = (batch + 7) / 8;
+	for (k=0; k < count; k++) {
+		struct arrow_column *c = columns + k;
+		memset (c->validity,0,bitmap);
+		if (c->kind == K_BOOL)
+			memset (c->values,0,bitmap);
+		if (c->kind == K_UTF8) {
+			Tcl_DStringSetLength(&c->text,0);
+			put32 (c->offsets,0);
+			}
+		c->nulls = 0;
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | export arrow <path> [-fields <list>] [-batchsize <n>]				|
+ |																		|
+ | Returns the number of records written.								|
+\*----------------------------------------------------------------------*/
+
+int arrow_export (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	Tcl_Obj *fields = NULL, *path;
+	struct arrow_column *columns;
+	struct arrow_file f;
+	struct fb b;
+	Tcl_DString body;
+	unsigned char tail[4];
+	int batch = ARROW_BATCH_SIZE, count, rc, records = 0, i, j, k, n;
+	int fixed = 0, widest = 0, text;
+	int schema, dictionaries, blocks, footer;
+
+	if (objc < 4) {
+		Tcl_SetResult (interp,"export: arrow expects the path of the file to write",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+	path = objv[3];
+	for (k=4; k < objc; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-fields") == 0 && k+1 < objc)
+			fields = objv[++k];
+		else if (strcmp (option,"-batchsize") == 0 && k+1 < objc) {
+			if (Tcl_GetIntFromObj (NULL,objv[++k],&batch) == TCL_ERROR || batch < 1) {
+				Tcl_SetResult (interp,"export: -batchsize expects a number of records of at least 1",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			}
+		else {
+			Tcl_SetResult (interp,"export: expected -fields list or -batchsize number",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		}
+
+	/* The columns: every field or those of -fields */
+
+	if (fields) {
+		Tcl_Obj **field_objv;
+		if (Tcl_ListObjGetElements (interp,fields,&count,&field_objv) == TCL_ERROR)
+			return (TCL_ERROR);
+		columns = (struct arrow_column *) ckalloc ((count > 0 ? count : 1) * sizeof (struct arrow_column));
+		for (k=0; k < count; k++)
+			if ((columns[k].field = get_field_index (di,field_objv[k])) == -1) {
+				Tcl_SetResult (interp,"export: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(field_objv[k])," does not match a field name in this dbf file",NULL);
+				ckfree ((char *) columns);
+				return (TCL_ERROR);
+				}
+		}
+	else {
+		count = DBFGetFieldCount (df);
+		columns = (struct arrow_column *) ckalloc ((count > 0 ? count : 1) * sizeof (struct arrow_column));
+		for (k=0; k < count; k++)
+			columns[k].field = k;
+		}
+
+	rc = DBFGetRecordCount (df);
+	if (batch > rc)
+		batch = rc > 0 ? rc : 1;
+
+	for (k=0; k < count; k++) {
+		struct arrow_column *c = columns + k;
+		char name[XBASE_FLDNAME_LEN_READ + 1];
+		int width, decimals;
+
+		DBFGetFieldInfo (df,c->field,name,&width,&decimals);
+		switch (df->pachFieldType[c->field]) {
+			case 'N':
+			case 'F': c->kind = decimals == 0 && width <= 18 ? K_INT64 : K_DOUBLE; break;
+			case 'L': c->kind = K_BOOL; break;
+			case 'D': c->kind = K_DATE; break;
+			default:  c->kind = K_UTF8; break;
+			}
+		Tcl_DStringInit(&c->name);
+		external_to_utf (di,name,(int) strlen (name),&c->name);
+		Tcl_DStringInit(&c->text);
+		fixed += 1 + (c->kind == K_UTF8 ? 4 : c->kind == K_DATE ? 4 : c->kind == K_BOOL ? 1 : 8);
+		if (c->kind == K_UTF8)
+			widest += 4 * width;
+		}
+
+	/* The body of a batch and the int32 offsets into its text stay below 2^31 bytes */
+
+	if (fixed > 0 && batch > ARROW_BODY_LIMIT / fixed)
+		batch = ARROW_BODY_LIMIT / fixed;
+
+	for (k=0; k < count; k++) {
+		struct arrow_column *c = columns + k;
+		int size = c->kind == K_BOOL ? (batch + 7) / 8 : c->kind == K_DATE ? 4 * batch : c->kind == K_UTF8 ? 0 : 8 * batch;
+
+		c->validity = (unsigned char *) ckalloc ((batch + 7) / 8);
+		c->values = size ? (unsigned char *) ckalloc (size) : NULL;
+		c->offsets = c->kind == K_UTF8 ? (unsigned char *) ckalloc (4 * (batch + 1)) : NULL;
+		if (c->values)
+			memset (c->values,0,size);
+		}
+
+	if (!(f.channel = Tcl_FSOpenFileChannel (interp,path,"w",0644)))
+		n = -1;
+	else {
+		Tcl_SetChannelOption (interp,f.channel,"-translation","binary");
+		f.position = 0;
+		f.failed = 0;
+		Tcl_DStringInit(&f.blocks);
+		Tcl_DStringInit(&body);
+
+		arrow_write (&f,"ARROW1\0\0",8);
+		fb_init (&b);
+		schema = arrow_schema (&b,columns,count);
+		fb_finish (&b,arrow_message (&b,H_SCHEMA,schema,0));
+		write_message (&f,&b,NULL,0,0);
+		ckfree ((char *) b.buffer);
+
+		/* The record batches */
+
+		reset_columns (columns,count,batch);
+		for (i=0, n=0; i < rc && !f.failed; i++) {
+			const char *record = DBFReadTuple (df,i);
+			if (!record)
+				continue;
+			for (j=0, text=0; j < count; j++) {
+				arrow_value (di,columns + j,n,record);
+				if (columns[j].kind == K_UTF8)
+					text += Tcl_DStringLength(&columns[j].text);
+				}
+			records++;
+			/* Ended early when the text of another record might not fit */
+			if (++n == batch || text > ARROW_BODY_LIMIT - widest) {
+				write_batch (&f,columns,count,n,&body);
+				reset_columns (columns,count,batch);
+				n = 0;
+				}
+			}
+		if (n > 0 || Tcl_DStringLength(&f.blocks) == 0)
+			write_batch (&f,columns,count,n,&body);
+		n = records;
+
+		/* End of stream, then the footer and its length */
+
+		put32 (tail,0xFFFFFFFF);
+		arrow_write (&f,tail,4);
+		put32 (tail,0);
+		arrow_write (&f,tail,4);
+
+		fb_init (&b);
+		blocks = fb_structs (&b,(unsigned char *) Tcl_DStringValue(&f.blocks),24,Tcl_DStringLength(&f.blocks) / 24);
+		dictionaries = fb_structs (&b,NULL,24,0);
+		schema = arrow_schema (&b,columns,count);
+		fb_table (&b,5);
+		fb_field_offset (&b,1,schema);
+		fb_field_offset (&b,2,dictionaries);
+		fb_field_offset (&b,3,blocks);
+		fb_field (&b,0,ARROW_VERSION,2);
+		footer = fb_end (&b);
+		fb_finish (&b,footer);
+		arrow_write (&f,b.buffer + b.head,FB_SIZE(&b));
+		put32 (tail,(unsigned int) FB_SIZE(&b));
+		arrow_write (&f,tail,4);
+		arrow_write (&f,"ARROW1",6);
+		ckfree ((char *) b.buffer);
+
+		Tcl_DStringFree(&body);
+		Tcl_DStringFree(&f.blocks);
+		if (Tcl_Close (interp,f.channel) != TCL_OK || f.failed) {
+			Tcl_SetResult (interp,"export: could not write ",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(path),NULL);
+			n = -1;
+			}
+		}
+
+	for (k=0; k < count; k++) {
+		struct arrow_column *c = columns + k;
+		Tcl_DStringFree(&c->name);
+		Tcl_DStringFree(&c->text);
+		ckfree ((char *) c->validity);
+		if (c->values)
+			ckfree ((char *) c->values);
+		if (c->offsets)
+			ckfree ((char *) c->offsets);
+		}
+	ckfree ((char *) columns);
+
+	if (n < 0)
+		return (TCL_ERROR);
+	Tcl_SetObjResult (interp,Tcl_NewIntObj (n));
+	return (TCL_OK);
+	}
@@ -0,0 +1,229 @@
+/*----------------------------------------------------------------------*\
+ | Conversion between the codepage of a dbf and Tcl strings through		|
+ | tables made once per handle.  Most dbf codepages use one byte per	|
+ | character, so a string converts byte by byte: a 256-entry table		|
+ | holds the UTF-8 of each byte and a table of 256-character pages,		|
+ | made only for the pages the codepage uses, holds the byte of each	|
+ | character.  Text that is all ASCII is copied as it is.				|
+ |																		|
+ | Codepages that use more than one byte per character, and characters	|
+ | or bytes the tables do not cover, go through Tcl's encoding			|
+ | routines, so that the results are always the same as Tcl's.			|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+struct codepage {
+	int single;						/* one byte per character */
+	int ascii;						/* bytes below 0x80 are themselves */
+	unsigned char length[256];		/* of the UTF-8 of each byte, 0 if not in the table */
+	char utf[256][TCL_UTF_MAX];
+	unsigned char *pages[256];		/* byte of each character, 0 if none */
+	};
+
+/*----------------------------------------------------------------------*\
+ | Tables of an encoding, made by converting each byte with Tcl and		|
+ | keeping the characters that convert back to the same byte.			|
+\*----------------------------------------------------------------------*/
+
+struct codepage *codepage_new (Tcl_Encoding enc) {
+	struct codepage *cp = (struct codepage *) ckalloc (sizeof (struct codepage));
+	int b;
+
+	memset (cp,0,sizeof (struct codepage));
+	cp->single = 1;
+	cp->ascii = 1;
+
+	for (b=1; b < 256; b++) {
+		char byte = (char) b;
+		char utf[TCL_UTF_MAX + 1], back[8];
+		int read, wrote, chars, back_length, result;
+		Tcl_UniChar ch;
+
+		/* A byte that starts a longer character leaves the conversion incomplete */
+
+		result = Tcl_ExternalToUtf (NULL,enc,&byte,1,TCL_ENCODING_START,NULL,utf,sizeof (utf),&read,&wrote,&chars);
+		if (result == TCL_CONVERT_MULTIBYTE || read != 1) {
+			cp->single = 0;
+			continue;
+			}
+		if (result != TCL_OK || chars != 1 || wrote > TCL_UTF_MAX)
+			continue;
+
+		Tcl_UtfToUniChar (utf,&ch);
+		if (Tcl_UtfToExternal (NULL,enc,utf,wrote,TCL_ENCODING_START|TCL_ENCODING_END|TCL_ENCODING_STOPONERROR,NULL,back,sizeof (back),&read,&back_length,NULL) != TCL_OK
+		 || back_length != 1 || back[0] != byte || ch == 0) {
+			if (b < 0x80)
+				cp->ascii = 0;
+			continue;
+			}
+
+		cp->length[b] = (unsigned char) wrote;
+		memcpy (cp->utf[b],utf,wrote);
+		if (!cp->pages[(ch >> 8) & 0xFF]) {
+			cp->pages[(ch >> 8) & 0xFF] = (unsigned char *) ckalloc (256);
+			memset (cp->pages[(ch >> 8) & 0xFF],0,256);
+			}
+		if (!cp->pages[(ch >> 8) & 0xFF][ch & 0xFF])
+			cp->pages[(ch >> 8) & 0xFF][ch & 0xFF] = (unsigned char) b;
+		if (b < 0x80 && (wrote != 1 || utf[0] != byte))
+			cp->ascii = 0;
+		}
+	return (cp);
+	}
+
+void codepage_free (struct codepage *cp) {
+	int i;
+	if (!cp)
+		return;
+	for (i=0; i < 256; i++)
+		if (cp->pages[i])
+			ckfree ((char *) cp->pages[i]);
+	ckfree ((char *) cp);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Tcl string of length bytes of text in the codepage of the dbf, which	|
+ | holds no NUL bytes, as field_text leaves it.							|
+\*----------------------------------------------------------------------*/
+
+Tcl_Obj *external_to_obj (struct dbf_info *di, const char *s, int length) {
+	struct codepage *cp = di->codepage;
+	const unsigned char *u = (const unsigned char *) s;
+	int k, n;
+
+	di->conversions++;
+	if (cp && cp->ascii && DBFIsASCII (s,length))
+		return (Tcl_NewStringObj (s,length));
+
+	if (cp && cp->single) {
+		for (k=0, n=0; k < length && cp->length[u[k]]; k++)
+			n += cp->length[u[k]];
+		if (k == length) {
+			char buffer[1024];
+			char *utf = n < (int) sizeof (buffer) ? buffer : ckalloc (n);
+			char *p = utf;
+			Tcl_Obj *obj;
+			for (k=0; k < length; k++) {
+				memcpy (p,cp->utf[u[k]],cp->length[u[k]]);
+				p += cp->length[u[k]];
+				}
+			obj = Tcl_NewStringObj (utf,n);
+			if (utf != buffer)
+				ckfree (utf);
+			return (obj);
+			}
+		}
+
+	{
+	Tcl_DString e;
+	Tcl_Obj *obj;
+	di->tcl_conversions++;
+	Tcl_DStringInit(&e);
+	obj = Tcl_NewStringObj (Tcl_ExternalToUtfDString(di->enc,s,length,&e),-1);
+	Tcl_DStringFree(&e);
+	return (obj);
+	}
+	}
+
+/*----------------------------------------------------------------------*\
+ | The same conversion appended to utf, for output that never becomes	|
+ | a Tcl object.														|
+\*----------------------------------------------------------------------*/
+
+void external_to_utf (struct dbf_info *di, const char *s, int length, Tcl_DString *utf) {
+	struct codepage *cp = di->codepage;
+	const unsigned char *u = (const unsigned char *) s;
+	int k, n;
+
+	di->conversions++;
+	if (cp && cp->ascii && DBFIsASCII (s,length)) {
+		Tcl_DStringAppend(utf,s,length);
+		return;
+		}
+
+	if (cp && cp->single) {
+		for (k=0, n=0; k < length && cp->length[u[k]]; k++)
+			n += cp->length[u[k]];
+		if (k == length) {
+			int old = Tcl_DStringLength(utf);
+			char *p;
+			Tcl_DStringSetLength(utf,old + n);
+			p = Tcl_DStringValue(utf) + old;
+			for (k=0; k < length; k++) {
+				memcpy (p,cp->utf[u[k]],cp->length[u[k]]);
+				p += cp->length[u[k]];
+				}
+			return;
+			}
+		}
+
+	{
+	Tcl_DString e;
+	di->tcl_conversions++;
+	Tcl_DStringInit(&e);
+	Tcl_ExternalToUtfDString(di->enc,s,length,&e);
+	Tcl_DStringAppend(utf,Tcl_DStringValue(&e),Tcl_DStringLength(&e));
+	Tcl_DStringFree(&e);
+	}
+	}
+
+/*----------------------------------------------------------------------*\
+ | Text in the codepage of the dbf of length bytes of a Tcl string (all	|
+ | of it if length is negative), in e as Tcl_UtfToExternalDString		|
+ | would leave it.														|
+\*----------------------------------------------------------------------*/
+
+char *utf_to_external (struct dbf_info *di, const char *s, int length, Tcl_DString *e) {
+	struct codepage *cp = di->codepage;
+	const unsigned char *u = (const unsigned char *) s;
+	int k;
+
+	if (length < 0)
+		length = (int) strlen (s);
+	Tcl_DStringInit(e);
+	di->conversions++;
+
+	if (cp && cp->ascii && DBFIsASCII (s,length)) {
+		Tcl_DStringAppend(e,s,length);
+		return (Tcl_DStringValue(e));
+		}
+
+	if (cp && cp->single) {
+		char *p;
+		Tcl_DStringSetLength(e,length);
+		p = Tcl_DStringValue(e);
+		for (k=0; k < length; ) {
+			Tcl_UniChar ch;
+			unsigned char *page;
+			int n;
+			if (u[k] < 0x80 && u[k] && cp->ascii) {
+				*p++ = s[k++];
+				continue;
+				}
+			n = Tcl_UtfToUniChar (s + k,&ch);
+#if TCL_UTF_MAX > 4
+			if (ch > 0xFFFF)	/* past the tables, in builds with wide Tcl_UniChar */
+				break;
+#endif
+			if (!(page = cp->pages[ch >> 8]) || !page[ch & 0xFF])
+				break;
+			*p++ = (char) page[ch & 0xFF];
+			k += n;
+			}
+		if (k >= length) {
+			Tcl_DStringSetLength(e,(int) (p - Tcl_DStringValue(e)));
+			return (Tcl_DStringValue(e));
+			}
+		Tcl_DStringFree(e);
+		}
+
+	di->tcl_conversions++;
+	return (Tcl_UtfToExternalDString(di->enc,s,length,e));
+	}
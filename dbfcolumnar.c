@@ -0,0 +1,948 @@
+/*----------------------------------------------------------------------*\
+ | Column-major sidecars for $d columnize: the values of each field of	|
+ | a dbf, parsed once and kept apart from those of the other fields in	|
+ | a file next to it (by default parcels.dbfc for parcels.dbf).			|
+ |																		|
+ | N and F fields are kept as 8 byte integers or doubles with a state	|
+ | byte per record, NULL, integer, double, other number or text, and	|
+ | for each block of COLUMNAR_BLOCK records a zone map: the count,		|
+ | smallest and largest of its numbers.  Other fields but L are kept	|
+ | as a dictionary of their distinct trimmed values with a 2 byte code	|
+ | per record, as long as there are few enough of them; L fields and	|
+ | fields with too many values have no column.							|
+ |																		|
+ | Like an index the file records the record count, size and			|
+ | modification time of the dbf, and is used only while they still		|
+ | match.  A handle looks for the sidecar of its dbf the first time a	|
+ | command could use it and reads its directory; zone maps and values	|
+ | are read only once a command needs those of a field.  Writing a		|
+ | record through the handle drops the sidecar until the next			|
+ | columnize.															|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+#define COLUMNAR_MAGIC "TCLDBFCL"
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_HEADER_SIZE 64
+#define COLUMNAR_ENTRY_SIZE 40
+#define COLUMNAR_ZONE_SIZE 24
+#define COLUMNAR_BLOCK 65536		/* records in a zone */
+#define COLUMNAR_MAX_RECORDS (0x7FFFFFFF / 9)	/* values and states of a column in one allocation */
+#define COLUMNAR_PASS (64 << 20)	/* bytes of values built in one pass over the records */
+#define DICTIONARY_MIN 1024			/* values a dictionary may always have */
+#define DICTIONARY_MAX 65536		/* values a 2 byte code can name */
+
+enum column_kind { COLUMN_NONE, COLUMN_NUMBER, COLUMN_DICTIONARY };
+enum number_state { NUMBER_NULL, NUMBER_WIDE, NUMBER_DOUBLE, NUMBER_OTHER, NUMBER_TEXT };
+
+union number {
+	Tcl_WideInt w;			/* NUMBER_WIDE */
+	double d;				/* NUMBER_DOUBLE and NUMBER_OTHER */
+	};
+
+struct zone {
+	unsigned int count;		/* numbers in the block, NaN aside */
+	int nan;				/* some number of the block is NaN */
+	double low;
+	double high;
+	};
+
+struct column {
+	enum column_kind kind;
+	Tcl_WideUInt offset;	/* of its data in the file */
+	Tcl_WideUInt length;
+	int zoned;				/* zones read: 1, or could not be: -1 */
+	int loaded;				/* values read: 1, or could not be: -1 */
+	struct zone *zones;
+	union number *numbers;
+	unsigned char *states;
+	int entries;			/* of the dictionary */
+	unsigned int *starts;	/* of each entry in text, and its end */
+	char *text;
+	unsigned short *codes;
+	};
+
+struct dbf_columnar {
+	char *path;
+	unsigned char stamp[20];	/* record count, size and time of the dbf */
+	int records;
+	int blocks;
+	int fields;
+	int header_length;
+	int record_length;
+	struct column *columns;
+	};
+
+static void put32 (unsigned char *p, unsigned int v) {
+	int i;
+	for (i=0; i < 4; i++, v >>= 8)
+		p[i] = (unsigned char) (v & 0xFF);
+	}
+
+static void put64 (unsigned char *p, Tcl_WideUInt v) {
+	int i;
+	for (i=0; i < 8; i++, v >>= 8)
+		p[i] = (unsigned char) (v & 0xFF);
+	}
+
+static unsigned int get32 (const unsigned char *p) {
+	return ((unsigned) p[0] | ((unsigned) p[1] << 8) | ((unsigned) p[2] << 16) | ((unsigned) p[3] << 24));
+	}
+
+static Tcl_WideUInt get64 (const unsigned char *p) {
+	return ((Tcl_WideUInt) get32 (p) | ((Tcl_WideUInt) get32 (p + 4) << 32));
+	}
+
+static double get_double (const unsigned char *p) {
+	Tcl_WideUInt bits = get64 (p);
+	double d;
+	memcpy (&d,&bits,sizeof (d));
+	return (d);
+	}
+
+static int dbf_stamp (struct dbf_info *di, unsigned char *stamp) {
+	Tcl_StatBuf *buffer = Tcl_AllocStatBuf();
+	Tcl_Obj *path = path_obj (di->path);
+	int result = Tcl_FSStat (path,buffer) == 0;
+
+	Tcl_DecrRefCount (path);
+
+	if (result) {
+		put32 (stamp,(unsigned int) DBFGetRecordCount (di->df));
+		put64 (stamp + 4,(Tcl_WideUInt) Tcl_GetSizeFromStat (buffer));
+		put64 (stamp + 12,(Tcl_WideUInt) Tcl_GetModificationTimeFromStat (buffer));
+		}
+	ckfree ((char *) buffer);
+	return (result);
+	}
+
+/* The sidecar of a dbf: its file name with .dbfc for its extension */
+
+static void default_path (struct dbf_info *di, Tcl_DString *path) {
+	char *dot = strrchr (di->path,'.');
+	int length = -1;
+
+	if (dot && !strchr (dot,'/') && !strchr (dot,'\\'))
+		length = (int) (dot - di->path);
+	Tcl_DStringAppend(path,di->path,length);
+	Tcl_DStringAppend(path,".dbfc",-1);
+	}
+
+static enum column_kind kind_of (DBFHandle df, int j) {
+	char type = df->pachFieldType[j];
+	if (type == 'N' || type == 'F')
+		return (COLUMN_NUMBER);
+	return (type == 'L' ? COLUMN_NONE : COLUMN_DICTIONARY);
+	}
+
+static void free_values (struct column *col) {
+	if (col->zones) ckfree ((char *) col->zones);
+	if (col->numbers) ckfree ((char *) col->numbers);
+	if (col->states) ckfree ((char *) col->states);
+	if (col->starts) ckfree ((char *) col->starts);
+	if (col->text) ckfree (col->text);
+	if (col->codes) ckfree ((char *) col->codes);
+	col->zones = NULL;
+	col->numbers = NULL;
+	col->states = NULL;
+	col->starts = NULL;
+	col->text = NULL;
+	col->codes = NULL;
+	}
+
+static struct dbf_columnar *new_columnar (int fields, const char *path) {
+	struct dbf_columnar *c = (struct dbf_columnar *) ckalloc (sizeof (struct dbf_columnar));
+
+	memset (c,0,sizeof (struct dbf_columnar));
+	c->fields = fields;
+	c->columns = (struct column *) ckalloc ((fields > 0 ? fields : 1) * sizeof (struct column));
+	memset (c->columns,0,(fields > 0 ? fields : 1) * sizeof (struct column));
+	c->path = strcpy (ckalloc (strlen (path) + 1),path);
+	return (c);
+	}
+
+static void free_columnar (struct dbf_columnar *c) {
+	int j;
+	for (j=0; j < c->fields; j++)
+		free_values (c->columns + j);
+	ckfree ((char *) c->columns);
+	ckfree (c->path);
+	ckfree ((char *) c);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Building: a pass over the records fills as many columns as			|
+ | COLUMNAR_PASS bytes of values hold, and at least one.  A				|
+ | dictionary that grows past its limit is dropped on the spot.			|
+\*----------------------------------------------------------------------*/
+
+struct dictionary {
+	Tcl_HashTable values;	/* text to code */
+	Tcl_DString text;
+	int limit;
+	char *key;				/* the text of a value, NUL terminated */
+	};
+
+static void number_cell (DBFHandle df, int j, const char *record, struct column *col, int i) {
+	union number *v = col->numbers + i;
+	struct zone *z;
+	const char *t;
+	int64_t w;
+	double d;
+	int n;
+
+	v->w = 0;
+	col->states[i] = NUMBER_NULL;
+	if (!record)
+		return;
+	t = field_text (df,record,j,&n);
+	if (DBFIsFieldValueNULL (df->pachFieldType[j],t,n,df->panFieldSize[j]))
+		return;
+
+	if (df->panFieldDecimals[j] == 0 && DBFParseInteger (t,n,&w)) {
+		v->w = (Tcl_WideInt) w;
+		col->states[i] = NUMBER_WIDE;
+		d = (double) w;
+		}
+	else if (DBFParseDouble (t,n,&d)) {
+		v->d = d;
+		/* d - d is 0 unless d is infinite or not a number */
+		col->states[i] = d - d == 0 ? NUMBER_DOUBLE : NUMBER_OTHER;
+		}
+	else {
+		col->states[i] = NUMBER_TEXT;
+		return;
+		}
+
+	z = col->zones + i / COLUMNAR_BLOCK;
+	if (d != d) {
+		z->nan = 1;
+		return;
+		}
+	if (z->count == 0 || d < z->low)
+		z->low = d;
+	if (z->count == 0 || d > z->high)
+		z->high = d;
+	z->count++;
+	}
+
+static void dictionary_cell (DBFHandle df, int j, const char *record, struct column *col, struct dictionary *dict, int i) {
+	Tcl_HashEntry *entry;
+	const char *t = "";
+	int n = 0, isnew;
+
+	if (record) {
+		t = field_text (df,record,j,&n);
+		if (DBFIsFieldValueNULL (df->pachFieldType[j],t,n,df->panFieldSize[j]))
+			n = 0;
+		}
+	memcpy (dict->key,t,n);
+	dict->key[n] = '\0';
+
+	entry = Tcl_CreateHashEntry (&dict->values,dict->key,&isnew);
+	if (isnew) {
+		if (col->entries == dict->limit) {
+			col->kind = COLUMN_NONE;
+			free_values (col);
+			return;
+			}
+		Tcl_SetHashValue (entry,(ClientData) (size_t) col->entries);
+		col->starts[col->entries++] = (unsigned int) Tcl_DStringLength(&dict->text);
+		Tcl_DStringAppend(&dict->text,t,n);
+		}
+	col->codes[i] = (unsigned short) (size_t) Tcl_GetHashValue (entry);
+	}
+
+/* Bytes of values a column holds for each record while it is built */
+
+static int column_bytes (DBFHandle df, int j) {
+	switch (kind_of (df,j)) {
+		case COLUMN_NUMBER: return ((int) sizeof (union number) + 1);
+		case COLUMN_DICTIONARY: return ((int) sizeof (unsigned short));
+		default: return (0);
+		}
+	}
+
+static void build_columns (struct dbf_info *di, struct dbf_columnar *c, int from, int to) {
+	DBFHandle df = di->df;
+	int rc = c->records, i, j;
+	struct dictionary *dicts = (struct dictionary *) ckalloc ((to - from) * sizeof (struct dictionary));
+	int limit = rc / 2 > DICTIONARY_MIN ? rc / 2 : DICTIONARY_MIN;
+
+	if (limit > DICTIONARY_MAX)
+		limit = DICTIONARY_MAX;
+
+	for (j=from; j < to; j++) {
+		struct column *col = c->columns + j;
+		struct dictionary *dict = dicts + (j - from);
+		col->kind = kind_of (df,j);
+		col->zoned = col->loaded = 1;
+		if (col->kind == COLUMN_NUMBER) {
+			col->zones = (struct zone *) ckalloc ((c->blocks > 0 ? c->blocks : 1) * sizeof (struct zone));
+			memset (col->zones,0,(c->blocks > 0 ? c->blocks : 1) * sizeof (struct zone));
+			col->numbers = (union number *) ckalloc ((rc > 0 ? rc : 1) * sizeof (union number));
+			col->states = (unsigned char *) ckalloc (rc > 0 ? rc : 1);
+			}
+		else if (col->kind == COLUMN_DICTIONARY) {
+			Tcl_InitHashTable (&dict->values,TCL_STRING_KEYS);
+			Tcl_DStringInit(&dict->text);
+			dict->limit = limit;
+			dict->key = ckalloc (df->panFieldSize[j] + 1);
+			col->starts = (unsigned int *) ckalloc ((limit + 1) * sizeof (unsigned int));
+			col->codes = (unsigned short *) ckalloc ((rc > 0 ? rc : 1) * sizeof (unsigned short));
+			}
+		}
+
+	for (i=0; i < rc; i++) {
+		const char *record = DBFReadTuple (df,i);
+		for (j=from; j < to; j++)
+			switch (c->columns[j].kind) {
+				case COLUMN_NUMBER: number_cell (df,j,record,c->columns + j,i); break;
+				case COLUMN_DICTIONARY: dictionary_cell (df,j,record,c->columns + j,dicts + (j - from),i); break;
+				default: break;
+				}
+		}
+
+	/* The text of the dictionaries moves to the columns */
+
+	for (j=from; j < to; j++) {
+		struct column *col = c->columns + j;
+		struct dictionary *dict = dicts + (j - from);
+		if (kind_of (df,j) != COLUMN_DICTIONARY)
+			continue;
+		if (col->kind == COLUMN_DICTIONARY) {
+			int length = Tcl_DStringLength(&dict->text);
+			col->starts[col->entries] = (unsigned int) length;
+			col->text = ckalloc (length > 0 ? length : 1);
+			memcpy (col->text,Tcl_DStringValue(&dict->text),length);
+			}
+		Tcl_DeleteHashTable (&dict->values);
+		Tcl_DStringFree(&dict->text);
+		ckfree (dict->key);
+		}
+	ckfree ((char *) dicts);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Files: a header, a directory of the fields and their data.			|
+ |																		|
+ | Header: magic, version, field count, records in a block, header and	|
+ | record length of the dbf, then its record count, size and time.		|
+ | Directory: for each field its name, type, kind, width and decimals	|
+ | and the offset and length of its data.								|
+ | Numbers: the zones, a value per record and a state per record.		|
+ | Dictionaries: the entry count, the starts of the entries and the		|
+ | end of the last, the text of the entries and a code per record.		|
+ | All numbers are little endian.										|
+\*----------------------------------------------------------------------*/
+
+struct output {
+	Tcl_Channel channel;
+	int used;
+	int error;
+	unsigned char buffer[65536];
+	};
+
+static void out_bytes (struct output *o, const void *p, size_t n) {
+	const unsigned char *s = (const unsigned char *) p;
+
+	while (n > 0) {
+		size_t k = sizeof (o->buffer) - o->used;
+		if (k > n)
+			k = n;
+		memcpy (o->buffer + o->used,s,k);
+		o->used += (int) k;
+		s += k;
+		n -= k;
+		if (o->used == (int) sizeof (o->buffer)) {
+			if (Tcl_Write (o->channel,(char *) o->buffer,o->used) < 0)
+				o->error = 1;
+			o->used = 0;
+			}
+		}
+	}
+
+static void out32 (struct output *o, unsigned int v) {
+	unsigned char b[4];
+	put32 (b,v);
+	out_bytes (o,b,4);
+	}
+
+static void out64 (struct output *o, Tcl_WideUInt v) {
+	unsigned char b[8];
+	put64 (b,v);
+	out_bytes (o,b,8);
+	}
+
+static void out_double (struct output *o, double d) {
+	Tcl_WideUInt bits;
+	memcpy (&bits,&d,sizeof (bits));
+	out64 (o,bits);
+	}
+
+static void write_column (struct output *o, struct dbf_columnar *c, struct column *col) {
+	int i, b;
+
+	if (col->kind == COLUMN_NUMBER) {
+		for (b=0; b < c->blocks; b++) {
+			out32 (o,col->zones[b].count);
+			out32 (o,(unsigned int) col->zones[b].nan);
+			out_double (o,col->zones[b].low);
+			out_double (o,col->zones[b].high);
+			}
+		for (i=0; i < c->records; i++)
+			out64 (o,(Tcl_WideUInt) col->numbers[i].w);
+		out_bytes (o,col->states,c->records);
+		}
+	else if (col->kind == COLUMN_DICTIONARY) {
+		out32 (o,(unsigned int) col->entries);
+		for (i=0; i <= col->entries; i++)
+			out32 (o,col->starts[i]);
+		out_bytes (o,col->text,col->starts[col->entries]);
+		for (i=0; i < c->records; i++) {
+			unsigned char code[2];
+			code[0] = (unsigned char) (col->codes[i] & 0xFF);
+			code[1] = (unsigned char) (col->codes[i] >> 8);
+			out_bytes (o,code,2);
+			}
+		}
+	}
+
+/* Columns are built and written a pass at a time and their values		*/
+/* freed, the zones aside; the directory is written once their offsets	*/
+/* are known.															*/
+
+static int save_columnar (Tcl_Interp *interp, struct dbf_info *di, struct dbf_columnar *c) {
+	DBFHandle df = di->df;
+	unsigned char header[COLUMNAR_HEADER_SIZE], *directory;
+	int size = (c->fields > 0 ? c->fields : 1) * COLUMNAR_ENTRY_SIZE;
+	Tcl_WideUInt offset = COLUMNAR_HEADER_SIZE + (Tcl_WideUInt) c->fields * COLUMNAR_ENTRY_SIZE;
+	struct output *o;
+	Tcl_Obj *path = path_obj (c->path);
+	int j, k;
+
+	o = (struct output *) ckalloc (sizeof (struct output));
+	o->channel = Tcl_FSOpenFileChannel (interp,path,"w",0644);
+	Tcl_DecrRefCount (path);
+	if (!o->channel) {
+		ckfree ((char *) o);
+		return (TCL_ERROR);
+		}
+	Tcl_SetChannelOption (interp,o->channel,"-translation","binary");
+	o->used = o->error = 0;
+
+	memset (header,0,COLUMNAR_HEADER_SIZE);
+	memcpy (header,COLUMNAR_MAGIC,8);
+	put32 (header + 8,COLUMNAR_VERSION);
+	put32 (header + 12,(unsigned int) c->fields);
+	put32 (header + 16,COLUMNAR_BLOCK);
+	put32 (header + 20,(unsigned int) c->header_length);
+	put32 (header + 24,(unsigned int) c->record_length);
+	memcpy (header + 32,c->stamp,20);
+	out_bytes (o,header,COLUMNAR_HEADER_SIZE);
+
+	/* Room for the directory, filled in below */
+
+	directory = (unsigned char *) ckalloc (size);
+	memset (directory,0,size);
+	out_bytes (o,directory,(size_t) c->fields * COLUMNAR_ENTRY_SIZE);
+
+	for (j=0; j < c->fields && !o->error; ) {
+		Tcl_WideUInt bytes = (Tcl_WideUInt) c->records * column_bytes (df,j);
+
+		for (k=j + 1; k < c->fields; k++) {
+			bytes += (Tcl_WideUInt) c->records * column_bytes (df,k);
+			if (bytes > COLUMNAR_PASS)
+				break;
+			}
+		build_columns (di,c,j,k);
+
+		for (; j < k; j++) {
+			struct column *col = c->columns + j;
+			unsigned char *entry = directory + j * COLUMNAR_ENTRY_SIZE;
+
+			if (col->kind == COLUMN_NUMBER)
+				col->length = (Tcl_WideUInt) c->blocks * COLUMNAR_ZONE_SIZE + (Tcl_WideUInt) c->records * 9;
+			else if (col->kind == COLUMN_DICTIONARY)
+				col->length = 4 + (Tcl_WideUInt) (col->entries + 1) * 4 + col->starts[col->entries] + (Tcl_WideUInt) c->records * 2;
+			else
+				col->length = 0;
+			col->offset = offset;
+			offset += col->length;
+
+			DBFGetFieldInfo (df,j,(char *) entry,NULL,NULL);
+			entry[12] = (unsigned char) df->pachFieldType[j];
+			entry[13] = (unsigned char) col->kind;
+			put32 (entry + 14,(unsigned int) df->panFieldSize[j]);
+			put32 (entry + 18,(unsigned int) df->panFieldDecimals[j]);
+			put64 (entry + 24,col->offset);
+			put64 (entry + 32,col->length);
+
+			write_column (o,c,col);
+			if (col->kind == COLUMN_NUMBER) {
+				ckfree ((char *) col->numbers);
+				ckfree ((char *) col->states);
+				col->numbers = NULL;
+				col->states = NULL;
+				}
+			else
+				free_values (col);
+			col->loaded = 0;
+			}
+		}
+
+	if (o->used > 0 && Tcl_Write (o->channel,(char *) o->buffer,o->used) < 0)
+		o->error = 1;
+	if (!o->error && (Tcl_Seek (o->channel,COLUMNAR_HEADER_SIZE,SEEK_SET) != COLUMNAR_HEADER_SIZE
+	 || Tcl_Write (o->channel,(char *) directory,c->fields * COLUMNAR_ENTRY_SIZE) < 0))
+		o->error = 1;
+	ckfree ((char *) directory);
+	if (Tcl_Close (interp,o->channel) != TCL_OK || o->error) {
+		ckfree ((char *) o);
+		Tcl_SetResult (interp,"columnize: could not write ",TCL_STATIC);
+		Tcl_AppendResult (interp,c->path,NULL);
+		return (TCL_ERROR);
+		}
+	ckfree ((char *) o);
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Reading: the header and directory when the sidecar is first looked	|
+ | for, and the zones or values of a column when first needed.  A		|
+ | sidecar that cannot be read is simply not used.						|
+\*----------------------------------------------------------------------*/
+
+static int read_bytes (struct dbf_columnar *c, Tcl_WideUInt offset, Tcl_WideUInt length, unsigned char *buffer) {
+	Tcl_Obj *path = path_obj (c->path);
+	Tcl_Channel channel = Tcl_FSOpenFileChannel (NULL,path,"r",0);
+	int result;
+
+	Tcl_DecrRefCount (path);
+	if (!channel)
+		return (0);
+	Tcl_SetChannelOption (NULL,channel,"-translation","binary");
+	result = Tcl_Seek (channel,(Tcl_WideInt) offset,SEEK_SET) == (Tcl_WideInt) offset
+	 && Tcl_Read (channel,(char *) buffer,(int) length) == (int) length;
+	Tcl_Close (NULL,channel);
+	return (result);
+	}
+
+static struct dbf_columnar *load_columnar (struct dbf_info *di, const char *path) {
+	DBFHandle df = di->df;
+	unsigned char header[COLUMNAR_HEADER_SIZE], *directory;
+	int fields = DBFGetFieldCount (df), j;
+	struct dbf_columnar *c;
+	Tcl_Obj *obj = path_obj (path);
+	Tcl_Channel channel = Tcl_FSOpenFileChannel (NULL,obj,"r",0);
+
+	Tcl_DecrRefCount (obj);
+	if (!channel)
+		return (NULL);
+	Tcl_SetChannelOption (NULL,channel,"-translation","binary");
+	if (Tcl_Read (channel,(char *) header,COLUMNAR_HEADER_SIZE) != COLUMNAR_HEADER_SIZE
+	 || memcmp (header,COLUMNAR_MAGIC,8) != 0 || get32 (header + 8) != COLUMNAR_VERSION
+	 || get32 (header + 12) != (unsigned int) fields || get32 (header + 16) != COLUMNAR_BLOCK
+	 || get32 (header + 20) != (unsigned int) df->nHeaderLength || get32 (header + 24) != (unsigned int) df->nRecordLength
+	 || get32 (header + 32) > COLUMNAR_MAX_RECORDS) {
+		Tcl_Close (NULL,channel);
+		return (NULL);
+		}
+
+	directory = (unsigned char *) ckalloc ((fields > 0 ? fields : 1) * COLUMNAR_ENTRY_SIZE);
+	if (Tcl_Read (channel,(char *) directory,fields * COLUMNAR_ENTRY_SIZE) != fields * COLUMNAR_ENTRY_SIZE) {
+		Tcl_Close (NULL,channel);
+		ckfree ((char *) directory);
+		return (NULL);
+		}
+	Tcl_Close (NULL,channel);
+
+	c = new_columnar (fields,path);
+	memcpy (c->stamp,header + 32,20);
+	c->records = (int) get32 (header + 32);
+	c->blocks = (c->records + COLUMNAR_BLOCK - 1) / COLUMNAR_BLOCK;
+	c->header_length = df->nHeaderLength;
+	c->record_length = df->nRecordLength;
+
+	/* The fields have to be those of the dbf, or the columns are not used */
+
+	for (j=0; j < fields; j++) {
+		unsigned char *entry = directory + j * COLUMNAR_ENTRY_SIZE;
+		struct column *col = c->columns + j;
+		char name[XBASE_FLDNAME_LEN_READ + 1];
+
+		DBFGetFieldInfo (df,j,name,NULL,NULL);
+		col->kind = (enum column_kind) entry[13];
+		col->offset = get64 (entry + 24);
+		col->length = get64 (entry + 32);
+		if (strncmp ((char *) entry,name,12) != 0 || entry[12] != (unsigned char) df->pachFieldType[j]
+		 || get32 (entry + 14) != (unsigned int) df->panFieldSize[j] || get32 (entry + 18) != (unsigned int) df->panFieldDecimals[j]
+		 || (col->kind != COLUMN_NONE && col->kind != kind_of (df,j)) || col->length > 0x7FFFFFFF)
+			col->kind = COLUMN_NONE;
+		}
+	ckfree ((char *) directory);
+	return (c);
+	}
+
+static struct column *column_zones (struct dbf_columnar *c, int j) {
+	struct column *col = c->columns + j;
+	Tcl_WideUInt length = (Tcl_WideUInt) c->blocks * COLUMNAR_ZONE_SIZE;
+	unsigned char *buffer;
+	int b;
+
+	if (col->kind != COLUMN_NUMBER || col->zoned < 0)
+		return (NULL);
+	if (col->zoned)
+		return (col);
+
+	col->zoned = -1;
+	if (col->length != length + (Tcl_WideUInt) c->records * 9)
+		return (NULL);
+	buffer = (unsigned char *) ckalloc (length > 0 ? (unsigned int) length : 1);
+	if (!read_bytes (c,col->offset,length,buffer)) {
+		ckfree ((char *) buffer);
+		return (NULL);
+		}
+	col->zones = (struct zone *) ckalloc ((c->blocks > 0 ? c->blocks : 1) * sizeof (struct zone));
+	for (b=0; b < c->blocks; b++) {
+		const unsigned char *p = buffer + b * COLUMNAR_ZONE_SIZE;
+		col->zones[b].count = get32 (p);
+		col->zones[b].nan = (int) get32 (p + 4);
+		col->zones[b].low = get_double (p + 8);
+		col->zones[b].high = get_double (p + 16);
+		}
+	ckfree ((char *) buffer);
+	col->zoned = 1;
+	return (col);
+	}
+
+static int read_numbers (struct dbf_columnar *c, struct column *col) {
+	Tcl_WideUInt zones = (Tcl_WideUInt) c->blocks * COLUMNAR_ZONE_SIZE;
+	Tcl_WideUInt length = (Tcl_WideUInt) c->records * 9;
+	unsigned char *buffer;
+	int i;
+
+	if (col->length != zones + length)
+		return (0);
+	buffer = (unsigned char *) ckalloc (length > 0 ? (unsigned int) length : 1);
+	if (!read_bytes (c,col->offset + zones,length,buffer)) {
+		ckfree ((char *) buffer);
+		return (0);
+		}
+	col->numbers = (union number *) ckalloc ((c->records > 0 ? c->records : 1) * sizeof (union number));
+	col->states = (unsigned char *) ckalloc (c->records > 0 ? c->records : 1);
+	for (i=0; i < c->records; i++)
+		col->numbers[i].w = (Tcl_WideInt) get64 (buffer + (size_t) i * 8);
+	memcpy (col->states,buffer + (size_t) c->records * 8,c->records);
+	ckfree ((char *) buffer);
+	return (1);
+	}
+
+static int read_dictionary (struct dbf_columnar *c, struct column *col) {
+	unsigned char *buffer, *p;
+	Tcl_WideUInt text;
+	int entries, i;
+
+	if (col->length < 8)
+		return (0);
+	buffer = (unsigned char *) ckalloc ((unsigned int) col->length);
+	if (!read_bytes (c,col->offset,col->length,buffer)) {
+		ckfree ((char *) buffer);
+		return (0);
+		}
+
+	/* Entry starts that run backwards or past the text, or codes past	*/
+	/* the entries, mean the file is damaged							*/
+
+	entries = (int) get32 (buffer);
+	if (entries > DICTIONARY_MAX || 4 + (Tcl_WideUInt) (entries + 1) * 4 > col->length) {
+		ckfree ((char *) buffer);
+		return (0);
+		}
+	p = buffer + 4;
+	text = get32 (p + (size_t) entries * 4);
+	if (col->length != 4 + (Tcl_WideUInt) (entries + 1) * 4 + text + (Tcl_WideUInt) c->records * 2) {
+		ckfree ((char *) buffer);
+		return (0);
+		}
+
+	col->entries = entries;
+	col->starts = (unsigned int *) ckalloc ((entries + 1) * sizeof (unsigned int));
+	for (i=0; i <= entries; i++) {
+		col->starts[i] = get32 (p + (size_t) i * 4);
+		if (col->starts[i] > text || (i > 0 && col->starts[i] < col->starts[i - 1])) {
+			ckfree ((char *) buffer);
+			return (0);
+			}
+		}
+	p += (size_t) (entries + 1) * 4;
+	col->text = ckalloc (text > 0 ? (unsigned int) text : 1);
+	memcpy (col->text,p,(size_t) text);
+	p += text;
+	col->codes = (unsigned short *) ckalloc ((c->records > 0 ? c->records : 1) * sizeof (unsigned short));
+	for (i=0; i < c->records; i++) {
+		col->codes[i] = (unsigned short) (p[2 * i] | (p[2 * i + 1] << 8));
+		if (col->codes[i] >= entries) {
+			ckfree ((char *) buffer);
+			return (0);
+			}
+		}
+	ckfree ((char *) buffer);
+	return (1);
+	}
+
+static struct column *column_values (struct dbf_columnar *c, int j) {
+	struct column *col = c->columns + j;
+
+	if (col->kind == COLUMN_NONE || col->loaded < 0)
+		return (NULL);
+	if (col->loaded)
+		return (col);
+	if (!(col->kind == COLUMN_NUMBER ? read_numbers (c,col) : read_dictionary (c,col))) {
+		free_values (col);
+		col->loaded = col->zoned = -1;
+		return (NULL);
+		}
+	col->loaded = 1;
+	return (col);
+	}
+
+/*----------------------------------------------------------------------*\
+ | The sidecar of a handle if it matches the dbf on disk, loading the	|
+ | one next to the dbf the first time; one that does not match is		|
+ | dropped.																|
+\*----------------------------------------------------------------------*/
+
+struct dbf_columnar *columnar_fresh (struct dbf_info *di) {
+	unsigned char stamp[20];
+	struct dbf_columnar *c;
+
+	if (!di->columnar && !di->columnar_looked) {
+		Tcl_DString path;
+		Tcl_DStringInit(&path);
+		default_path (di,&path);
+		di->columnar_looked = 1;
+		di->columnar = load_columnar (di,Tcl_DStringValue(&path));
+		Tcl_DStringFree(&path);
+		}
+	if (!(c = di->columnar))
+		return (NULL);
+	if (c->header_length != di->df->nHeaderLength || c->record_length != di->df->nRecordLength
+	 || !dbf_stamp (di,stamp) || memcmp (stamp,c->stamp,20) != 0) {
+		columnar_forget (di);
+		return (NULL);
+		}
+	return (c);
+	}
+
+/* Records are about to be written: the sidecar no longer holds them */
+
+void columnar_forget (struct dbf_info *di) {
+	di->columnar_looked = 1;
+	if (di->columnar) {
+		free_columnar (di->columnar);
+		di->columnar = NULL;
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | sync and close write the header of the dbf again, which changes its	|
+ | time but none of its records: a sidecar that matched it before		|
+ | (columnar_check) is stamped with the new time after					|
+ | (columnar_restamp).													|
+\*----------------------------------------------------------------------*/
+
+void columnar_check (struct dbf_info *di) {
+	if (di->columnar)
+		columnar_fresh (di);
+	}
+
+void columnar_restamp (struct dbf_info *di) {
+	struct dbf_columnar *c = di->columnar;
+	Tcl_Channel channel;
+	Tcl_Obj *path;
+	unsigned char stamp[20];
+
+	if (!c || !dbf_stamp (di,stamp) || memcmp (stamp,c->stamp,20) == 0)
+		return;
+	path = path_obj (c->path);
+	channel = Tcl_FSOpenFileChannel (NULL,path,"r+",0);
+	Tcl_DecrRefCount (path);
+	if (!channel) {
+		columnar_forget (di);
+		return;
+		}
+	Tcl_SetChannelOption (NULL,channel,"-translation","binary");
+	if (Tcl_Seek (channel,32,SEEK_SET) != 32 || Tcl_Write (channel,(char *) stamp,20) != 20) {
+		Tcl_Close (NULL,channel);
+		columnar_forget (di);
+		return;
+		}
+	Tcl_Close (NULL,channel);
+	memcpy (c->stamp,stamp,20);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Values of field j of count records from from, as column makes them:	|
+ | -typed numbers and the text of dictionary fields, one object for		|
+ | each distinct value.  Returns 0 if the sidecar has no such column.	|
+\*----------------------------------------------------------------------*/
+
+int columnar_column (struct dbf_info *di, int j, int from, int count, int typed, Tcl_Obj **values) {
+	struct dbf_columnar *c = columnar_fresh (di);
+	struct column *col;
+	Tcl_Obj **objs;
+	int i, k;
+
+	if (!c || (c->columns[j].kind == COLUMN_NUMBER && !typed) || !(col = column_values (c,j)))
+		return (0);
+
+	if (col->kind == COLUMN_NUMBER) {
+		for (i=0, k=from; i < count; i++, k++)
+			switch (col->states[k]) {
+				case NUMBER_NULL: values[i] = Tcl_NewStringObj ("",0); break;
+				case NUMBER_WIDE: values[i] = Tcl_NewWideIntObj (col->numbers[k].w); break;
+				case NUMBER_DOUBLE: values[i] = Tcl_NewDoubleObj (col->numbers[k].d); break;
+				default: values[i] = field_obj (di,DBFReadTuple (di->df,k),j,1); break;
+				}
+		return (1);
+		}
+
+	/* The list holds the only references to the objects of the entries */
+
+	objs = (Tcl_Obj **) ckalloc ((col->entries > 0 ? col->entries : 1) * sizeof (Tcl_Obj *));
+	memset (objs,0,(col->entries > 0 ? col->entries : 1) * sizeof (Tcl_Obj *));
+	for (i=0, k=from; i < count; i++, k++) {
+		int code = col->codes[k];
+		if (!objs[code])
+			objs[code] = external_to_obj (di,col->text + col->starts[code],(int) (col->starts[code + 1] - col->starts[code]));
+		values[i] = objs[code];
+		}
+	ckfree ((char *) objs);
+	return (1);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Records from i that where cannot match, going by the zone maps of	|
+ | the block i starts; 0 unless i starts a block.						|
+\*----------------------------------------------------------------------*/
+
+struct zone_probe {
+	struct dbf_columnar *c;
+	int block;
+	};
+
+static int zone_bounds (void *data, int field, double *low, double *high) {
+	struct zone_probe *p = (struct zone_probe *) data;
+	struct column *col = column_zones (p->c,field);
+	struct zone *z;
+
+	if (!col)
+		return (-1);
+	z = col->zones + p->block;
+	if (z->nan)
+		return (-1);
+	if (z->count == 0)
+		return (0);
+	*low = z->low;
+	*high = z->high;
+	return (1);
+	}
+
+int columnar_skip (struct dbf_columnar *c, struct where *where, int i) {
+	struct zone_probe p;
+
+	if (i % COLUMNAR_BLOCK != 0 || i >= c->records)
+		return (0);
+	p.c = c;
+	p.block = i / COLUMNAR_BLOCK;
+	if (!where_excludes (where,zone_bounds,&p))
+		return (0);
+	return (c->records - i < COLUMNAR_BLOCK ? c->records - i : COLUMNAR_BLOCK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | The numbers of field j in record order, as DBFParseDouble reads		|
+ | them, for aggregate; columnar_numeric says if the sidecar has them.	|
+\*----------------------------------------------------------------------*/
+
+int columnar_numeric (struct dbf_columnar *c, int j) {
+	return (c->columns[j].kind == COLUMN_NUMBER && column_values (c,j) != NULL);
+	}
+
+void columnar_fold (struct dbf_columnar *c, int j, columnar_fn *fold, void *data) {
+	struct column *col = c->columns + j;
+	int i;
+
+	for (i=0; i < c->records; i++)
+		switch (col->states[i]) {
+			case NUMBER_WIDE: fold (data,(double) col->numbers[i].w); break;
+			case NUMBER_DOUBLE:
+			case NUMBER_OTHER: fold (data,col->numbers[i].d); break;
+			default: break;
+			}
+	}
+
+/*----------------------------------------------------------------------*\
+ | columnize [-file <path>]												|
+\*----------------------------------------------------------------------*/
+
+int columnar_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	struct dbf_columnar *c;
+	Tcl_DString path;
+
+	if (objc != 2 && !(objc == 4 && strcmp (Tcl_GetString(objv[2]),"-file") == 0)) {
+		Tcl_SetResult (interp,"columnize expects optionally -file path",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+	if (DBFGetRecordCount (df) > COLUMNAR_MAX_RECORDS) {
+		Tcl_SetResult (interp,"columnize: too many records",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+	if (objc == 4) {
+		Tcl_Obj *s = Tcl_FSGetNormalizedPath (interp,objv[3]);
+		if (!s)
+			return (TCL_ERROR);
+		Tcl_DStringInit(&path);
+		Tcl_DStringAppend(&path,Tcl_GetString(s),-1);
+		}
+	else {
+		Tcl_DStringInit(&path);
+		default_path (di,&path);
+		}
+
+	/* The sidecar has to match the dbf as it is on disk */
+
+	if (df->bUpdated)
+		DBFUpdateHeader (df);
+
+	c = new_columnar (DBFGetFieldCount (df),Tcl_DStringValue(&path));
+	Tcl_DStringFree(&path);
+	c->records = DBFGetRecordCount (df);
+	c->blocks = (c->records + COLUMNAR_BLOCK - 1) / COLUMNAR_BLOCK;
+	c->header_length = df->nHeaderLength;
+	c->record_length = df->nRecordLength;
+	if (!dbf_stamp (di,c->stamp)) {
+		free_columnar (c);
+		Tcl_SetResult (interp,"columnize: cannot read the size and time of ",TCL_STATIC);
+		Tcl_AppendResult (interp,di->path,NULL);
+		return (TCL_ERROR);
+		}
+	if (save_columnar (interp,di,c) == TCL_ERROR) {
+		free_columnar (c);
+		return (TCL_ERROR);
+		}
+
+	columnar_forget (di);
+	di->columnar = c;
+	Tcl_SetObjResult (interp,Tcl_NewStringObj (c->path,-1));
+	return (TCL_OK);
+	}
@@ -0,0 +1,874 @@
+/*----------------------------------------------------------------------*\
+ | CSV for $d export csv and dbf d -import csv.							|
+ |																		|
+ | Export converts records from the codepage of the dbf to UTF-8 and	|
+ | gathers them in one large buffer, which is written to the channel	|
+ | whenever it fills, so memory stays flat however many records there	|
+ | are.  Values are trimmed as field_text trims them and NULL values	|
+ | are empty.  With -quote auto a value is quoted only if it holds the	|
+ | delimiter, a quote, CR or LF; quotes inside quoted values are		|
+ | doubled, as RFC 4180 has it.											|
+ |																		|
+ | Import reads the file twice: once for the first rows, to infer the	|
+ | type and width of each column unless -schema gives them, then again	|
+ | to format every row straight into a record, written through the		|
+ | append buffer of -bulkload.											|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+#define CSV_BUFFER_SIZE (1 << 20)	/* bytes gathered before each write */
+
+enum csv_quote { Q_AUTO, Q_ALL, Q_NONE };
+
+static char *quote_names[] = {"auto", "all", "none", NULL};
+
+struct csv {
+	Tcl_DString out;
+	Tcl_DString value;		/* the value being quoted */
+	char delimiter[TCL_UTF_MAX];
+	int delimiter_length;
+	enum csv_quote quote;
+	};
+
+static int csv_error (Tcl_Interp *interp, const char *message) {
+	Tcl_SetResult (interp,"export: ",TCL_STATIC);
+	Tcl_AppendResult (interp,message,NULL);
+	return (TCL_ERROR);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Append the UTF-8 text from start of the output to the end, quoted	|
+ | as the options ask.													|
+\*----------------------------------------------------------------------*/
+
+static void csv_quote (struct csv *c, int start) {
+	char *s = Tcl_DStringValue(&c->out) + start;
+	int n = Tcl_DStringLength(&c->out) - start, k;
+
+	if (c->quote == Q_NONE)
+		return;
+	if (c->quote == Q_AUTO) {
+		for (k=0; k < n; k++)
+			if (s[k] == '"' || s[k] == '\n' || s[k] == '\r'
+			 || (s[k] == c->delimiter[0] && k + c->delimiter_length <= n && memcmp (s + k,c->delimiter,c->delimiter_length) == 0))
+				break;
+		if (k == n)
+			return;
+		}
+
+	Tcl_DStringSetLength(&c->value,0);
+	Tcl_DStringAppend(&c->value,s,n);
+	Tcl_DStringSetLength(&c->out,start);
+	s = Tcl_DStringValue(&c->value);
+	Tcl_DStringAppend(&c->out,"\"",1);
+	for (k=0; k < n; k++) {
+		char *q = memchr (s + k,'"',n - k);
+		int m = q ? (int) (q - s) + 1 : n;
+		Tcl_DStringAppend(&c->out,s + k,m - k);
+		if (q)
+			Tcl_DStringAppend(&c->out,"\"",1);
+		k = m - 1;
+		}
+	Tcl_DStringAppend(&c->out,"\"",1);
+	}
+
+static int csv_flush (Tcl_Channel channel, int utf, struct csv *c) {
+	int n = Tcl_DStringLength(&c->out), written;
+
+	if (!channel || n == 0)
+		return (TCL_OK);
+	written = utf ? Tcl_Write (channel,Tcl_DStringValue(&c->out),n) : Tcl_WriteChars (channel,Tcl_DStringValue(&c->out),n);
+	Tcl_DStringSetLength(&c->out,0);
+	return (written < 0 ? TCL_ERROR : TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | export csv [-channel <chan> | -file <path>] [-fields <list>]			|
+ |	[-where <predicate>] [-delimiter <char>] [-quote auto|all|none]		|
+ |	[-header <bool>] [-skipdeleted]										|
+ |																		|
+ | Without -channel or -file the CSV text is returned, otherwise the	|
+ | number of records written.  -file writes UTF-8; -channel writes in	|
+ | the encoding and translation the channel has been given.				|
+\*----------------------------------------------------------------------*/
+
+int csv_export (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	Tcl_Obj *predicate = NULL, *fields = NULL, *file = NULL;
+	Tcl_Channel channel = NULL;
+	struct where *where = NULL;
+	struct csv c;
+	int *index;
+	int header = 1, skip = 0, count, records = 0, rc, i, j, k, quote;
+	int result = TCL_OK;
+
+	c.delimiter[0] = ',';
+	c.delimiter_length = 1;
+	c.quote = Q_AUTO;
+
+	for (k=3; k < objc; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-channel") == 0 && k+1 < objc) {
+			int mode;
+			if (!(channel = Tcl_GetChannel (interp,Tcl_GetString(objv[++k]),&mode)))
+				return (TCL_ERROR);
+			if (!(mode & TCL_WRITABLE))
+				return (csv_error (interp,"the channel is not open for writing"));
+			}
+		else if (strcmp (option,"-file") == 0 && k+1 < objc)
+			file = objv[++k];
+		else if (strcmp (option,"-fields") == 0 && k+1 < objc)
+			fields = objv[++k];
+		else if (strcmp (option,"-where") == 0 && k+1 < objc)
+			predicate = objv[++k];
+		else if (strcmp (option,"-delimiter") == 0 && k+1 < objc) {
+			char *d = Tcl_GetString(objv[++k]);
+			Tcl_UniChar ch;
+			c.delimiter_length = Tcl_UtfToUniChar (d,&ch);
+			if (*d == '\0' || d[c.delimiter_length] != '\0' || *d == '"' || *d == '\r' || *d == '\n')
+				return (csv_error (interp,"the delimiter must be one character other than a quote, CR or LF"));
+			memcpy (c.delimiter,d,c.delimiter_length);
+			}
+		else if (strcmp (option,"-quote") == 0 && k+1 < objc) {
+			if (Tcl_GetIndexFromObj (interp,objv[++k],(const char **) quote_names,"quote mode",0,&quote) == TCL_ERROR)
+				return (TCL_ERROR);
+			c.quote = (enum csv_quote) quote;
+			}
+		else if (strcmp (option,"-header") == 0 && k+1 < objc) {
+			if (Tcl_GetBooleanFromObj (interp,objv[++k],&header) == TCL_ERROR)
+				return (TCL_ERROR);
+			}
+		else if (strcmp (option,"-skipdeleted") == 0)
+			skip = 1;
+		else
+			return (csv_error (interp,"expected -channel chan, -file path, -fields list, -where predicate, -delimiter char, -quote mode, -header bool or -skipdeleted"));
+		}
+	if (channel && file)
+		return (csv_error (interp,"-channel and -file cannot both be given"));
+
+	/* The fields to write, all of them by default */
+
+	if (fields) {
+		Tcl_Obj **field_objv;
+		if (Tcl_ListObjGetElements (interp,fields,&count,&field_objv) == TCL_ERROR)
+			return (TCL_ERROR);
+		index = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+		for (j=0; j < count; j++)
+			if ((index[j] = get_field_index (di,field_objv[j])) == -1) {
+				Tcl_SetResult (interp,"export: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(field_objv[j])," does not match a field name in this dbf file",NULL);
+				ckfree ((char *) index);
+				return (TCL_ERROR);
+				}
+		}
+	else {
+		count = DBFGetFieldCount (df);
+		index = (int *) ckalloc ((count > 0 ? count : 1) * sizeof (int));
+		for (j=0; j < count; j++)
+			index[j] = j;
+		}
+
+	if (predicate && where_compile (interp,di,predicate,&where) == TCL_ERROR) {
+		ckfree ((char *) index);
+		return (TCL_ERROR);
+		}
+
+	if (file) {
+		if (!(channel = Tcl_FSOpenFileChannel (interp,file,"w",0644))) {
+			where_free (where);
+			ckfree ((char *) index);
+			return (TCL_ERROR);
+			}
+		Tcl_SetChannelOption (interp,channel,"-translation","binary");
+		}
+
+	Tcl_DStringInit(&c.out);
+	Tcl_DStringInit(&c.value);
+
+	if (header) {
+		for (j=0; j < count; j++) {
+			char name[XBASE_FLDNAME_LEN_READ + 1];
+			int start;
+			if (j > 0)
+				Tcl_DStringAppend(&c.out,c.delimiter,c.delimiter_length);
+			DBFGetFieldInfo (df,index[j],name,NULL,NULL);
+			start = Tcl_DStringLength(&c.out);
+			Tcl_DStringAppend(&c.out,name,-1);
+			csv_quote (&c,start);
+			}
+		Tcl_DStringAppend(&c.out,"\n",1);
+		}
+
+	rc = DBFGetRecordCount (df);
+	for (i=0; i < rc && result == TCL_OK; i++) {
+		const char *record = DBFReadTuple (df,i);
+		if (!record || (skip && *record == '*') || (where && !where_match (where,record)))
+			continue;
+		for (j=0; j < count; j++) {
+			int n, start, f = index[j];
+			const char *t = field_text (df,record,f,&n);
+			if (j > 0)
+				Tcl_DStringAppend(&c.out,c.delimiter,c.delimiter_length);
+			if (DBFIsFieldValueNULL (df->pachFieldType[f],t,n,df->panFieldSize[f]))
+				continue;
+			start = Tcl_DStringLength(&c.out);
+			external_to_utf (di,t,n,&c.out);
+			csv_quote (&c,start);
+			}
+		Tcl_DStringAppend(&c.out,"\n",1);
+		records++;
+		if (Tcl_DStringLength(&c.out) >= CSV_BUFFER_SIZE)
+			result = csv_flush (channel,file != NULL,&c);
+		}
+	if (result == TCL_OK)
+		result = csv_flush (channel,file != NULL,&c);
+
+	where_free (where);
+	ckfree ((char *) index);
+	Tcl_DStringFree(&c.value);
+
+	if (file && Tcl_Close (interp,channel) != TCL_OK)
+		result = TCL_ERROR;
+	if (result == TCL_ERROR) {
+		Tcl_DStringFree(&c.out);
+		Tcl_SetResult (interp,"export: could not write ",TCL_STATIC);
+		Tcl_AppendResult (interp,file ? Tcl_GetString(file) : Tcl_GetChannelName(channel),NULL);
+		return (TCL_ERROR);
+		}
+
+	if (channel)
+		Tcl_SetObjResult (interp,Tcl_NewIntObj (records));
+	else
+		Tcl_DStringResult (interp,&c.out);
+	Tcl_DStringFree(&c.out);
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Rows of a CSV file read a chunk at a time.  The values of a row are	|
+ | gathered end to end in text, value k ending at ends[k].  Quotes are	|
+ | undone; blank lines are skipped.										|
+\*----------------------------------------------------------------------*/
+
+struct csv_reader {
+	Tcl_Channel channel;
+	Tcl_Obj *chunk;
+	const char *p;
+	const char *end;
+	int delimiter;
+	int failed;				/* the channel could not be read */
+	Tcl_DString text;
+	int *ends;
+	int size;
+	};
+
+static int csv_fill (struct csv_reader *r) {
+	int n = 0;
+
+	if (r->failed || (n = Tcl_ReadChars (r->channel,r->chunk,CSV_BUFFER_SIZE,0)) <= 0) {
+		if (n < 0)
+			r->failed = 1;
+		r->p = r->end;
+		return (0);
+		}
+	r->p = Tcl_GetStringFromObj (r->chunk,&n);
+	r->end = r->p + n;
+	return (1);
+	}
+
+#define CSV_GETC(r) ((r)->p < (r)->end ? (unsigned char) *(r)->p++ : (csv_fill (r) ? (unsigned char) *(r)->p++ : -1))
+
+/* Append characters up to the next delimiter, quote or line end */
+
+static void csv_span (struct csv_reader *r) {
+	for (;;) {
+		const char *s = r->p;
+		while (r->p < r->end && (unsigned char) *r->p != r->delimiter && *r->p != '\n' && *r->p != '\r')
+			r->p++;
+		Tcl_DStringAppend(&r->text,s,(int) (r->p - s));
+		if (r->p < r->end || !csv_fill (r))
+			return;
+		}
+	}
+
+static int csv_row (struct csv_reader *r) {
+	int c, count = 0;
+	char ch;
+
+	do c = CSV_GETC(r); while (c == '\n' || c == '\r');
+	if (c < 0)
+		return (-1);
+
+	Tcl_DStringSetLength(&r->text,0);
+	for (;;) {
+		if (c == '"') {
+			while ((c = CSV_GETC(r)) >= 0) {
+				if (c == '"' && (c = CSV_GETC(r)) != '"')
+					break;
+				ch = (char) c;
+				Tcl_DStringAppend(&r->text,&ch,1);
+				}
+			}
+		while (c >= 0 && c != r->delimiter && c != '\n' && c != '\r') {
+			ch = (char) c;
+			Tcl_DStringAppend(&r->text,&ch,1);
+			csv_span (r);
+			c = CSV_GETC(r);
+			}
+		if (count == r->size) {
+			r->size = r->size ? 2 * r->size : 64;
+			r->ends = (int *) ckrealloc ((char *) r->ends,r->size * sizeof (int));
+			}
+		r->ends[count++] = Tcl_DStringLength(&r->text);
+		if (c == r->delimiter) {
+			c = CSV_GETC(r);
+			continue;
+			}
+		if (c == '\r' && (c = CSV_GETC(r)) >= 0 && c != '\n')
+			r->p--;
+		return (count);
+		}
+	}
+
+static const char *csv_value (struct csv_reader *r, int k, int *length) {
+	int start = k > 0 ? r->ends[k - 1] : 0;
+	*length = r->ends[k] - start;
+	return (Tcl_DStringValue(&r->text) + start);
+	}
+
+static int csv_open (Tcl_Interp *interp, struct csv_reader *r, Tcl_Obj *path, const char *encoding) {
+	if (!(r->channel = Tcl_FSOpenFileChannel (interp,path,"r",0)))
+		return (TCL_ERROR);
+	if (Tcl_SetChannelOption (interp,r->channel,"-encoding",encoding) == TCL_ERROR) {
+		Tcl_Close (NULL,r->channel);
+		r->channel = NULL;
+		return (TCL_ERROR);
+		}
+	Tcl_SetChannelOption (NULL,r->channel,"-translation","lf");
+	Tcl_SetChannelOption (NULL,r->channel,"-eofchar","");
+	r->p = r->end = NULL;
+	r->failed = 0;
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | What the sampled values of a column could be.  Numbers must be plain	|
+ | decimals, without exponents or leading zeros, so that the width		|
+ | found holds them all, and of at most EXACT_DIGITS significant		|
+ | digits, so that a double holds them: longer ones, such as long		|
+ | identifiers, make the column text.  Dates are YYYYMMDD or			|
+ | YYYY-MM-DD; logicals are T, F, Y, N, true, false, yes or no in any	|
+ | case.																|
+\*----------------------------------------------------------------------*/
+
+#define EXACT_DIGITS 15
+
+struct csv_column {
+	int values;				/* that are not empty */
+	int number;
+	int logical;
+	int date;
+	int digits;				/* most characters before the point */
+	int decimals;			/* most digits after it */
+	int length;				/* longest value in the codepage */
+	};
+
+static const char *csv_trim (const char *t, int *n) {
+	while (*n > 0 && *t == ' ') {
+		t++;
+		(*n)--;
+		}
+	while (*n > 0 && t[*n - 1] == ' ')
+		(*n)--;
+	return (t);
+	}
+
+static int plain_number (const char *t, int n, int *digits, int *decimals) {
+	int k = 0, before, after = 0;
+
+	if (k < n && (t[k] == '-' || t[k] == '+'))
+		k++;
+	for (before = k; k < n && isdigit ((unsigned char) t[k]); k++);
+	before = k - before;
+	if (before > 1 && t[k - before] == '0')
+		return (0);
+	if (k < n && t[k] == '.')
+		for (k++; k < n && isdigit ((unsigned char) t[k]); k++)
+			after++;
+	if (k < n || before + after == 0)
+		return (0);
+	*digits = (t[0] == '-' || t[0] == '+') + (before > 0 ? before : 1);
+	*decimals = after;
+	return (1);
+	}
+
+/* Digits of a plain number from its first nonzero one, trailing zeros of its decimals aside */
+
+static int significant_digits (const char *t, int n) {
+	int k = 0, count = 0, zeros = 0, point = 0;
+
+	for (; k < n && (t[k] < '1' || t[k] > '9'); k++)
+		point |= t[k] == '.';
+	for (; k < n; k++) {
+		if (t[k] == '.')
+			point = 1;
+		else if (t[k] == '0')
+			zeros++;
+		else {
+			count += zeros + 1;
+			zeros = 0;
+			}
+		}
+	return (point ? count : count + zeros);
+	}
+
+static int logical_value (const char *t, int n) {
+	char word[6];
+	int k;
+
+	if (n > 5)
+		return (0);
+	for (k=0; k < n; k++)
+		word[k] = (char) tolower ((unsigned char) t[k]);
+	word[n] = '\0';
+	if (strcmp (word,"t") == 0 || strcmp (word,"y") == 0 || strcmp (word,"true") == 0 || strcmp (word,"yes") == 0)
+		return ('T');
+	if (strcmp (word,"f") == 0 || strcmp (word,"n") == 0 || strcmp (word,"false") == 0 || strcmp (word,"no") == 0)
+		return ('F');
+	return (0);
+	}
+
+static int date_value (const char *t, int n, char *date) {
+	int k, month, day;
+
+	if (n == 10 && t[4] == '-' && t[7] == '-') {
+		memcpy (date,t,4);
+		memcpy (date + 4,t + 5,2);
+		memcpy (date + 6,t + 8,2);
+		}
+	else if (n == 8)
+		memcpy (date,t,8);
+	else
+		return (0);
+	for (k=0; k < 8; k++)
+		if (!isdigit ((unsigned char) date[k]))
+			return (0);
+	month = (date[4] - '0') * 10 + date[5] - '0';
+	day = (date[6] - '0') * 10 + date[7] - '0';
+	return (month >= 1 && month <= 12 && day >= 1 && day <= 31);
+	}
+
+static void csv_sample (struct dbf_info *di, struct csv_column *col, const char *t, int n, Tcl_DString *e) {
+	int digits, decimals;
+	char date[8];
+
+	t = csv_trim (t,&n);
+	if (n == 0)
+		return;
+	if (col->values++ == 0)
+		col->number = col->logical = col->date = 1;
+
+	if (col->number) {
+		if (plain_number (t,n,&digits,&decimals) && significant_digits (t,n) <= EXACT_DIGITS) {
+			if (digits > col->digits)
+				col->digits = digits;
+			if (decimals > col->decimals)
+				col->decimals = decimals;
+			}
+		else
+			col->number = 0;
+		}
+	if (col->logical && !logical_value (t,n))
+		col->logical = 0;
+	if (col->date && !date_value (t,n,date))
+		col->date = 0;
+
+	Tcl_DStringSetLength(e,0);
+	n = (int) strlen (utf_to_external (di,t,n,e));
+	if (n > col->length)
+		col->length = n;
+	}
+
+/*----------------------------------------------------------------------*\
+ | Field names from the header row, cut to 10 letters, digits and		|
+ | underscores and made unique.											|
+\*----------------------------------------------------------------------*/
+
+static void field_name (DBFHandle df, const char *t, int n, int k, char *name) {
+	int length = 0, j, suffix = 1;
+
+	t = csv_trim (t,&n);
+	for (j=0; j < n && length < 10; j++)
+		if ((unsigned char) t[j] < 0x80)
+			name[length++] = isalnum ((unsigned char) t[j]) ? t[j] : '_';
+	name[length] = '\0';
+	if (length == 0)
+		sprintf (name,"F%d",k + 1);
+
+	while (DBFGetFieldIndex (df,name) >= 0) {
+		char number[16];
+		int m = sprintf (number,"_%d",++suffix);
+		length = (int) strlen (name);
+		strcpy (name + (length + m > 10 ? 10 - m : length),number);
+		}
+	}
+
+static int import_error (Tcl_Interp *interp, const char *message, Tcl_Obj *obj) {
+	Tcl_SetResult (interp,"import: ",TCL_STATIC);
+	Tcl_AppendResult (interp,message,obj ? Tcl_GetString(obj) : NULL,NULL);
+	return (TCL_ERROR);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Fields from -schema, a list of {name type width ?prec?} as add		|
+ | takes them.															|
+\*----------------------------------------------------------------------*/
+
+static int schema_fields (Tcl_Interp *interp, DBFHandle df, Tcl_Obj *schema) {
+	Tcl_Obj **field_objv, **spec_objv;
+	int count, n, j, width, prec;
+
+	if (Tcl_ListObjGetElements (interp,schema,&count,&field_objv) == TCL_ERROR)
+		return (TCL_ERROR);
+	for (j=0; j < count; j++) {
+		DBFFieldType type;
+		prec = 0;
+		if (Tcl_ListObjGetElements (interp,field_objv[j],&n,&spec_objv) == TCL_ERROR)
+			return (TCL_ERROR);
+		if (n < 3 || n > 4
+		 || (type = dbf_get_type (Tcl_GetString(spec_objv[1]))) == FTInvalid
+		 || Tcl_GetIntFromObj (NULL,spec_objv[2],&width) == TCL_ERROR || width < 1 || width > XBASE_FLD_MAX_WIDTH
+		 || (n == 4 && (Tcl_GetIntFromObj (NULL,spec_objv[3],&prec) == TCL_ERROR || prec < 0 || prec > width)))
+			return (import_error (interp,"expected a field as {name type width ?prec?} in -schema, not ",field_objv[j]));
+		if (DBFAddField (df,Tcl_GetString(spec_objv[0]),type,width,type == FTDouble ? prec : 0) < 0)
+			return (import_error (interp,"could not add the field ",field_objv[j]));
+		}
+	if (count == 0)
+		return (import_error (interp,"-schema has no fields",NULL));
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Fields inferred from the header row and the first rows of the file.	|
+\*----------------------------------------------------------------------*/
+
+static int infer_fields (Tcl_Interp *interp, struct dbf_info *di, struct csv_reader *r, int header, int infer) {
+	struct csv_column *columns = NULL;
+	int *name_ends = NULL;
+	Tcl_DString names, e;
+	int count = 0, names_count = 0, rows, n, k;
+	int result = TCL_OK;
+
+	Tcl_DStringInit(&names);
+	Tcl_DStringInit(&e);
+
+	/* The header row, kept for the names */
+
+	if (header && (names_count = csv_row (r)) > 0) {
+		Tcl_DStringAppend(&names,Tcl_DStringValue(&r->text),Tcl_DStringLength(&r->text));
+		name_ends = (int *) ckalloc (names_count * sizeof (int));
+		memcpy (name_ends,r->ends,names_count * sizeof (int));
+		count = names_count;
+		columns = (struct csv_column *) ckalloc (count * sizeof (struct csv_column));
+		memset (columns,0,count * sizeof (struct csv_column));
+		}
+
+	for (rows=0; (infer == 0 || rows < infer) && (n = csv_row (r)) >= 0; rows++) {
+		if (n > count) {
+			columns = (struct csv_column *) ckrealloc ((char *) columns,n * sizeof (struct csv_column));
+			memset (columns + count,0,(n - count) * sizeof (struct csv_column));
+			count = n;
+			}
+		for (k=0; k < n; k++) {
+			int length;
+			const char *t = csv_value (r,k,&length);
+			csv_sample (di,columns + k,t,length,&e);
+			}
+		}
+	Tcl_DStringFree(&e);
+
+	if (r->failed)
+		result = import_error (interp,"could not read the file",NULL);
+	else if (count == 0)
+		result = import_error (interp,"the file has no rows",NULL);
+
+	for (k=0; k < count && result == TCL_OK; k++) {
+		struct csv_column *col = columns + k;
+		char name[XBASE_FLDNAME_LEN_READ + 1];
+		int width = col->length > 0 ? col->length : 1, decimals = 0;
+		DBFFieldType type = FTString;
+
+		if (col->values > 0 && col->date) {
+			type = FTDate;
+			width = 8;
+			}
+		else if (col->values > 0 && col->logical) {
+			type = FTLogical;
+			width = 1;
+			}
+		else if (col->values > 0 && col->number && col->digits + (col->decimals ? col->decimals + 1 : 0) <= XBASE_FLD_MAX_WIDTH) {
+			type = FTDouble;
+			decimals = col->decimals;
+			width = col->digits + (decimals ? decimals + 1 : 0);
+			}
+		else if (width > XBASE_FLD_MAX_WIDTH)
+			width = XBASE_FLD_MAX_WIDTH;
+
+		if (k < names_count) {
+			int start = k > 0 ? name_ends[k - 1] : 0;
+			field_name (di->df,Tcl_DStringValue(&names) + start,name_ends[k] - start,k,name);
+			}
+		else
+			field_name (di->df,"",0,k,name);
+		if (DBFAddField (di->df,name,type,width,decimals) < 0) {
+			Tcl_SetResult (interp,"import: could not add the field ",TCL_STATIC);
+			Tcl_AppendResult (interp,name,NULL);
+			result = TCL_ERROR;
+			}
+		}
+
+	Tcl_DStringFree(&names);
+	if (name_ends)
+		ckfree ((char *) name_ends);
+	if (columns)
+		ckfree ((char *) columns);
+	return (result);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Format value t of n UTF-8 bytes into field j of a record.  Values	|
+ | that cannot be written as they are, such as text longer than the		|
+ | field or a number that is not one, stop the import.					|
+\*----------------------------------------------------------------------*/
+
+/* A plain number too long for a double goes into the field digit for digit, if its decimals fit */
+
+static int exact_number (char *field, int width, int decimals, const char *t, int n) {
+	char number[2 * XBASE_FLD_MAX_WIDTH + 4];
+	int digits, after, length = 0, k = 0;
+
+	if (!plain_number (t,n,&digits,&after) || after > decimals)
+		return (0);
+	if (n > width + 1)
+		return (-1);
+	if (t[0] == '-' || t[0] == '+') {
+		if (t[0] == '-')
+			number[length++] = '-';
+		k++;
+		}
+	if (t[k] == '.')
+		number[length++] = '0';
+	for (; k < n; k++)
+		number[length++] = t[k];
+	if (decimals > 0 && after == 0 && number[length - 1] != '.')
+		number[length++] = '.';
+	else if (decimals == 0 && number[length - 1] == '.')
+		length--;
+	for (; after < decimals; after++)
+		number[length++] = '0';
+	if (length > width)
+		return (-1);
+	memset (field,' ',width - length);
+	memcpy (field + width - length,number,length);
+	return (1);
+	}
+
+static int import_cell (struct dbf_info *di, int j, char *record, const char *t, int n, Tcl_DString *e) {
+	DBFHandle df = di->df;
+	char *field = record + df->panFieldOffset[j];
+	int width = df->panFieldSize[j];
+	char number[XBASE_FLD_MAX_WIDTH + 1];
+	double d;
+	int k;
+
+	t = csv_trim (t,&n);
+	if (n == 0) {
+		switch (df->pachFieldType[j]) {
+			case 'N':
+			case 'F': memset (field,'*',width); break;
+			case 'D': memset (field,'0',width); break;
+			case 'L': memset (field,'?',width); break;
+			}
+		return (1);
+		}
+
+	switch (df->pachFieldType[j]) {
+		case 'N':
+		case 'F':
+			if (significant_digits (t,n) > EXACT_DIGITS && (k = exact_number (field,width,df->panFieldDecimals[j],t,n)) != 0)
+				return (k > 0);
+			if (!DBFParseDouble (t,n,&d) || DBFFormatDouble (number,width,df->panFieldDecimals[j],d) > width)
+				return (0);
+			memcpy (field,number,width);
+			return (1);
+		case 'L':
+			if (!(*field = (char) logical_value (t,n)))
+				return (0);
+			return (1);
+		case 'D':
+			if (!date_value (t,n,number) || width < 8)
+				return (0);
+			memcpy (field,number,8);
+			return (1);
+		default:
+			Tcl_DStringSetLength(e,0);
+			t = utf_to_external (di,t,n,e);
+			if ((n = (int) strlen (t)) > width)
+				return (0);
+			memcpy (field,t,n);
+			return (1);
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | dbf d -import csv <path> -output <path> [-schema <list> | -infer <n>]	|
+ |	[-header <bool>] [-delimiter <char>] [-encoding <name>]				|
+ |	[-codepage <codepage>]												|
+ |																		|
+ | Creates the dbf and returns it open, or NULL, leaving no file, with	|
+ | a message in interp.  -infer 0 samples every row.					|
+\*----------------------------------------------------------------------*/
+
+DBFHandle csv_import (Tcl_Interp *interp, int objc, Tcl_Obj * CONST objv[], Tcl_Obj **output) {
+	Tcl_Obj *input = objv[4], *schema = NULL;
+	char *encoding = "utf-8", *codepage = "LDID/87";
+	struct csv_reader r;
+	struct dbf_info di;
+	DBFHandle df;
+	Tcl_DString native, e;
+	char *record;
+	int header = 1, infer = 1000, rows = 0, n, k, j, fc;
+	int result = TCL_OK;
+
+	*output = NULL;
+	r.delimiter = ',';
+	for (k=5; k < objc; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-output") == 0 && k+1 < objc)
+			*output = objv[++k];
+		else if (strcmp (option,"-schema") == 0 && k+1 < objc)
+			schema = objv[++k];
+		else if (strcmp (option,"-infer") == 0 && k+1 < objc) {
+			if (Tcl_GetIntFromObj (NULL,objv[++k],&infer) == TCL_ERROR || infer < 0) {
+				import_error (interp,"-infer expects a number of rows, 0 for all of them",NULL);
+				return (NULL);
+				}
+			}
+		else if (strcmp (option,"-header") == 0 && k+1 < objc) {
+			if (Tcl_GetBooleanFromObj (interp,objv[++k],&header) == TCL_ERROR)
+				return (NULL);
+			}
+		else if (strcmp (option,"-delimiter") == 0 && k+1 < objc) {
+			char *d = Tcl_GetString(objv[++k]);
+			if ((unsigned char) d[0] >= 0x80 || d[0] == '\0' || d[1] != '\0' || *d == '"' || *d == '\r' || *d == '\n') {
+				import_error (interp,"the delimiter must be one ASCII character other than a quote, CR or LF",NULL);
+				return (NULL);
+				}
+			r.delimiter = (unsigned char) *d;
+			}
+		else if (strcmp (option,"-encoding") == 0 && k+1 < objc)
+			encoding = Tcl_GetString(objv[++k]);
+		else if (strcmp (option,"-codepage") == 0 && k+1 < objc)
+			codepage = Tcl_GetString(objv[++k]);
+		else {
+			import_error (interp,"expected -output path, -schema list, -infer rows, -header bool, -delimiter char, -encoding name or -codepage codepage",NULL);
+			return (NULL);
+			}
+		}
+	if (!*output) {
+		import_error (interp,"-output is required",NULL);
+		return (NULL);
+		}
+
+	Tcl_DStringInit(&native);
+	df = DBFCreateEx (Tcl_UtfToExternalDString (NULL,Tcl_GetString(*output),-1,&native),codepage);
+	Tcl_DStringFree(&native);
+	if (!df) {
+		import_error (interp,"could not create ",*output);
+		return (NULL);
+		}
+
+	memset (&di,0,sizeof (di));
+	di.df = df;
+	di.enc = Tcl_GetEncoding (NULL,get_encoding (df->pszCodePage));
+	di.codepage = codepage_new (di.enc);
+	r.chunk = Tcl_NewObj ();
+	Tcl_IncrRefCount (r.chunk);
+	Tcl_DStringInit(&r.text);
+	r.ends = NULL;
+	r.size = 0;
+	r.channel = NULL;
+
+	/* First pass: the fields */
+
+	if (schema)
+		result = schema_fields (interp,df,schema);
+	else if ((result = csv_open (interp,&r,input,encoding)) == TCL_OK) {
+		result = infer_fields (interp,&di,&r,header,infer);
+		Tcl_Close (NULL,r.channel);
+		}
+
+	/* Second pass: the records, through a large append buffer */
+
+	if (result == TCL_OK && (result = csv_open (interp,&r,input,encoding)) == TCL_OK) {
+		fc = DBFGetFieldCount (df);
+		record = ckalloc (df->nRecordLength);
+		Tcl_DStringInit(&e);
+		DBFSetAppendBufferSize (df,BULKLOAD_BUFFER_SIZE);
+		if (header)
+			csv_row (&r);
+		while (result == TCL_OK && (n = csv_row (&r)) >= 0) {
+			memset (record,' ',df->nRecordLength);
+			for (j=0; j < fc; j++) {
+				int length = 0;
+				const char *t = j < n ? csv_value (&r,j,&length) : "";
+				if (!import_cell (&di,j,record,t,length,&e)) {
+					char name[XBASE_FLDNAME_LEN_READ + 1], where[64];
+					Tcl_DString value;
+					Tcl_DStringInit(&value);
+					Tcl_DStringAppend(&value,t,length);
+					DBFGetFieldInfo (df,j,name,NULL,NULL);
+					sprintf (where," in row %d does not fit field ",rows + 1);
+					Tcl_SetResult (interp,"import: value \"",TCL_STATIC);
+					Tcl_AppendResult (interp,Tcl_DStringValue(&value),"\"",where,name,"; give -schema or a larger -infer",NULL);
+					Tcl_DStringFree(&value);
+					result = TCL_ERROR;
+					break;
+					}
+				}
+			if (result == TCL_OK && !DBFWriteTuple (df,rows++,record))
+				result = import_error (interp,"could not write to ",*output);
+			}
+		if (result == TCL_OK && r.failed)
+			result = import_error (interp,"could not read ",input);
+		if (!DBFSetAppendBufferSize (df,0) && result == TCL_OK)
+			result = import_error (interp,"could not write to ",*output);
+		Tcl_DStringFree(&e);
+		ckfree (record);
+		Tcl_Close (NULL,r.channel);
+		}
+
+	Tcl_DStringFree(&r.text);
+	if (r.ends)
+		ckfree ((char *) r.ends);
+	Tcl_DecrRefCount (r.chunk);
+	codepage_free (di.codepage);
+	if (di.enc)
+		Tcl_FreeEncoding (di.enc);
+
+	if (result == TCL_ERROR) {
+		DBFClose (df);
+		Tcl_FSDeleteFile (*output);
+		return (NULL);
+		}
+	DBFUpdateHeader (df);
+	return (df);
+	}
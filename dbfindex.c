@@ -0,0 +1,831 @@
+/*----------------------------------------------------------------------*\
+ | Sidecar indexes: a sorted array of {key rowid} entries for one field	|
+ | of a dbf, kept in a file next to it (by default parcels.APN.idx for	|
+ | the field APN of parcels.dbf) and loaded whole when opened.			|
+ |																		|
+ | Keys are fixed width and compare with memcmp: numbers of N and F		|
+ | fields as 8 bytes that sort as the numbers do, L fields as T or F	|
+ | and other fields as their trimmed text padded with zero bytes.  The	|
+ | record number follows the key, most significant byte first, so that	|
+ | entries sort by key and then by record.  NULL values and deleted		|
+ | records are left out.												|
+ |																		|
+ | Records written while an index is open leave it with index_touch and	|
+ | go back in as they were written when the index is next read.  New		|
+ | entries go to a small sorted delta array and removed ones are only		|
+ | flagged, so that a change costs O(log n) plus a short move; the two	|
+ | are merged once the delta holds about the square root of n entries.	|
+ |																		|
+ | The file records the size, modification time and record count of		|
+ | the dbf when it was written; an index that does not match them is		|
+ | out of date and has to be created again.								|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+#define INDEX_MAGIC "TCLDBFIX"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 56
+#define INDEX_DELTA_MIN 1024
+
+struct dbf_index {
+	struct dbf_index *next;
+	int field;
+	char name[XBASE_FLDNAME_LEN_READ + 1];
+	char native;			/* type of the field in the dbf */
+	char type;				/* N, L or C: how keys are made */
+	int width;				/* bytes of a key */
+	int size;				/* bytes of an entry: key, rowid and removed flag */
+	char *path;
+	unsigned char *entries;	/* sorted */
+	int count;
+	int removed;			/* entries flagged as removed */
+	unsigned char *delta;	/* sorted, added since the last merge */
+	int delta_count;
+	int delta_limit;
+	int dirty;
+	};
+
+/*----------------------------------------------------------------------*\
+ | Keys																	|
+\*----------------------------------------------------------------------*/
+
+static void number_key (double d, unsigned char *key) {
+	Tcl_WideUInt bits;
+	int i;
+
+	if (d == 0)
+		d = 0;	/* no negative zero */
+	memcpy (&bits,&d,sizeof (bits));
+	if (bits >> 63)
+		bits = ~bits;
+	else
+		bits |= (Tcl_WideUInt) 1 << 63;
+	for (i=7; i >= 0; i--, bits >>= 8)
+		key[i] = (unsigned char) (bits & 0xFF);
+	}
+
+static void put_rowid (unsigned char *p, int rowid) {
+	p[0] = (unsigned char) (rowid >> 24);
+	p[1] = (unsigned char) (rowid >> 16);
+	p[2] = (unsigned char) (rowid >> 8);
+	p[3] = (unsigned char) rowid;
+	}
+
+static int get_rowid (const unsigned char *p) {
+	return ((int) (((unsigned) p[0] << 24) | ((unsigned) p[1] << 16) | ((unsigned) p[2] << 8) | p[3]));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Key of a record, or 0 if the record is deleted or its value is NULL	|
+ | or, in a numeric field, not a number.								|
+\*----------------------------------------------------------------------*/
+
+static int record_key (struct dbf_index *ix, DBFHandle df, const char *record, unsigned char *key) {
+	const char *t;
+	int n;
+
+	if (!record || *record == '*')
+		return (0);
+	t = field_text (df,record,ix->field,&n);
+	if (DBFIsFieldValueNULL (df->pachFieldType[ix->field],t,n,df->panFieldSize[ix->field]))
+		return (0);
+
+	if (ix->type == 'N') {
+		double d;
+		if (!DBFParseDouble (t,n,&d) || d != d)
+			return (0);
+		number_key (d,key);
+		return (1);
+		}
+
+	if (ix->type == 'L') {
+		if (n > 0 && strchr ("TtYy",*t)) *key = 'T';
+		else if (n > 0 && strchr ("FfNn",*t)) *key = 'F';
+		else return (0);
+		return (1);
+		}
+
+	memcpy (key,t,n);
+	memset (key + n,0,ix->width - n);
+	return (1);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Key of a value given to lookup or range.  Text longer than the field	|
+ | is cut to its width and *longer set, since no record can equal it.	|
+\*----------------------------------------------------------------------*/
+
+static int value_key (Tcl_Interp *interp, struct dbf_info *di, struct dbf_index *ix, Tcl_Obj *obj, unsigned char *key, int *longer) {
+	*longer = 0;
+
+	if (ix->type == 'N') {
+		double d;
+		if (Tcl_GetDoubleFromObj (NULL,obj,&d) != TCL_OK || d != d) {
+			Tcl_SetResult (interp,"index: expected a number but got \"",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(obj),"\"",NULL);
+			return (TCL_ERROR);
+			}
+		number_key (d,key);
+		return (TCL_OK);
+		}
+
+	if (ix->type == 'L') {
+		int b;
+		if (Tcl_GetBooleanFromObj (NULL,obj,&b) != TCL_OK) {
+			Tcl_SetResult (interp,"index: expected a boolean but got \"",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(obj),"\"",NULL);
+			return (TCL_ERROR);
+			}
+		*key = b ? 'T' : 'F';
+		return (TCL_OK);
+		}
+
+	{
+	Tcl_DString e;
+	int length;
+	char *value = Tcl_GetStringFromObj (obj,&length);
+	utf_to_external (di,value,length,&e);
+	length = Tcl_DStringLength(&e);
+	if (length > ix->width) {
+		length = ix->width;
+		*longer = 1;
+		}
+	memcpy (key,Tcl_DStringValue(&e),length);
+	memset (key + length,0,ix->width - length);
+	Tcl_DStringFree(&e);
+	}
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Sorted arrays of entries												|
+\*----------------------------------------------------------------------*/
+
+/* First entry not less than the first length bytes of probe */
+
+static int lower_bound (unsigned char *entries, int count, int size, const unsigned char *probe, int length) {
+	int low = 0, high = count;
+	while (low < high) {
+		int middle = low + (high - low) / 2;
+		if (memcmp (entries + (size_t) middle * size,probe,length) < 0)
+			low = middle + 1;
+		else
+			high = middle;
+		}
+	return (low);
+	}
+
+/* Stable bottom up merge sort; entries are compared on their first length bytes */
+
+static void sort_entries (unsigned char *entries, int count, int size, int length) {
+	unsigned char *a = entries, *b, *t;
+	int width, i;
+
+	if (count < 2)
+		return;
+	b = (unsigned char *) ckalloc ((size_t) count * size);
+	for (width=1; width < count; width *= 2) {
+		for (i=0; i < count; i += 2 * width) {
+			int left = i, middle = i + width < count ? i + width : count, right = i + 2 * width < count ? i + 2 * width : count;
+			int l = left, r = middle, k = left;
+			while (l < middle && r < right)
+				if (memcmp (a + (size_t) r * size,a + (size_t) l * size,length) < 0)
+					memcpy (b + (size_t) k++ * size,a + (size_t) r++ * size,size);
+				else
+					memcpy (b + (size_t) k++ * size,a + (size_t) l++ * size,size);
+			memcpy (b + (size_t) k * size,a + (size_t) l * size,(size_t) (middle - l) * size);
+			k += middle - l;
+			memcpy (b + (size_t) k * size,a + (size_t) r * size,(size_t) (right - r) * size);
+			}
+		t = a; a = b; b = t;
+		}
+	if (a != entries) {
+		memcpy (entries,a,(size_t) count * size);
+		ckfree ((char *) a);
+		}
+	else
+		ckfree ((char *) b);
+	}
+
+/* Merge the delta into the entries, dropping those flagged as removed */
+
+static void merge_delta (struct dbf_index *ix) {
+	int size = ix->size, length = ix->width + 4;
+	int total = ix->count - ix->removed + ix->delta_count;
+	unsigned char *merged = (unsigned char *) ckalloc ((size_t) (total > 0 ? total : 1) * size);
+	int i = 0, j = 0, k = 0;
+
+	while (i < ix->count || j < ix->delta_count) {
+		unsigned char *e = ix->entries + (size_t) i * size;
+		unsigned char *d = ix->delta + (size_t) j * size;
+		if (i < ix->count && e[length]) {
+			i++;
+			continue;
+			}
+		if (j >= ix->delta_count || (i < ix->count && memcmp (e,d,length) < 0)) {
+			memcpy (merged + (size_t) k++ * size,e,size);
+			i++;
+			}
+		else {
+			memcpy (merged + (size_t) k++ * size,d,size);
+			j++;
+			}
+		}
+
+	if (ix->entries)
+		ckfree ((char *) ix->entries);
+	ix->entries = merged;
+	ix->count = k;
+	ix->removed = 0;
+	ix->delta_count = 0;
+	for (ix->delta_limit = INDEX_DELTA_MIN; (double) ix->delta_limit * ix->delta_limit < ix->count; ix->delta_limit *= 2)
+		;
+	if (ix->delta)
+		ckfree ((char *) ix->delta);
+	ix->delta = (unsigned char *) ckalloc ((size_t) ix->delta_limit * size);
+	}
+
+static void add_entry (struct dbf_index *ix, const unsigned char *entry) {
+	int size = ix->size, length = ix->width + 4;
+	int i = lower_bound (ix->entries,ix->count,size,entry,length);
+	unsigned char *e = ix->entries + (size_t) i * size;
+
+	if (i < ix->count && memcmp (e,entry,length) == 0) {
+		if (e[length]) {
+			e[length] = 0;
+			ix->removed--;
+			}
+		return;
+		}
+
+	if (ix->delta_count >= ix->delta_limit)
+		merge_delta (ix);
+	i = lower_bound (ix->delta,ix->delta_count,size,entry,length);
+	e = ix->delta + (size_t) i * size;
+	if (i < ix->delta_count && memcmp (e,entry,length) == 0)
+		return;
+	memmove (e + size,e,(size_t) (ix->delta_count - i) * size);
+	memcpy (e,entry,length);
+	e[length] = 0;
+	ix->delta_count++;
+	}
+
+static void remove_entry (struct dbf_index *ix, const unsigned char *entry) {
+	int size = ix->size, length = ix->width + 4;
+	int i = lower_bound (ix->entries,ix->count,size,entry,length);
+	unsigned char *e = ix->entries + (size_t) i * size;
+
+	if (i < ix->count && memcmp (e,entry,length) == 0) {
+		if (!e[length]) {
+			e[length] = 1;
+			ix->removed++;
+			}
+		if (ix->removed > ix->count / 4 + INDEX_DELTA_MIN)
+			merge_delta (ix);
+		return;
+		}
+
+	i = lower_bound (ix->delta,ix->delta_count,size,entry,length);
+	e = ix->delta + (size_t) i * size;
+	if (i < ix->delta_count && memcmp (e,entry,length) == 0) {
+		memmove (e,e + size,(size_t) (ix->delta_count - i - 1) * size);
+		ix->delta_count--;
+		}
+	}
+
+/*----------------------------------------------------------------------*\
+ | Keeping the indexes of a handle current as records are written		|
+\*----------------------------------------------------------------------*/
+
+static void touch_record (struct dbf_info *di, int i, int add) {
+	struct dbf_index *ix;
+	const char *record = DBFReadTuple (di->df,i);
+	unsigned char *entry;
+
+	if (!record)
+		return;
+	for (ix=di->indexes; ix; ix=ix->next) {
+		entry = (unsigned char *) ckalloc (ix->size);
+		if (record_key (ix,di->df,record,entry)) {
+			put_rowid (entry + ix->width,i);
+			entry[ix->width + 4] = 0;
+			if (add)
+				add_entry (ix,entry);
+			else
+				remove_entry (ix,entry);
+			}
+		ix->dirty = 1;
+		ckfree ((char *) entry);
+		}
+	}
+
+/* Put the record last touched back into the indexes, as it is now */
+
+void index_settle (struct dbf_info *di) {
+	if (di->pending >= 0) {
+		int i = di->pending;
+		di->pending = -1;
+		touch_record (di,i,1);
+		}
+	}
+
+void index_touch (struct dbf_info *di, int i) {
+	if (!di->indexes)
+		return;
+	index_settle (di);
+	touch_record (di,i,0);
+	di->pending = i;
+	}
+
+/*----------------------------------------------------------------------*\
+ | Index files															|
+\*----------------------------------------------------------------------*/
+
+static void put32 (unsigned char *p, unsigned int v) {
+	int i;
+	for (i=0; i < 4; i++, v >>= 8)
+		p[i] = (unsigned char) (v & 0xFF);
+	}
+
+static void put64 (unsigned char *p, Tcl_WideUInt v) {
+	int i;
+	for (i=0; i < 8; i++, v >>= 8)
+		p[i] = (unsigned char) (v & 0xFF);
+	}
+
+static unsigned int get32 (const unsigned char *p) {
+	return ((unsigned) p[0] | ((unsigned) p[1] << 8) | ((unsigned) p[2] << 16) | ((unsigned) p[3] << 24));
+	}
+
+/*----------------------------------------------------------------------*\
+ | Header: magic, version, field name, type, key width, entry count,		|
+ | then the record count, size and modification time of the dbf.		|
+\*----------------------------------------------------------------------*/
+
+static int dbf_stamp (Tcl_Interp *interp, struct dbf_info *di, int records, unsigned char *stamp) {
+	Tcl_StatBuf *buffer = Tcl_AllocStatBuf();
+	Tcl_Obj *path = path_obj (di->path);
+	int found = Tcl_FSStat (path,buffer) == 0;
+
+	Tcl_DecrRefCount (path);
+	if (!found) {
+		ckfree ((char *) buffer);
+		if (interp) {
+			Tcl_SetResult (interp,"index: cannot read the size and time of ",TCL_STATIC);
+			Tcl_AppendResult (interp,di->path,NULL);
+			}
+		return (TCL_ERROR);
+		}
+	put32 (stamp,(unsigned int) records);
+	put64 (stamp + 4,(Tcl_WideUInt) Tcl_GetSizeFromStat (buffer));
+	put64 (stamp + 12,(Tcl_WideUInt) Tcl_GetModificationTimeFromStat (buffer));
+	ckfree ((char *) buffer);
+	return (TCL_OK);
+	}
+
+static void make_header (struct dbf_index *ix, unsigned char *header) {
+	memset (header,0,INDEX_HEADER_SIZE);
+	memcpy (header,INDEX_MAGIC,8);
+	put32 (header + 8,INDEX_VERSION);
+	memcpy (header + 12,ix->name,sizeof (ix->name));
+	header[24] = (unsigned char) ix->native;
+	header[25] = (unsigned char) ix->type;
+	put32 (header + 28,(unsigned int) ix->width);
+	put32 (header + 32,(unsigned int) (ix->count - ix->removed + ix->delta_count));
+	}
+
+static int save_index (Tcl_Interp *interp, struct dbf_info *di, struct dbf_index *ix, int records) {
+	unsigned char header[INDEX_HEADER_SIZE];
+	Tcl_Channel channel;
+	int length = ix->width + 4, i, result = TCL_OK;
+	Tcl_DString buffer;
+	Tcl_Obj *path;
+
+	if (ix->delta_count || ix->removed)
+		merge_delta (ix);
+	make_header (ix,header);
+	if (dbf_stamp (interp,di,records,header + 36) == TCL_ERROR)
+		return (TCL_ERROR);
+
+	path = path_obj (ix->path);
+	channel = Tcl_FSOpenFileChannel (interp,path,"w",0644);
+	Tcl_DecrRefCount (path);
+	if (!channel)
+		return (TCL_ERROR);
+	Tcl_SetChannelOption (interp,channel,"-translation","binary");
+
+	/* Entries go to the file without their removed flag, many at a time */
+
+	Tcl_DStringInit(&buffer);
+	Tcl_DStringAppend(&buffer,(char *) header,INDEX_HEADER_SIZE);
+	for (i=0; i < ix->count && result == TCL_OK; i++) {
+		Tcl_DStringAppend(&buffer,(char *) ix->entries + (size_t) i * ix->size,length);
+		if (Tcl_DStringLength(&buffer) >= 65536) {
+			if (Tcl_Write (channel,Tcl_DStringValue(&buffer),Tcl_DStringLength(&buffer)) < 0)
+				result = TCL_ERROR;
+			Tcl_DStringSetLength(&buffer,0);
+			}
+		}
+	if (result == TCL_OK && Tcl_DStringLength(&buffer) > 0)
+		if (Tcl_Write (channel,Tcl_DStringValue(&buffer),Tcl_DStringLength(&buffer)) < 0)
+			result = TCL_ERROR;
+	Tcl_DStringFree(&buffer);
+
+	if (Tcl_Close (interp,channel) != TCL_OK || result == TCL_ERROR) {
+		if (interp) {
+			Tcl_SetResult (interp,"index: could not write ",TCL_STATIC);
+			Tcl_AppendResult (interp,ix->path,NULL);
+			}
+		return (TCL_ERROR);
+		}
+	ix->dirty = 0;
+	return (TCL_OK);
+	}
+
+static int load_index (Tcl_Interp *interp, struct dbf_info *di, struct dbf_index *ix) {
+	unsigned char header[INDEX_HEADER_SIZE], expected[INDEX_HEADER_SIZE];
+	Tcl_Channel channel;
+	int length = ix->width + 4, count, i;
+	unsigned char *row;
+	Tcl_Obj *path = path_obj (ix->path);
+
+	channel = Tcl_FSOpenFileChannel (interp,path,"r",0);
+	Tcl_DecrRefCount (path);
+	if (!channel)
+		return (TCL_ERROR);
+	Tcl_SetChannelOption (interp,channel,"-translation","binary");
+
+	if (Tcl_Read (channel,(char *) header,INDEX_HEADER_SIZE) != INDEX_HEADER_SIZE
+	 || memcmp (header,INDEX_MAGIC,8) != 0 || get32 (header + 8) != INDEX_VERSION) {
+		Tcl_Close (NULL,channel);
+		Tcl_SetResult (interp,"index: ",TCL_STATIC);
+		Tcl_AppendResult (interp,ix->path," is not an index file",NULL);
+		return (TCL_ERROR);
+		}
+
+	make_header (ix,expected);
+	if (memcmp (header + 12,expected + 12,20) != 0) {
+		Tcl_Close (NULL,channel);
+		Tcl_SetResult (interp,"index: ",TCL_STATIC);
+		Tcl_AppendResult (interp,ix->path," is an index of another field",NULL);
+		return (TCL_ERROR);
+		}
+
+	/* Records written through this handle and not yet closed are not in the file */
+
+	if (dbf_stamp (interp,di,DBFGetRecordCount (di->df),expected + 36) == TCL_ERROR) {
+		Tcl_Close (NULL,channel);
+		return (TCL_ERROR);
+		}
+	if (memcmp (header + 36,expected + 36,20) != 0 || di->df->bUpdated) {
+		Tcl_Close (NULL,channel);
+		Tcl_SetResult (interp,"index: ",TCL_STATIC);
+		Tcl_AppendResult (interp,ix->path," is out of date; create it again",NULL);
+		return (TCL_ERROR);
+		}
+
+	count = (int) get32 (header + 32);
+	ix->entries = (unsigned char *) ckalloc ((size_t) (count > 0 ? count : 1) * ix->size);
+	row = ix->entries;
+	for (i=0; i < count; i++, row += ix->size) {
+		if (Tcl_Read (channel,(char *) row,length) != length)
+			break;
+		row[length] = 0;
+		}
+	Tcl_Close (NULL,channel);
+	if (i < count) {
+		Tcl_SetResult (interp,"index: ",TCL_STATIC);
+		Tcl_AppendResult (interp,ix->path," is truncated",NULL);
+		return (TCL_ERROR);
+		}
+	ix->count = count;
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Handles on indexes													|
+\*----------------------------------------------------------------------*/
+
+static struct dbf_index *find_index (struct dbf_info *di, int field) {
+	struct dbf_index *ix;
+	for (ix=di->indexes; ix; ix=ix->next)
+		if (ix->field == field)
+			return (ix);
+	return (NULL);
+	}
+
+static void free_index (struct dbf_index *ix) {
+	if (ix->entries)
+		ckfree ((char *) ix->entries);
+	if (ix->delta)
+		ckfree ((char *) ix->delta);
+	ckfree (ix->path);
+	ckfree ((char *) ix);
+	}
+
+/* The index file of a field: the dbf file name with .FIELD.idx for its extension */
+
+static char *default_path (struct dbf_info *di, const char *name) {
+	char *dot = strrchr (di->path,'.');
+	size_t length = strlen (di->path);
+	char *path;
+
+	if (dot && !strchr (dot,'/') && !strchr (dot,'\\'))
+		length = (size_t) (dot - di->path);
+	path = ckalloc (length + strlen (name) + 6);
+	memcpy (path,di->path,length);
+	sprintf (path + length,".%s.idx",name);
+	return (path);
+	}
+
+static struct dbf_index *new_index (struct dbf_info *di, int field, const char *path) {
+	struct dbf_index *ix = (struct dbf_index *) ckalloc (sizeof (struct dbf_index));
+	char type = di->df->pachFieldType[field];
+
+	memset (ix,0,sizeof (struct dbf_index));
+	ix->field = field;
+	DBFGetFieldInfo (di->df,field,ix->name,NULL,NULL);
+	ix->native = type;
+	if (type == 'N' || type == 'F') {
+		ix->type = 'N';
+		ix->width = 8;
+		}
+	else if (type == 'L') {
+		ix->type = 'L';
+		ix->width = 1;
+		}
+	else {
+		ix->type = 'C';
+		ix->width = di->df->panFieldSize[field];
+		}
+	ix->size = ix->width + 5;
+	ix->path = path ? strcpy (ckalloc (strlen (path) + 1),path) : default_path (di,ix->name);
+	ix->delta_limit = INDEX_DELTA_MIN;
+	ix->delta = (unsigned char *) ckalloc ((size_t) ix->delta_limit * ix->size);
+	return (ix);
+	}
+
+static int build_index (struct dbf_info *di, struct dbf_index *ix) {
+	DBFHandle df = di->df;
+	int rc = DBFGetRecordCount (df), i;
+	unsigned char *entry;
+
+	ix->entries = (unsigned char *) ckalloc ((size_t) (rc > 0 ? rc : 1) * ix->size);
+	entry = ix->entries;
+	for (i=0; i < rc; i++)
+		if (record_key (ix,df,DBFReadTuple (df,i),entry)) {
+			put_rowid (entry + ix->width,i);
+			entry[ix->width + 4] = 0;
+			entry += ix->size;
+			ix->count++;
+			}
+	sort_entries (ix->entries,ix->count,ix->size,ix->width);
+	merge_delta (ix);
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Write the indexes changed since they were last written, after sync	|
+ | or once the dbf is closed; always, if the dbf itself was changed.	|
+ | index_settle must have been called while the dbf was still open,	|
+ | which then had the given number of records.  interp is NULL when a	|
+ | shared dbf goes with the last interpreter using it.					|
+\*----------------------------------------------------------------------*/
+
+int index_save_all (Tcl_Interp *interp, struct dbf_info *di, int records, int changed) {
+	struct dbf_index *ix;
+	int result = TCL_OK;
+
+	for (ix=di->indexes; ix; ix=ix->next)
+		if ((ix->dirty || changed) && save_index (interp,di,ix,records) == TCL_ERROR)
+			result = TCL_ERROR;
+	return (result);
+	}
+
+/* The records were renumbered, as by pack: build the open indexes again */
+
+void index_rebuild_all (struct dbf_info *di) {
+	struct dbf_index *ix;
+
+	for (ix=di->indexes; ix; ix=ix->next) {
+		ckfree ((char *) ix->entries);
+		ix->entries = NULL;
+		ix->count = ix->removed = ix->delta_count = 0;
+		build_index (di,ix);
+		ix->dirty = 1;
+		}
+	}
+
+/* The fields were restructured: place[j] is the new number of field j, or -1 if it was dropped */
+
+void index_restructure (struct dbf_info *di, const int *place) {
+	struct dbf_index **p = &di->indexes;
+
+	while (*p) {
+		struct dbf_index *ix = *p, *fresh;
+
+		/* An index goes with its field, built again for the new definition */
+
+		*p = ix->next;
+		if (place[ix->field] >= 0) {
+			fresh = new_index (di,place[ix->field],ix->path);
+			build_index (di,fresh);
+			fresh->dirty = 1;
+			fresh->next = *p;
+			*p = fresh;
+			p = &fresh->next;
+			}
+		free_index (ix);
+		}
+	}
+
+void index_free_all (struct dbf_info *di) {
+	while (di->indexes) {
+		struct dbf_index *ix = di->indexes;
+		di->indexes = ix->next;
+		free_index (ix);
+		}
+	di->pending = -1;
+	}
+
+/*----------------------------------------------------------------------*\
+ | index create <field> [-file <path>]									|
+ | index open <field> [-file <path>]									|
+ | index close <field>													|
+\*----------------------------------------------------------------------*/
+
+int index_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	struct dbf_index *ix, **p;
+	const char *path = NULL;
+	char *action;
+	int field;
+
+	if (objc != 4 && !(objc == 6 && strcmp (Tcl_GetString(objv[4]),"-file") == 0)) {
+		Tcl_SetResult (interp,"index expects create, open or close, the name of a field and optionally -file path",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+	action = Tcl_GetString(objv[2]);
+	if ((field = get_field_index (di,objv[3])) == -1) {
+		Tcl_SetResult (interp,"index: ",TCL_STATIC);
+		Tcl_AppendResult (interp,Tcl_GetString(objv[3])," does not match a field name in this dbf file",NULL);
+		return (TCL_ERROR);
+		}
+	if (objc == 6) {
+		Tcl_Obj *s = Tcl_FSGetNormalizedPath (interp,objv[5]);
+		if (!s)
+			return (TCL_ERROR);
+		path = Tcl_GetString(s);
+		}
+
+	index_settle (di);
+
+	if (strcmp (action,"close") == 0) {
+		int result = TCL_OK;
+		for (p=&di->indexes; *p; p=&(*p)->next)
+			if ((*p)->field == field) {
+				ix = *p;
+				if (ix->dirty)
+					result = save_index (interp,di,ix,DBFGetRecordCount (di->df));
+				*p = ix->next;
+				free_index (ix);
+				break;
+				}
+		return (result);
+		}
+
+	if (strcmp (action,"create") != 0 && strcmp (action,"open") != 0) {
+		Tcl_SetResult (interp,"index expects create, open or close",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+
+	ix = new_index (di,field,path);
+	if (strcmp (action,"create") == 0) {
+		build_index (di,ix);
+		/* written at once so that the file matches the dbf as it is on disk */
+		if (!di->df->bUpdated && save_index (interp,di,ix,DBFGetRecordCount (di->df)) == TCL_ERROR) {
+			free_index (ix);
+			return (TCL_ERROR);
+			}
+		ix->dirty = di->df->bUpdated;
+		}
+	else {
+		if (load_index (interp,di,ix) == TCL_ERROR) {
+			free_index (ix);
+			return (TCL_ERROR);
+			}
+		merge_delta (ix);
+		}
+
+	/* A new index replaces one already open on the field */
+
+	for (p=&di->indexes; *p; p=&(*p)->next)
+		if ((*p)->field == field) {
+			struct dbf_index *old = *p;
+			*p = old->next;
+			free_index (old);
+			break;
+			}
+	ix->next = di->indexes;
+	di->indexes = ix;
+	Tcl_SetObjResult (interp,Tcl_NewStringObj (ix->path,-1));
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | lookup <field> <value>												|
+ | range <field> <low> <high>											|
+ | record numbers with the value, or with values from low to high		|
+ | inclusive in the order of the index; an empty low or high leaves		|
+ | that end open.														|
+\*----------------------------------------------------------------------*/
+
+int lookup_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	char *command = Tcl_GetString(objv[1]);
+	int range = strcmp (command,"range") == 0;
+	struct dbf_index *ix;
+	unsigned char *low = NULL, *high = NULL;
+	int low_longer = 0, high_longer = 0, i, j, field, length;
+	Tcl_Obj *obj;
+
+	if (objc != (range ? 5 : 4)) {
+		Tcl_SetResult (interp,range ? "range expects the name of a field, a low and a high value" : "lookup expects the name of a field and a value",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+	if ((field = get_field_index (di,objv[2])) == -1) {
+		Tcl_AppendResult (interp,command,": ",Tcl_GetString(objv[2])," does not match a field name in this dbf file",NULL);
+		return (TCL_ERROR);
+		}
+	if (!(ix = find_index (di,field))) {
+		Tcl_AppendResult (interp,command,": no index is open on ",Tcl_GetString(objv[2]),NULL);
+		return (TCL_ERROR);
+		}
+
+	index_settle (di);
+	length = ix->width + 4;
+	low = (unsigned char *) ckalloc (2 * ix->size);
+	high = low + ix->size;
+
+	if (range) {
+		int low_open = Tcl_GetCharLength (objv[3]) == 0 && ix->type != 'C';
+		int high_open = Tcl_GetCharLength (objv[4]) == 0;
+		if ((!low_open && value_key (interp,di,ix,objv[3],low,&low_longer) == TCL_ERROR)
+		 || (!high_open && value_key (interp,di,ix,objv[4],high,&high_longer) == TCL_ERROR)) {
+			ckfree ((char *) low);
+			return (TCL_ERROR);
+			}
+		if (low_open)
+			memset (low,0,ix->width);
+		if (high_open)
+			memset (high,0xFF,ix->width);
+		}
+	else {
+		if (value_key (interp,di,ix,objv[3],low,&low_longer) == TCL_ERROR) {
+			ckfree ((char *) low);
+			return (TCL_ERROR);
+			}
+		memcpy (high,low,ix->width);
+		if (low_longer) {
+			ckfree ((char *) low);
+			Tcl_SetObjResult (interp,Tcl_NewListObj (0,NULL));
+			return (TCL_OK);
+			}
+		}
+
+	/* Walk the entries and the delta together, in order */
+
+	put_rowid (low + ix->width,0);
+	i = lower_bound (ix->entries,ix->count,ix->size,low,length);
+	j = lower_bound (ix->delta,ix->delta_count,ix->size,low,length);
+	obj = Tcl_NewListObj (0,NULL);
+	for (;;) {
+		unsigned char *e = i < ix->count ? ix->entries + (size_t) i * ix->size : NULL;
+		unsigned char *d = j < ix->delta_count ? ix->delta + (size_t) j * ix->size : NULL;
+		unsigned char *next;
+
+		if (e && d)
+			next = memcmp (e,d,length) <= 0 ? e : d;
+		else
+			next = e ? e : d;
+		if (!next || memcmp (next,high,ix->width) > 0)
+			break;
+		if (next == e)
+			i++;
+		else
+			j++;
+		/* a low value cut to the field width excludes records equal to the cut */
+		if (next[length] || (low_longer && memcmp (next,low,ix->width) == 0))
+			continue;
+		Tcl_ListObjAppendElement (NULL,obj,Tcl_NewIntObj (get_rowid (next + ix->width)));
+		}
+
+	ckfree ((char *) low);
+	Tcl_SetObjResult (interp,obj);
+	return (TCL_OK);
+	}
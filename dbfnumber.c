@@ -0,0 +1,450 @@
+/******************************************************************************
+ *
+ * Project:  Shapelib
+ * Purpose:  Formatting numbers into the fixed width text of .dbf N, F
+ *           and D fields, and parsing them back, without going through
+ *           printf and atof.
+ *
+ ******************************************************************************
+ *
+ * SPDX-License-Identifier: MIT OR LGPL-2.0-or-later
+ ******************************************************************************/
+
+#include "shapefil_private.h"
+
+#include <locale.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#if _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+#elif defined(_WIN32)
+#ifndef snprintf
+#define snprintf _snprintf
+#endif
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE 1
+#endif
+
+/* Below 2^52 a double has no fraction bits to spare, so the difference */
+/* between it and its floor is exact */
+#define DBF_EXACT_LIMIT 4503599627370496.0
+
+/* Powers of ten that are exact as doubles */
+static const double adfPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+#define DBF_MAX_EXACT_POWER 22
+
+/************************************************************************/
+/*                          DBFFormatFixed()                            */
+/*                                                                      */
+/*      Write nWhole.nFraction right justified in nWidth, the fraction  */
+/*      zero padded to nDecimals digits.  Return -1 if it would not     */
+/*      fit in a field buffer.                                          */
+/************************************************************************/
+
+static int DBFFormatFixed(char *pszBuffer, int nWidth, int nDecimals,
+                          bool bNegative, uint64_t nWhole, uint64_t nFraction)
+{
+    char szWhole[24];
+    char *pszWhole = szWhole + sizeof(szWhole);
+
+    do
+    {
+        *--pszWhole = STATIC_CAST(char, '0' + nWhole % 10);
+        nWhole /= 10;
+    } while (nWhole != 0);
+
+    const int nWholeLength =
+        STATIC_CAST(int, szWhole + sizeof(szWhole) - pszWhole);
+    const int nLength =
+        (bNegative ? 1 : 0) + nWholeLength + (nDecimals > 0 ? nDecimals + 1 : 0);
+    const int nPad = nWidth > nLength ? nWidth - nLength : 0;
+
+    if (nPad + nLength > XBASE_FLD_MAX_WIDTH)
+        return -1;
+
+    char *pszOut = pszBuffer;
+    memset(pszOut, ' ', nPad);
+    pszOut += nPad;
+    if (bNegative)
+        *pszOut++ = '-';
+    memcpy(pszOut, pszWhole, nWholeLength);
+    pszOut += nWholeLength;
+    if (nDecimals > 0)
+    {
+        *pszOut = '.';
+        for (int i = nDecimals; i > 0; i--)
+        {
+            pszOut[i] = STATIC_CAST(char, '0' + nFraction % 10);
+            nFraction /= 10;
+        }
+        pszOut += nDecimals + 1;
+    }
+    *pszOut = '\0';
+
+    return nPad + nLength;
+}
+
+/************************************************************************/
+/*                          DBFFormatDouble()                           */
+/*                                                                      */
+/*      Format dValue as printf("%*.*f", nWidth, nDecimals) would,      */
+/*      into a buffer of XBASE_FLD_MAX_WIDTH + 1 bytes, and return the  */
+/*      length of the text.  Whole numbers and numbers that scale to    */
+/*      below 2^52 are written directly, rounding half to even on the   */
+/*      exact binary value like printf; anything else falls back to     */
+/*      snprintf.  Integers written as doubles take the first path.     */
+/************************************************************************/
+
+int SHPAPI_CALL DBFFormatDouble(char *pszBuffer, int nWidth, int nDecimals,
+                                double dValue)
+{
+    const double dAbs = fabs(dValue);
+    const bool bNegative = signbit(dValue) != 0;
+    int nLength = -1;
+
+    if (nWidth > XBASE_FLD_MAX_WIDTH - 1)
+        nWidth = XBASE_FLD_MAX_WIDTH - 1;
+
+    if (nDecimals >= 0 && dAbs < DBF_EXACT_LIMIT)
+    {
+        const double dWhole = floor(dAbs);
+
+        if (dWhole == dAbs)
+        {
+            nLength = DBFFormatFixed(pszBuffer, nWidth, nDecimals, bNegative,
+                                     STATIC_CAST(uint64_t, dWhole), 0);
+        }
+        else if (nDecimals <= DBF_MAX_EXACT_POWER)
+        {
+            const double dPower = adfPowersOf10[nDecimals];
+            const double dScaled = dAbs * dPower;
+
+            if (dScaled < DBF_EXACT_LIMIT)
+            {
+                double dRounded = floor(dScaled);
+                const double dRest = dScaled - dRounded;
+
+                /* dScaled is the product rounded, which only matters */
+                /* when it lands exactly halfway */
+                if (dRest > 0.5)
+                    dRounded += 1;
+                else if (dRest == 0.5)
+                {
+                    const double dError = fma(dAbs, dPower, -dScaled);
+                    if (dError > 0 ||
+                        (dError == 0 && fmod(dRounded, 2) != 0))
+                        dRounded += 1;
+                }
+
+                const uint64_t nScaled = STATIC_CAST(uint64_t, dRounded);
+
+                /* 10^20 and up do not fit in a uint64_t, but then */
+                /* nScaled, below 2^52, is all fraction */
+                if (nDecimals <= 19)
+                {
+                    const uint64_t nPower = STATIC_CAST(uint64_t, dPower);
+                    nLength = DBFFormatFixed(pszBuffer, nWidth, nDecimals,
+                                             bNegative, nScaled / nPower,
+                                             nScaled % nPower);
+                }
+                else
+                    nLength = DBFFormatFixed(pszBuffer, nWidth, nDecimals,
+                                             bNegative, 0, nScaled);
+            }
+        }
+    }
+
+    if (nLength < 0)
+    {
+        snprintf(pszBuffer, XBASE_FLD_MAX_WIDTH + 1, "%*.*f", nWidth,
+                 nDecimals, dValue);
+        pszBuffer[XBASE_FLD_MAX_WIDTH] = '\0';
+        nLength = STATIC_CAST(int, strlen(pszBuffer));
+    }
+
+    return nLength;
+}
+
+/************************************************************************/
+/*                           DBFFormatDate()                            */
+/*                                                                      */
+/*      Write a date as the eight digits YYYYMMDD of a D field and a    */
+/*      terminating nul.  The year must be 0 to 9999, the month and     */
+/*      day 0 to 99, as DBFWriteDateAttribute checks.                   */
+/************************************************************************/
+
+void SHPAPI_CALL DBFFormatDate(char *pszBuffer, const SHPDate *psDate)
+{
+    int nDate = psDate->year * 10000 + psDate->month * 100 + psDate->day;
+
+    for (int i = 7; i >= 0; i--)
+    {
+        pszBuffer[i] = STATIC_CAST(char, '0' + nDate % 10);
+        nDate /= 10;
+    }
+    pszBuffer[8] = '\0';
+}
+
+/************************************************************************/
+/*                          DBFParseDecimal()                           */
+/*                                                                      */
+/*      Split blank padded [sign]digits[.digits] into a mantissa and    */
+/*      the number of digits after the point.  Return false for any     */
+/*      other text, or more digits than a uint64_t holds.               */
+/************************************************************************/
+
+static bool DBFParseDecimal(const char *pachValue, int nLength,
+                            bool *pbNegative, uint64_t *pnMantissa,
+                            int *pnDecimals, bool *pbPoint)
+{
+    const char *pszEnd = pachValue + nLength;
+    uint64_t nMantissa = 0;
+    int nDigits = 0;
+    int nSignificant = 0;
+    int nDecimals = 0;
+    bool bPoint = false;
+
+    while (pachValue < pszEnd && *pachValue == ' ')
+        pachValue++;
+    while (pszEnd > pachValue && pszEnd[-1] == ' ')
+        pszEnd--;
+
+    *pbNegative = pachValue < pszEnd && *pachValue == '-';
+    if (pachValue < pszEnd && (*pachValue == '-' || *pachValue == '+'))
+        pachValue++;
+
+    for (; pachValue < pszEnd; pachValue++)
+    {
+        const unsigned int nDigit =
+            STATIC_CAST(unsigned int, *pachValue - '0');
+        if (nDigit <= 9)
+        {
+            if (nMantissa != 0 || nDigit != 0)
+            {
+                if (++nSignificant > 19)
+                    return false;
+                nMantissa = nMantissa * 10 + nDigit;
+            }
+            nDigits++;
+            if (bPoint)
+                nDecimals++;
+        }
+        else if (*pachValue == '.' && !bPoint)
+            bPoint = true;
+        else
+            return false;
+    }
+
+    if (nDigits == 0)
+        return false;
+
+    *pnMantissa = nMantissa;
+    *pnDecimals = nDecimals;
+    *pbPoint = bPoint;
+    return true;
+}
+
+/************************************************************************/
+/*                          DBFParseDouble()                            */
+/*                                                                      */
+/*      Parse the nLength bytes of a numeric field, which need not be   */
+/*      NUL terminated, and return TRUE if, leading and trailing        */
+/*      blanks aside, they are all a number.  Up to 2^53 with at most   */
+/*      22 decimals the value is one exact division, so correctly       */
+/*      rounded; exponents and longer numbers are left to strtod,       */
+/*      given the decimal point of the locale in place of the '.' of    */
+/*      the field so that they parse as in the C locale.                */
+/************************************************************************/
+
+int SHPAPI_CALL DBFParseDouble(const char *pachValue, int nLength,
+                               double *pdfValue)
+{
+    bool bNegative;
+    bool bPoint;
+    uint64_t nMantissa;
+    int nDecimals;
+
+    if (DBFParseDecimal(pachValue, nLength, &bNegative, &nMantissa,
+                        &nDecimals, &bPoint) &&
+        nMantissa <= 9007199254740992ULL && nDecimals <= DBF_MAX_EXACT_POWER)
+    {
+        const double dfValue =
+            STATIC_CAST(double, nMantissa) / adfPowersOf10[nDecimals];
+        *pdfValue = bNegative ? -dfValue : dfValue;
+        return TRUE;
+    }
+
+    const int nLeading = DBFSpanChar(pachValue, nLength, ' ');
+    pachValue += nLeading;
+    nLength -= nLeading;
+    nLength -= DBFSpanCharReverse(pachValue, nLength, ' ');
+    if (nLength == 0 || nLength > XBASE_FLD_MAX_WIDTH)
+        return FALSE;
+
+    char szNumber[XBASE_FLD_MAX_WIDTH + 1];
+    char *pszEnd;
+    memcpy(szNumber, pachValue, nLength);
+    szNumber[nLength] = '\0';
+
+    const char *pszPoint = localeconv()->decimal_point;
+    if (pszPoint[0] != '.' && pszPoint[0] != '\0' && pszPoint[1] == '\0')
+    {
+        for (int i = 0; i < nLength; i++)
+        {
+            if (szNumber[i] == pszPoint[0])
+                return FALSE;
+            if (szNumber[i] == '.')
+                szNumber[i] = pszPoint[0];
+        }
+    }
+
+    *pdfValue = strtod(szNumber, &pszEnd);
+    return pszEnd == szNumber + nLength;
+}
+
+/************************************************************************/
+/*                          DBFParseInteger()                           */
+/*                                                                      */
+/*      As DBFParseDouble(), for blank padded [sign]digits that fit in  */
+/*      an int64_t.  No decimal point and no exponent.                  */
+/************************************************************************/
+
+int SHPAPI_CALL DBFParseInteger(const char *pachValue, int nLength,
+                                int64_t *pnValue)
+{
+    bool bNegative;
+    bool bPoint;
+    uint64_t nMantissa;
+    int nDecimals;
+
+    if (!DBFParseDecimal(pachValue, nLength, &bNegative, &nMantissa,
+                         &nDecimals, &bPoint) ||
+        bPoint || nMantissa > STATIC_CAST(uint64_t, INT64_MAX))
+        return FALSE;
+
+    *pnValue = bNegative ? -STATIC_CAST(int64_t, nMantissa)
+                         : STATIC_CAST(int64_t, nMantissa);
+    return TRUE;
+}
+
+/************************************************************************/
+/*                           DBFColumnText()                            */
+/*                                                                      */
+/*      The text of field iField of a raw record, up to any NUL and     */
+/*      without leading and trailing blanks, or NULL if the field is    */
+/*      NULL.                                                           */
+/************************************************************************/
+
+static const char *DBFColumnText(DBFHandle psDBF, const char *pachRecord,
+                                 int iField, int *pnLength)
+{
+    const char *pachValue = pachRecord + psDBF->panFieldOffset[iField];
+    const char *pachNUL = STATIC_CAST(
+        const char *, memchr(pachValue, '\0', psDBF->panFieldSize[iField]));
+    int nLength = pachNUL ? STATIC_CAST(int, pachNUL - pachValue)
+                          : psDBF->panFieldSize[iField];
+    const int nLeading = DBFSpanChar(pachValue, nLength, ' ');
+
+    pachValue += nLeading;
+    nLength -= nLeading;
+    nLength -= DBFSpanCharReverse(pachValue, nLength, ' ');
+    if (DBFIsFieldValueNULL(psDBF->pachFieldType[iField], pachValue, nLength,
+                            psDBF->panFieldSize[iField]))
+        return SHPLIB_NULLPTR;
+
+    *pnLength = nLength;
+    return pachValue;
+}
+
+/************************************************************************/
+/*                        DBFReadDoubleColumn()                         */
+/*                                                                      */
+/*      Parse field iField of nCount records from iFirstRecord on into  */
+/*      padfValues.  pabyNoValue[i] is set to 1, and padfValues[i] to   */
+/*      0, where the field is NULL or not a number.  Return FALSE if    */
+/*      the range is out of bounds or a record cannot be read.  The     */
+/*      records are read a run at a time, see DBFReadTupleRun().        */
+/************************************************************************/
+
+int SHPAPI_CALL DBFReadDoubleColumn(DBFHandle psDBF, int iField,
+                                    int iFirstRecord, int nCount,
+                                    double *padfValues,
+                                    unsigned char *pabyNoValue)
+{
+    if (iField < 0 || iField >= psDBF->nFields || iFirstRecord < 0 ||
+        nCount < 0 || nCount > psDBF->nRecords - iFirstRecord)
+        return FALSE;
+
+    for (int i = 0; i < nCount;)
+    {
+        int nRun;
+        const char *pachRecord =
+            DBFReadTupleRun(psDBF, iFirstRecord + i, nCount - i, &nRun);
+        if (pachRecord == SHPLIB_NULLPTR)
+            return FALSE;
+
+        for (; nRun > 0; nRun--, i++, pachRecord += psDBF->nRecordLength)
+        {
+            int nLength;
+            const char *pachValue =
+                DBFColumnText(psDBF, pachRecord, iField, &nLength);
+            pabyNoValue[i] =
+                pachValue == SHPLIB_NULLPTR ||
+                !DBFParseDouble(pachValue, nLength, padfValues + i);
+            if (pabyNoValue[i])
+                padfValues[i] = 0;
+        }
+    }
+    return TRUE;
+}
+
+/************************************************************************/
+/*                       DBFReadInteger64Column()                       */
+/*                                                                      */
+/*      As DBFReadDoubleColumn(), with DBFParseInteger(), so fields     */
+/*      with decimals or exponents have no value.                       */
+/************************************************************************/
+
+int SHPAPI_CALL DBFReadInteger64Column(DBFHandle psDBF, int iField,
+                                       int iFirstRecord, int nCount,
+                                       int64_t *panValues,
+                                       unsigned char *pabyNoValue)
+{
+    if (iField < 0 || iField >= psDBF->nFields || iFirstRecord < 0 ||
+        nCount < 0 || nCount > psDBF->nRecords - iFirstRecord)
+        return FALSE;
+
+    for (int i = 0; i < nCount;)
+    {
+        int nRun;
+        const char *pachRecord =
+            DBFReadTupleRun(psDBF, iFirstRecord + i, nCount - i, &nRun);
+        if (pachRecord == SHPLIB_NULLPTR)
+            return FALSE;
+
+        for (; nRun > 0; nRun--, i++, pachRecord += psDBF->nRecordLength)
+        {
+            int nLength;
+            const char *pachValue =
+                DBFColumnText(psDBF, pachRecord, iField, &nLength);
+            pabyNoValue[i] =
+                pachValue == SHPLIB_NULLPTR ||
+                !DBFParseInteger(pachValue, nLength, panValues + i);
+            if (pabyNoValue[i])
+                panValues[i] = 0;
+        }
+    }
+    return TRUE;
+}
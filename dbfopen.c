@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include <string.h>
 
 #ifdef USE_CPL
@@ -68,6 +69,37 @@ CPL_INLINE static void CPL_IGNORE_RET_VAL_INT(CPL_UNUSED int unused)
 #define CPL_IGNORE_RET_VAL_INT(x) x
 #endif
 
+/************************************************************************/
+/*                     DBFSeek(), DBFRead(), DBFWrite()                 */
+/*                                                                      */
+/*      The io hooks on the file of the handle, counted in its stats.   */
+/************************************************************************/
+
+static int DBFSeek(DBFHandle psDBF, SAOffset nOffset, int nWhence)
+{
+    psDBF->sStats.nSeeks++;
+    return psDBF->sHooks.FSeek(psDBF->fp, nOffset, nWhence);
+}
+
+static SAOffset DBFRead(DBFHandle psDBF, void *p, SAOffset nSize,
+                        SAOffset nCount)
+{
+    const SAOffset nRead = psDBF->sHooks.FRead(p, nSize, nCount, psDBF->fp);
+    psDBF->sStats.nReads++;
+    psDBF->sStats.nBytesRead += nRead * nSize;
+    return nRead;
+}
+
+static SAOffset DBFWrite(DBFHandle psDBF, const void *p, SAOffset nSize,
+                         SAOffset nCount)
+{
+    const SAOffset nWritten =
+        psDBF->sHooks.FWrite(p, nSize, nCount, psDBF->fp);
+    psDBF->sStats.nWrites++;
+    psDBF->sStats.nBytesWritten += nWritten * nSize;
+    return nWritten;
+}
+
 /************************************************************************/
 /*                           DBFWriteHeader()                           */
 /*                                                                      */
@@ -110,10 +142,9 @@ static void DBFWriteHeader(DBFHandle psDBF)
     /*      Write the initial 32 byte file header, and all the field        */
     /*      descriptions.                                                   */
     /* -------------------------------------------------------------------- */
-    psDBF->sHooks.FSeek(psDBF->fp, 0, 0);
-    psDBF->sHooks.FWrite(abyHeader, XBASE_FILEHDR_SZ, 1, psDBF->fp);
-    psDBF->sHooks.FWrite(psDBF->pszHeader, XBASE_FLDHDR_SZ, psDBF->nFields,
-                         psDBF->fp);
+    DBFSeek(psDBF, 0, 0);
+    DBFWrite(psDBF, abyHeader, XBASE_FILEHDR_SZ, 1);
+    DBFWrite(psDBF, psDBF->pszHeader, XBASE_FLDHDR_SZ, psDBF->nFields);
 
     /* -------------------------------------------------------------------- */
     /*      Write out the newline character if there is room for it.        */
@@ -122,7 +153,7 @@ static void DBFWriteHeader(DBFHandle psDBF)
         XBASE_FLDHDR_SZ * psDBF->nFields + XBASE_FLDHDR_SZ)
     {
         char cNewline = HEADER_RECORD_TERMINATOR;
-        psDBF->sHooks.FWrite(&cNewline, 1, 1, psDBF->fp);
+        DBFWrite(psDBF, &cNewline, 1, 1);
     }
 
     /* -------------------------------------------------------------------- */
@@ -132,8 +163,622 @@ static void DBFWriteHeader(DBFHandle psDBF)
     {
         char ch = END_OF_FILE_CHARACTER;
 
-        psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+        DBFWrite(psDBF, &ch, 1, 1);
+    }
+}
+
+/************************************************************************/
+/*                         Record block cache.                          */
+/*                                                                      */
+/*      When enabled with DBFSetCacheSize(), records are read and       */
+/*      written in blocks of consecutive records held in memory.        */
+/*      Blocks are looked up through a small chained hash, evicted      */
+/*      least recently used first, and dirty records are written        */
+/*      back when their block is evicted or the cache is flushed.       */
+/************************************************************************/
+
+/* Size in bytes aimed at for one block of records */
+#define DBF_CACHE_BLOCK_SIZE 65536
+
+typedef struct
+{
+    int iBlock;      /* block number, -1 if the slot is unused */
+    int nRecords;    /* leading records of the block holding data */
+    int iFirstDirty; /* range of records to write back, -1 if clean */
+    int iLastDirty;
+    int iHashNext;
+    int iPrev; /* LRU list, most recently used first */
+    int iNext;
+    char *pachData;
+} DBFCacheBlock;
+
+struct DBFCacheInfo
+{
+    SAOffset nSize;    /* bytes requested */
+    int nRecordLength; /* record length the blocks are laid out for */
+    int nRecordsPerBlock;
+    int nSlots;
+    int nUsed;
+    int iMostRecent;
+    int iLeastRecent;
+    int nHashSize;
+    int *panHash;
+    DBFCacheBlock *pasBlocks;
+};
+
+static DBFCacheInfo *DBFCacheCreate(SAOffset nSize, int nRecordLength)
+{
+    DBFCacheInfo *psCache =
+        STATIC_CAST(DBFCacheInfo *, calloc(1, sizeof(DBFCacheInfo)));
+    if (psCache == SHPLIB_NULLPTR)
+        return SHPLIB_NULLPTR;
+
+    psCache->nSize = nSize;
+    psCache->nRecordLength = nRecordLength;
+    psCache->nRecordsPerBlock = DBF_CACHE_BLOCK_SIZE / nRecordLength;
+    if (psCache->nRecordsPerBlock < 1)
+        psCache->nRecordsPerBlock = 1;
+
+    const SAOffset nBlockSize =
+        STATIC_CAST(SAOffset, psCache->nRecordsPerBlock) * nRecordLength;
+    psCache->nSlots = nSize / nBlockSize > 65536
+                          ? 65536
+                          : STATIC_CAST(int, nSize / nBlockSize);
+    if (psCache->nSlots < 1)
+        psCache->nSlots = 1;
+
+    psCache->nHashSize = 1;
+    while (psCache->nHashSize < 2 * psCache->nSlots)
+        psCache->nHashSize *= 2;
+
+    psCache->panHash =
+        STATIC_CAST(int *, malloc(sizeof(int) * psCache->nHashSize));
+    psCache->pasBlocks = STATIC_CAST(
+        DBFCacheBlock *, calloc(psCache->nSlots, sizeof(DBFCacheBlock)));
+    if (psCache->panHash == SHPLIB_NULLPTR ||
+        psCache->pasBlocks == SHPLIB_NULLPTR)
+    {
+        free(psCache->panHash);
+        free(psCache->pasBlocks);
+        free(psCache);
+        return SHPLIB_NULLPTR;
+    }
+
+    for (int i = 0; i < psCache->nHashSize; i++)
+        psCache->panHash[i] = -1;
+    psCache->iMostRecent = -1;
+    psCache->iLeastRecent = -1;
+
+    return psCache;
+}
+
+static void DBFCacheDestroy(DBFCacheInfo *psCache)
+{
+    if (psCache == SHPLIB_NULLPTR)
+        return;
+
+    for (int i = 0; i < psCache->nUsed; i++)
+        free(psCache->pasBlocks[i].pachData);
+    free(psCache->pasBlocks);
+    free(psCache->panHash);
+    free(psCache);
+}
+
+/* Move a slot to the head of the LRU list */
+static void DBFCacheTouch(DBFCacheInfo *psCache, int iSlot)
+{
+    DBFCacheBlock *psBlock = psCache->pasBlocks + iSlot;
+
+    if (psCache->iMostRecent == iSlot)
+        return;
+
+    if (psBlock->iPrev >= 0)
+        psCache->pasBlocks[psBlock->iPrev].iNext = psBlock->iNext;
+    if (psBlock->iNext >= 0)
+        psCache->pasBlocks[psBlock->iNext].iPrev = psBlock->iPrev;
+    if (psCache->iLeastRecent == iSlot)
+        psCache->iLeastRecent = psBlock->iPrev;
+
+    psBlock->iPrev = -1;
+    psBlock->iNext = psCache->iMostRecent;
+    if (psCache->iMostRecent >= 0)
+        psCache->pasBlocks[psCache->iMostRecent].iPrev = iSlot;
+    psCache->iMostRecent = iSlot;
+    if (psCache->iLeastRecent < 0)
+        psCache->iLeastRecent = iSlot;
+}
+
+static bool DBFCacheWriteBack(DBFHandle psDBF, DBFCacheBlock *psBlock)
+{
+    DBFCacheInfo *psCache = psDBF->psCache;
+
+    if (psBlock->iFirstDirty < 0)
+        return true;
+
+    const int iFirstRecord =
+        psBlock->iBlock * psCache->nRecordsPerBlock + psBlock->iFirstDirty;
+    const int nCount = psBlock->iLastDirty - psBlock->iFirstDirty + 1;
+    const SAOffset nRecordOffset =
+        psDBF->nRecordLength * STATIC_CAST(SAOffset, iFirstRecord) +
+        psDBF->nHeaderLength;
+    const char *pachFirst =
+        psBlock->pachData +
+        STATIC_CAST(SAOffset, psBlock->iFirstDirty) * psCache->nRecordLength;
+
+    psDBF->bRequireNextWriteSeek = TRUE;
+    psDBF->sStats.nFlushes++;
+
+    /* On failure the records stay dirty, to be written again later */
+    if (DBFSeek(psDBF, nRecordOffset, 0) != 0 ||
+        DBFWrite(psDBF, pachFirst, psDBF->nRecordLength, nCount) !=
+            STATIC_CAST(SAOffset, nCount))
+    {
+        char szMessage[128];
+        snprintf(szMessage, sizeof(szMessage),
+                 "Failure writing DBF records %d to %d.", iFirstRecord,
+                 iFirstRecord + nCount - 1);
+        psDBF->sHooks.Error(szMessage);
+        return false;
+    }
+    psBlock->iFirstDirty = -1;
+
+    if (iFirstRecord + nCount == psDBF->nRecords && psDBF->bWriteEndOfFileChar)
+    {
+        char ch = END_OF_FILE_CHARACTER;
+        DBFWrite(psDBF, &ch, 1, 1);
+    }
+
+    return true;
+}
+
+/* Write back all dirty blocks, in file order */
+static bool DBFCacheFlush(DBFHandle psDBF)
+{
+    DBFCacheInfo *psCache = psDBF->psCache;
+    bool bOK = true;
+    int iAfter = -1;
+
+    if (psCache == SHPLIB_NULLPTR)
+        return true;
+
+    /* Blocks that fail stay dirty, so each is tried once per flush */
+    for (;;)
+    {
+        DBFCacheBlock *psNext = SHPLIB_NULLPTR;
+        for (int i = 0; i < psCache->nUsed; i++)
+        {
+            DBFCacheBlock *psBlock = psCache->pasBlocks + i;
+            if (psBlock->iFirstDirty >= 0 && psBlock->iBlock > iAfter &&
+                (psNext == SHPLIB_NULLPTR || psBlock->iBlock < psNext->iBlock))
+                psNext = psBlock;
+        }
+        if (psNext == SHPLIB_NULLPTR)
+            break;
+        iAfter = psNext->iBlock;
+        if (!DBFCacheWriteBack(psDBF, psNext))
+            bOK = false;
+    }
+
+    return bOK;
+}
+
+/* Write back and forget all blocks, e.g. before the layout changes */
+static bool DBFCacheDiscard(DBFHandle psDBF)
+{
+    DBFCacheInfo *psCache = psDBF->psCache;
+
+    if (psCache == SHPLIB_NULLPTR)
+        return true;
+
+    const bool bOK = DBFCacheFlush(psDBF);
+
+    /* Records that could not be written stay cached, unless the layout
+       they were cached in is gone already */
+    if (!bOK && psCache->nRecordLength == psDBF->nRecordLength)
+        return false;
+
+    psDBF->psCache = DBFCacheCreate(psCache->nSize, psDBF->nRecordLength);
+    DBFCacheDestroy(psCache);
+
+    return bOK;
+}
+
+/* Write back and shorten blocks holding records from iFirst on, which
+   are about to be overwritten without going through the cache */
+static void DBFCacheInvalidate(DBFHandle psDBF, int iFirst, int nCount)
+{
+    DBFCacheInfo *psCache = psDBF->psCache;
+
+    if (psCache == SHPLIB_NULLPTR)
+        return;
+
+    for (int i = 0; i < psCache->nUsed; i++)
+    {
+        DBFCacheBlock *psBlock = psCache->pasBlocks + i;
+        const int iBlockFirst = psBlock->iBlock * psCache->nRecordsPerBlock;
+
+        if (iBlockFirst + psBlock->nRecords <= iFirst ||
+            iBlockFirst >= iFirst + nCount)
+            continue;
+
+        CPL_IGNORE_RET_VAL_INT(DBFCacheWriteBack(psDBF, psBlock));
+        psBlock->nRecords = iFirst > iBlockFirst ? iFirst - iBlockFirst : 0;
+
+        /* Left dirty by a failed write, records past the new end would
+           later overwrite the ones written directly */
+        if (psBlock->iFirstDirty >= psBlock->nRecords)
+            psBlock->iFirstDirty = -1;
+        else if (psBlock->iLastDirty >= psBlock->nRecords)
+            psBlock->iLastDirty = psBlock->nRecords - 1;
+    }
+}
+
+/************************************************************************/
+/*                         DBFCacheGetRecord()                          */
+/*                                                                      */
+/*      Return the cached copy of a record, loading its block if        */
+/*      needed.  For writing, the record may also be the one just       */
+/*      past the end of the block data, and is marked dirty.  Returns   */
+/*      NULL if the record cannot be served from the cache.             */
+/************************************************************************/
+
+static char *DBFCacheGetRecord(DBFHandle psDBF, int iRecord, bool bForWrite)
+{
+    DBFCacheInfo *psCache = psDBF->psCache;
+
+    if (psCache->nRecordLength != psDBF->nRecordLength && !DBFCacheDiscard(psDBF))
+        return SHPLIB_NULLPTR;
+    psCache = psDBF->psCache;
+    if (psCache == SHPLIB_NULLPTR)
+        return SHPLIB_NULLPTR;
+
+    const int iBlock = iRecord / psCache->nRecordsPerBlock;
+    const int iIndex = iRecord - iBlock * psCache->nRecordsPerBlock;
+    int *piHash = psCache->panHash + (iBlock & (psCache->nHashSize - 1));
+
+    int iSlot = *piHash;
+    while (iSlot >= 0 && psCache->pasBlocks[iSlot].iBlock != iBlock)
+        iSlot = psCache->pasBlocks[iSlot].iHashNext;
+
+    DBFCacheBlock *psBlock;
+    const bool bLoaded = iSlot < 0;
+    if (iSlot < 0)
+    {
+        /* ---------------------------------------------------------------- */
+        /*      Miss: take a free slot or evict the least recent block.     */
+        /* ---------------------------------------------------------------- */
+        if (psCache->nUsed < psCache->nSlots)
+        {
+            iSlot = psCache->nUsed;
+            psBlock = psCache->pasBlocks + iSlot;
+            psBlock->pachData = STATIC_CAST(
+                char *, malloc(STATIC_CAST(size_t, psCache->nRecordsPerBlock) *
+                               psCache->nRecordLength));
+            if (psBlock->pachData == SHPLIB_NULLPTR)
+                return SHPLIB_NULLPTR;
+            psBlock->iPrev = -1;
+            psBlock->iNext = -1;
+            psCache->nUsed++;
+        }
+        else
+        {
+            iSlot = psCache->iLeastRecent;
+            psBlock = psCache->pasBlocks + iSlot;
+            if (!DBFCacheWriteBack(psDBF, psBlock))
+                return SHPLIB_NULLPTR;
+
+            int *piOld = psCache->panHash +
+                         (psBlock->iBlock & (psCache->nHashSize - 1));
+            while (*piOld != iSlot)
+                piOld = &psCache->pasBlocks[*piOld].iHashNext;
+            *piOld = psBlock->iHashNext;
+        }
+
+        psBlock->iBlock = iBlock;
+        psBlock->nRecords = 0;
+        psBlock->iFirstDirty = -1;
+        psBlock->iHashNext = *piHash;
+        *piHash = iSlot;
+
+        /* ---------------------------------------------------------------- */
+        /*      Load as many records of the block as the file holds.        */
+        /* ---------------------------------------------------------------- */
+        const int iFirstRecord = iBlock * psCache->nRecordsPerBlock;
+        int nCount = psDBF->nRecords - iFirstRecord;
+        if (nCount > psCache->nRecordsPerBlock)
+            nCount = psCache->nRecordsPerBlock;
+        if (nCount > 0)
+        {
+            const SAOffset nRecordOffset =
+                psDBF->nRecordLength * STATIC_CAST(SAOffset, iFirstRecord) +
+                psDBF->nHeaderLength;
+            psDBF->bRequireNextWriteSeek = TRUE;
+            if (DBFSeek(psDBF, nRecordOffset, SEEK_SET) == 0)
+                psBlock->nRecords = STATIC_CAST(
+                    int, DBFRead(psDBF, psBlock->pachData,
+                                 psDBF->nRecordLength, nCount));
+        }
+    }
+    psBlock = psCache->pasBlocks + iSlot;
+    DBFCacheTouch(psCache, iSlot);
+
+    if (iIndex > psBlock->nRecords || (iIndex == psBlock->nRecords && !bForWrite))
+        return SHPLIB_NULLPTR;
+
+    if (!bForWrite && bLoaded)
+        psDBF->sStats.nRecordsLoaded++;
+    else if (!bForWrite)
+        psDBF->sStats.nRecordsBuffered++;
+
+    if (bForWrite)
+    {
+        if (iIndex == psBlock->nRecords)
+            psBlock->nRecords++;
+        if (psBlock->iFirstDirty < 0)
+        {
+            psBlock->iFirstDirty = iIndex;
+            psBlock->iLastDirty = iIndex;
+        }
+        else if (iIndex < psBlock->iFirstDirty)
+            psBlock->iFirstDirty = iIndex;
+        else if (iIndex > psBlock->iLastDirty)
+            psBlock->iLastDirty = iIndex;
+    }
+
+    return psBlock->pachData +
+           STATIC_CAST(SAOffset, iIndex) * psCache->nRecordLength;
+}
+
+/************************************************************************/
+/*                          DBFSetCacheSize()                           */
+/*                                                                      */
+/*      Enable a record block cache of about nBytes, or disable it      */
+/*      if nBytes is zero.  Not available for mapped files, which       */
+/*      need no cache.                                                  */
+/************************************************************************/
+
+int SHPAPI_CALL DBFSetCacheSize(DBFHandle psDBF, SAOffset nBytes)
+{
+    bool bOK = DBFCacheFlush(psDBF);
+
+    DBFCacheDestroy(psDBF->psCache);
+    psDBF->psCache = SHPLIB_NULLPTR;
+
+    if (nBytes == 0)
+        return bOK;
+
+    if (psDBF->pachMapped != SHPLIB_NULLPTR)
+        return FALSE;
+
+    psDBF->psCache = DBFCacheCreate(nBytes, psDBF->nRecordLength);
+
+    return bOK && psDBF->psCache != SHPLIB_NULLPTR;
+}
+
+/************************************************************************/
+/*                            Append buffer.                            */
+/*                                                                      */
+/*      When enabled with DBFSetAppendBufferSize(), records appended    */
+/*      one after the other at the end of the file are collected in     */
+/*      a large buffer and written in one piece when it is full.  The   */
+/*      end of file marker is only written by DBFUpdateHeader().        */
+/************************************************************************/
+
+struct DBFAppendInfo
+{
+    SAOffset nSize;    /* bytes requested */
+    int nRecordLength; /* record length the buffer is laid out for */
+    int nCapacity;     /* records the buffer holds */
+    int iFirst;        /* first record in the buffer */
+    int nRecords;      /* records in the buffer */
+    bool bNeedsEOF;    /* records were written up to the end, without EOF */
+    char *pachData;
+};
+
+static bool DBFAppendHasRecord(DBFHandle psDBF, int iRecord)
+{
+    const DBFAppendInfo *psAppend = psDBF->psAppend;
+
+    return psAppend != SHPLIB_NULLPTR && psAppend->nRecords > 0 &&
+           iRecord >= psAppend->iFirst &&
+           iRecord < psAppend->iFirst + psAppend->nRecords;
+}
+
+/************************************************************************/
+/*                          DBFAppendFlush()                            */
+/*                                                                      */
+/*      Write out the buffered records.  If bFinal, also write the      */
+/*      end of file marker they may have left out.                      */
+/************************************************************************/
+
+static bool DBFAppendFlush(DBFHandle psDBF, bool bFinal)
+{
+    DBFAppendInfo *psAppend = psDBF->psAppend;
+
+    if (psAppend == SHPLIB_NULLPTR)
+        return true;
+
+    if (psAppend->nRecords > 0)
+    {
+        const int nCount = psAppend->nRecords;
+        const SAOffset nRecordOffset =
+            psAppend->nRecordLength * STATIC_CAST(SAOffset, psAppend->iFirst) +
+            psDBF->nHeaderLength;
+
+        /* The cache must not keep older copies of these records */
+        DBFCacheInvalidate(psDBF, psAppend->iFirst, nCount);
+
+        psAppend->nRecords = 0;
+        psDBF->bRequireNextWriteSeek = TRUE;
+        psDBF->sStats.nFlushes++;
+
+        if (DBFSeek(psDBF, nRecordOffset, 0) != 0 ||
+            DBFWrite(psDBF, psAppend->pachData, psAppend->nRecordLength,
+                     nCount) != STATIC_CAST(SAOffset, nCount))
+        {
+            char szMessage[128];
+            snprintf(szMessage, sizeof(szMessage),
+                     "Failure writing DBF records %d to %d.", psAppend->iFirst,
+                     psAppend->iFirst + nCount - 1);
+            psDBF->sHooks.Error(szMessage);
+            return false;
+        }
+
+        if (psAppend->iFirst + nCount == psDBF->nRecords)
+            psAppend->bNeedsEOF = true;
+    }
+
+    if (bFinal && psAppend->bNeedsEOF)
+    {
+        psAppend->bNeedsEOF = false;
+        if (psDBF->bWriteEndOfFileChar)
+        {
+            const SAOffset nEOFOffset =
+                psDBF->nRecordLength * STATIC_CAST(SAOffset, psDBF->nRecords) +
+                psDBF->nHeaderLength;
+            char ch = END_OF_FILE_CHARACTER;
+
+            psDBF->bRequireNextWriteSeek = TRUE;
+            if (DBFSeek(psDBF, nEOFOffset, 0) != 0 ||
+                DBFWrite(psDBF, &ch, 1, 1) != 1)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/************************************************************************/
+/*                          DBFAppendRecord()                           */
+/*                                                                      */
+/*      Take the current record into the append buffer if it is in      */
+/*      it already, or if it is the last record and follows the ones    */
+/*      buffered.  Returns false if the record must be written          */
+/*      otherwise.                                                      */
+/************************************************************************/
+
+static bool DBFAppendRecord(DBFHandle psDBF)
+{
+    DBFAppendInfo *psAppend = psDBF->psAppend;
+    const int iRecord = psDBF->nCurrentRecord;
+
+    if (DBFAppendHasRecord(psDBF, iRecord))
+    {
+        memcpy(psAppend->pachData +
+                   STATIC_CAST(SAOffset, iRecord - psAppend->iFirst) *
+                       psAppend->nRecordLength,
+               psDBF->pszCurrentRecord, psDBF->nRecordLength);
+        return true;
     }
+
+    if (iRecord != psDBF->nRecords - 1)
+        return false;
+
+    if (psAppend->nRecords > 0 &&
+        (iRecord != psAppend->iFirst + psAppend->nRecords ||
+         psAppend->nRecords == psAppend->nCapacity) &&
+        !DBFAppendFlush(psDBF, false))
+        return false;
+
+    if (psAppend->nRecordLength != psDBF->nRecordLength)
+    {
+        /* Fields changed since the buffer was laid out; it is empty */
+        int nCapacity = STATIC_CAST(int, psAppend->nSize / psDBF->nRecordLength);
+        if (nCapacity < 1)
+            nCapacity = 1;
+        char *pachData = STATIC_CAST(
+            char *, realloc(psAppend->pachData,
+                            STATIC_CAST(size_t, nCapacity) * psDBF->nRecordLength));
+        if (pachData == SHPLIB_NULLPTR)
+            return false;
+        psAppend->pachData = pachData;
+        psAppend->nCapacity = nCapacity;
+        psAppend->nRecordLength = psDBF->nRecordLength;
+    }
+
+    if (psAppend->nRecords == 0)
+        psAppend->iFirst = iRecord;
+    memcpy(psAppend->pachData +
+               STATIC_CAST(SAOffset, psAppend->nRecords) *
+                   psAppend->nRecordLength,
+           psDBF->pszCurrentRecord, psDBF->nRecordLength);
+    psAppend->nRecords++;
+
+    return true;
+}
+
+/************************************************************************/
+/*                          DBFHashFieldName()                          */
+/*                                                                      */
+/*      Case insensitive (ASCII) FNV-1a hash of a field name.           */
+/************************************************************************/
+
+static unsigned int DBFHashFieldName(const char *pszFieldName)
+{
+    unsigned int nHash = 2166136261U;
+
+    for (; *pszFieldName != '\0'; pszFieldName++)
+    {
+        unsigned char ch = STATIC_CAST(unsigned char, *pszFieldName);
+        if (ch >= 'a' && ch <= 'z')
+            ch = STATIC_CAST(unsigned char, ch - 'a' + 'A');
+        nHash = (nHash ^ ch) * 16777619U;
+    }
+
+    return nHash;
+}
+
+/************************************************************************/
+/*                         DBFBuildFieldIndex()                         */
+/*                                                                      */
+/*      Build the open addressing table of field names used by          */
+/*      DBFGetFieldIndex().  When names repeat, only the first field    */
+/*      is entered so lookups keep returning the first match.           */
+/************************************************************************/
+
+static bool DBFBuildFieldIndex(DBFHandle psDBF)
+{
+    char name[XBASE_FLDNAME_LEN_READ + 1];
+
+    int nSize = 8;
+    while (nSize < 2 * psDBF->nFields)
+        nSize *= 2;
+
+    int *panHash = STATIC_CAST(int *, malloc(sizeof(int) * nSize));
+    if (panHash == SHPLIB_NULLPTR)
+        return false;
+    for (int i = 0; i < nSize; i++)
+        panHash[i] = -1;
+
+    psDBF->panFieldHash = panHash;
+    psDBF->nFieldHashSize = nSize;
+
+    for (int iField = 0; iField < psDBF->nFields; iField++)
+    {
+        DBFGetFieldInfo(psDBF, iField, name, SHPLIB_NULLPTR, SHPLIB_NULLPTR);
+        if (DBFGetFieldIndex(psDBF, name) >= 0)
+            continue;
+
+        unsigned int nHash = DBFHashFieldName(name);
+        while (panHash[nHash & (nSize - 1)] >= 0)
+            nHash++;
+        panHash[nHash & (nSize - 1)] = iField;
+    }
+
+    return true;
+}
+
+/************************************************************************/
+/*                      DBFInvalidateFieldIndex()                       */
+/*                                                                      */
+/*      Forget the field name table after the fields changed.           */
+/************************************************************************/
+
+static void DBFInvalidateFieldIndex(DBFHandle psDBF)
+{
+    free(psDBF->panFieldHash);
+    psDBF->panFieldHash = SHPLIB_NULLPTR;
+    psDBF->nFieldHashSize = 0;
 }
 
 /************************************************************************/
@@ -148,11 +793,32 @@ static bool DBFFlushRecord(DBFHandle psDBF)
     {
         psDBF->bCurrentRecordModified = FALSE;
 
+        /* -------------------------------------------------------------------- */
+        /*      Appended records are written later with the buffer, others     */
+        /*      with a block cache when their block is written back.           */
+        /* -------------------------------------------------------------------- */
+        if (psDBF->psAppend != SHPLIB_NULLPTR && DBFAppendRecord(psDBF))
+            return true;
+
+        if (psDBF->psCache != SHPLIB_NULLPTR)
+        {
+            char *pachCached =
+                DBFCacheGetRecord(psDBF, psDBF->nCurrentRecord, true);
+            if (pachCached != SHPLIB_NULLPTR)
+            {
+                memcpy(pachCached, psDBF->pszCurrentRecord,
+                       psDBF->nRecordLength);
+                return true;
+            }
+        }
+
         const SAOffset nRecordOffset =
             psDBF->nRecordLength *
                 STATIC_CAST(SAOffset, psDBF->nCurrentRecord) +
             psDBF->nHeaderLength;
 
+        psDBF->sStats.nFlushes++;
+
         /* -------------------------------------------------------------------- */
         /*      Guard FSeek with check for whether we're already at position;   */
         /*      no-op FSeeks defeat network filesystems' write buffering.       */
@@ -160,7 +826,7 @@ static bool DBFFlushRecord(DBFHandle psDBF)
         if (psDBF->bRequireNextWriteSeek ||
             psDBF->sHooks.FTell(psDBF->fp) != nRecordOffset)
         {
-            if (psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0) != 0)
+            if (DBFSeek(psDBF, nRecordOffset, 0) != 0)
             {
                 char szMessage[128];
                 snprintf(
@@ -172,8 +838,8 @@ static bool DBFFlushRecord(DBFHandle psDBF)
             }
         }
 
-        if (psDBF->sHooks.FWrite(psDBF->pszCurrentRecord, psDBF->nRecordLength,
-                                 1, psDBF->fp) != 1)
+        if (DBFWrite(psDBF, psDBF->pszCurrentRecord, psDBF->nRecordLength,
+                     1) != 1)
         {
             char szMessage[128];
             snprintf(szMessage, sizeof(szMessage),
@@ -192,7 +858,7 @@ static bool DBFFlushRecord(DBFHandle psDBF)
             if (psDBF->bWriteEndOfFileChar)
             {
                 char ch = END_OF_FILE_CHARACTER;
-                psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+                DBFWrite(psDBF, &ch, 1, 1);
             }
         }
     }
@@ -211,11 +877,37 @@ static bool DBFLoadRecord(DBFHandle psDBF, int iRecord)
         if (!DBFFlushRecord(psDBF))
             return false;
 
+        if (DBFAppendHasRecord(psDBF, iRecord))
+        {
+            const DBFAppendInfo *psAppend = psDBF->psAppend;
+            memcpy(psDBF->pszCurrentRecord,
+                   psAppend->pachData +
+                       STATIC_CAST(SAOffset, iRecord - psAppend->iFirst) *
+                           psAppend->nRecordLength,
+                   psDBF->nRecordLength);
+            psDBF->nCurrentRecord = iRecord;
+            psDBF->sStats.nRecordsBuffered++;
+            return true;
+        }
+
+        if (psDBF->psCache != SHPLIB_NULLPTR)
+        {
+            const char *pachCached = DBFCacheGetRecord(psDBF, iRecord, false);
+            if (pachCached != SHPLIB_NULLPTR)
+            {
+                memcpy(psDBF->pszCurrentRecord, pachCached,
+                       psDBF->nRecordLength);
+                psDBF->nCurrentRecord = iRecord;
+                psDBF->bRequireNextWriteSeek = TRUE;
+                return true;
+            }
+        }
+
         const SAOffset nRecordOffset =
             psDBF->nRecordLength * STATIC_CAST(SAOffset, iRecord) +
             psDBF->nHeaderLength;
 
-        if (psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, SEEK_SET) != 0)
+        if (DBFSeek(psDBF, nRecordOffset, SEEK_SET) != 0)
         {
             char szMessage[128];
             snprintf(szMessage, sizeof(szMessage),
@@ -225,8 +917,8 @@ static bool DBFLoadRecord(DBFHandle psDBF, int iRecord)
             return false;
         }
 
-        if (psDBF->sHooks.FRead(psDBF->pszCurrentRecord, psDBF->nRecordLength,
-                                1, psDBF->fp) != 1)
+        if (DBFRead(psDBF, psDBF->pszCurrentRecord, psDBF->nRecordLength,
+                    1) != 1)
         {
             char szMessage[128];
             snprintf(szMessage, sizeof(szMessage),
@@ -236,15 +928,93 @@ static bool DBFLoadRecord(DBFHandle psDBF, int iRecord)
         }
 
         psDBF->nCurrentRecord = iRecord;
+        psDBF->sStats.nRecordsLoaded++;
         /* -------------------------------------------------------------------- */
         /*      Require a seek for next write in case of mixed R/W operations.  */
         /* -------------------------------------------------------------------- */
         psDBF->bRequireNextWriteSeek = TRUE;
     }
+    else
+        psDBF->sStats.nRecordsBuffered++;
 
     return true;
 }
 
+/************************************************************************/
+/*                           DBFReadRecord()                            */
+/*                                                                      */
+/*      Return a read-only pointer to a record.  Records of a file      */
+/*      mapped by the io hooks, or held by the block cache, are served  */
+/*      in place, without seeking or copying, unless it is the current  */
+/*      (maybe modified) record.                                        */
+/************************************************************************/
+
+static const char *DBFReadRecord(DBFHandle psDBF, int iRecord)
+{
+    if (psDBF->pachMapped != SHPLIB_NULLPTR &&
+        psDBF->nCurrentRecord != iRecord)
+    {
+        const SAOffset nRecordOffset =
+            psDBF->nRecordLength * STATIC_CAST(SAOffset, iRecord) +
+            psDBF->nHeaderLength;
+
+        if (nRecordOffset + psDBF->nRecordLength <= psDBF->nMappedSize)
+        {
+            psDBF->sStats.nRecordsBuffered++;
+            return psDBF->pachMapped + nRecordOffset;
+        }
+    }
+
+    if (psDBF->psCache != SHPLIB_NULLPTR && psDBF->nCurrentRecord != iRecord &&
+        !DBFAppendHasRecord(psDBF, iRecord))
+    {
+        const char *pachCached = DBFCacheGetRecord(psDBF, iRecord, false);
+        if (pachCached != SHPLIB_NULLPTR)
+            return pachCached;
+    }
+
+    if (!DBFLoadRecord(psDBF, iRecord))
+        return SHPLIB_NULLPTR;
+
+    return psDBF->pszCurrentRecord;
+}
+
+/************************************************************************/
+/*                       DBFSetAppendBufferSize()                       */
+/*                                                                      */
+/*      Buffer up to nBytes of records appended at the end of the       */
+/*      file, or stop buffering if nBytes is zero.                      */
+/************************************************************************/
+
+int SHPAPI_CALL DBFSetAppendBufferSize(DBFHandle psDBF, SAOffset nBytes)
+{
+    DBFAppendInfo *psAppend = psDBF->psAppend;
+
+    const bool bOK = DBFFlushRecord(psDBF) && DBFAppendFlush(psDBF, true);
+
+    if (psAppend != SHPLIB_NULLPTR)
+    {
+        free(psAppend->pachData);
+        free(psAppend);
+        psDBF->psAppend = SHPLIB_NULLPTR;
+    }
+
+    if (nBytes == 0)
+        return bOK;
+
+    if (psDBF->pachMapped != SHPLIB_NULLPTR)
+        return FALSE;
+
+    psAppend =
+        STATIC_CAST(DBFAppendInfo *, calloc(1, sizeof(DBFAppendInfo)));
+    if (psAppend == SHPLIB_NULLPTR)
+        return FALSE;
+    psAppend->nSize = nBytes;
+    psDBF->psAppend = psAppend;
+
+    return bOK;
+}
+
 /************************************************************************/
 /*                          DBFUpdateHeader()                           */
 /************************************************************************/
@@ -254,13 +1024,14 @@ void SHPAPI_CALL DBFUpdateHeader(DBFHandle psDBF)
     if (psDBF->bNoHeader)
         DBFWriteHeader(psDBF);
 
-    if (!DBFFlushRecord(psDBF))
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, true) ||
+        !DBFCacheFlush(psDBF))
         return;
 
-    psDBF->sHooks.FSeek(psDBF->fp, 0, 0);
+    DBFSeek(psDBF, 0, 0);
 
     unsigned char abyFileHeader[XBASE_FILEHDR_SZ] = {0};
-    psDBF->sHooks.FRead(abyFileHeader, 1, sizeof(abyFileHeader), psDBF->fp);
+    DBFRead(psDBF, abyFileHeader, 1, sizeof(abyFileHeader));
 
     abyFileHeader[1] = STATIC_CAST(unsigned char, psDBF->nUpdateYearSince1900);
     abyFileHeader[2] = STATIC_CAST(unsigned char, psDBF->nUpdateMonth);
@@ -273,8 +1044,8 @@ void SHPAPI_CALL DBFUpdateHeader(DBFHandle psDBF)
     abyFileHeader[7] =
         STATIC_CAST(unsigned char, (psDBF->nRecords >> 24) & 0xFF);
 
-    psDBF->sHooks.FSeek(psDBF->fp, 0, 0);
-    psDBF->sHooks.FWrite(abyFileHeader, sizeof(abyFileHeader), 1, psDBF->fp);
+    DBFSeek(psDBF, 0, 0);
+    DBFWrite(psDBF, abyFileHeader, sizeof(abyFileHeader), 1);
 
     psDBF->sHooks.FFlush(psDBF->fp);
 }
@@ -394,7 +1165,7 @@ DBFHandle SHPAPI_CALL DBFOpenLL(const char *pszFilename, const char *pszAccess,
     /* -------------------------------------------------------------------- */
     const int nBufSize = 500;
     unsigned char *pabyBuf = STATIC_CAST(unsigned char *, malloc(nBufSize));
-    if (psDBF->sHooks.FRead(pabyBuf, XBASE_FILEHDR_SZ, 1, psDBF->fp) != 1)
+    if (DBFRead(psDBF, pabyBuf, XBASE_FILEHDR_SZ, 1) != 1)
     {
         psDBF->sHooks.FClose(psDBF->fp);
         if (pfCPG)
@@ -462,9 +1233,8 @@ DBFHandle SHPAPI_CALL DBFOpenLL(const char *pszFilename, const char *pszAccess,
     pabyBuf = STATIC_CAST(unsigned char *, realloc(pabyBuf, nHeadLen));
     psDBF->pszHeader = REINTERPRET_CAST(char *, pabyBuf);
 
-    psDBF->sHooks.FSeek(psDBF->fp, XBASE_FILEHDR_SZ, 0);
-    if (psDBF->sHooks.FRead(pabyBuf, nHeadLen - XBASE_FILEHDR_SZ, 1,
-                            psDBF->fp) != 1)
+    DBFSeek(psDBF, XBASE_FILEHDR_SZ, 0);
+    if (DBFRead(psDBF, pabyBuf, nHeadLen - XBASE_FILEHDR_SZ, 1) != 1)
     {
         psDBF->sHooks.FClose(psDBF->fp);
         free(pabyBuf);
@@ -479,6 +1249,28 @@ DBFHandle SHPAPI_CALL DBFOpenLL(const char *pszFilename, const char *pszAccess,
     psDBF->panFieldDecimals = STATIC_CAST(int *, malloc(sizeof(int) * nFields));
     psDBF->pachFieldType = STATIC_CAST(char *, malloc(sizeof(char) * nFields));
 
+    /* -------------------------------------------------------------------- */
+    /*      Some writers keep the high byte of the width of C fields wider  */
+    /*      than 255 in the decimals byte, others keep unrelated values     */
+    /*      there (bug 1202).  Trust it only when the widths it gives add   */
+    /*      up to the record length of the header.                          */
+    /* -------------------------------------------------------------------- */
+    bool bWideText = false;
+    int nWideLength = 1;
+    for (int iField = 0; iField < nFields; iField++)
+    {
+        const unsigned char *pabyFInfo = pabyBuf + iField * XBASE_FLDHDR_SZ;
+        if (pabyFInfo[0] == HEADER_RECORD_TERMINATOR)
+            break;
+        nWideLength += pabyFInfo[16];
+        if (pabyFInfo[11] == 'C' && pabyFInfo[17] != 0)
+        {
+            nWideLength += pabyFInfo[17] * 256;
+            bWideText = true;
+        }
+    }
+    bWideText = bWideText && nWideLength == psDBF->nRecordLength;
+
     for (int iField = 0; iField < nFields; iField++)
     {
         const unsigned char *pabyFInfo = pabyBuf + iField * XBASE_FLDHDR_SZ;
@@ -509,6 +1301,10 @@ DBFHandle SHPAPI_CALL DBFOpenLL(const char *pszFilename, const char *pszAccess,
                     psDBF->panFieldSize[iField] = pabyFInfo[16] +
             pabyFInfo[17]*256; psDBF->panFieldDecimals[iField] = 0;
             */
+
+            /* Done again for C fields, when bWideText vouches for it. */
+            if (bWideText && pabyFInfo[11] == 'C')
+                psDBF->panFieldSize[iField] += pabyFInfo[17] * 256;
         }
 
         psDBF->pachFieldType[iField] = STATIC_CAST(char, pabyFInfo[11]);
@@ -532,6 +1328,13 @@ DBFHandle SHPAPI_CALL DBFOpenLL(const char *pszFilename, const char *pszAccess,
 
     psDBF->bRequireNextWriteSeek = TRUE;
 
+    /* -------------------------------------------------------------------- */
+    /*  Records are read in place if the hooks mapped the file.             */
+    /* -------------------------------------------------------------------- */
+    if (psDBF->sHooks.FMap != SHPLIB_NULLPTR)
+        psDBF->pachMapped =
+            psDBF->sHooks.FMap(psDBF->fp, &psDBF->nMappedSize);
+
     return (psDBF);
 }
 
@@ -551,6 +1354,8 @@ void SHPAPI_CALL DBFClose(DBFHandle psDBF)
         DBFWriteHeader(psDBF);
 
     CPL_IGNORE_RET_VAL_INT(DBFFlushRecord(psDBF));
+    CPL_IGNORE_RET_VAL_INT(DBFAppendFlush(psDBF, true));
+    CPL_IGNORE_RET_VAL_INT(DBFCacheFlush(psDBF));
 
     /* -------------------------------------------------------------------- */
     /*      Update last access date, and number of records if we have       */
@@ -575,6 +1380,14 @@ void SHPAPI_CALL DBFClose(DBFHandle psDBF)
     if (psDBF->pszWorkField != SHPLIB_NULLPTR)
         free(psDBF->pszWorkField);
 
+    DBFCacheDestroy(psDBF->psCache);
+    DBFInvalidateFieldIndex(psDBF);
+    if (psDBF->psAppend != SHPLIB_NULLPTR)
+    {
+        free(psDBF->psAppend->pachData);
+        free(psDBF->psAppend);
+    }
+
     free(psDBF->pszHeader);
     free(psDBF->pszCurrentRecord);
     free(psDBF->pszCodePage);
@@ -763,9 +1576,12 @@ int SHPAPI_CALL DBFAddNativeFieldType(DBFHandle psDBF, const char *pszFieldName,
                                       char chType, int nWidth, int nDecimals)
 {
     /* make sure that everything is written in .dbf */
-    if (!DBFFlushRecord(psDBF))
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, false) ||
+        !DBFCacheDiscard(psDBF))
         return -1;
 
+    DBFInvalidateFieldIndex(psDBF);
+
     if (psDBF->nHeaderLength + XBASE_FLDHDR_SZ > 65535)
     {
         char szMessage[128];
@@ -883,8 +1699,8 @@ int SHPAPI_CALL DBFAddNativeFieldType(DBFHandle psDBF, const char *pszFieldName,
             nOldRecordLength * STATIC_CAST(SAOffset, i) + nOldHeaderLength;
 
         /* load record */
-        psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-        if (psDBF->sHooks.FRead(pszRecord, nOldRecordLength, 1, psDBF->fp) != 1)
+        DBFSeek(psDBF, nRecordOffset, 0);
+        if (DBFRead(psDBF, pszRecord, nOldRecordLength, 1) != 1)
         {
             free(pszRecord);
             return -1;
@@ -897,8 +1713,8 @@ int SHPAPI_CALL DBFAddNativeFieldType(DBFHandle psDBF, const char *pszFieldName,
                         psDBF->nHeaderLength;
 
         /* move record to the new place*/
-        psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-        psDBF->sHooks.FWrite(pszRecord, psDBF->nRecordLength, 1, psDBF->fp);
+        DBFSeek(psDBF, nRecordOffset, 0);
+        DBFWrite(psDBF, pszRecord, psDBF->nRecordLength, 1);
     }
 
     if (psDBF->bWriteEndOfFileChar)
@@ -909,8 +1725,8 @@ int SHPAPI_CALL DBFAddNativeFieldType(DBFHandle psDBF, const char *pszFieldName,
             psDBF->nRecordLength * STATIC_CAST(SAOffset, psDBF->nRecords) +
             psDBF->nHeaderLength;
 
-        psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-        psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+        DBFSeek(psDBF, nRecordOffset, 0);
+        DBFWrite(psDBF, &ch, 1, 1);
     }
 
     /* free record */
@@ -948,11 +1764,10 @@ static void *DBFReadAttribute(DBFHandle psDBF, int hEntity, int iField,
     /* -------------------------------------------------------------------- */
     /*     Have we read the record?                                         */
     /* -------------------------------------------------------------------- */
-    if (!DBFLoadRecord(psDBF, hEntity))
-        return SHPLIB_NULLPTR;
-
     const unsigned char *pabyRec =
-        REINTERPRET_CAST(const unsigned char *, psDBF->pszCurrentRecord);
+        REINTERPRET_CAST(const unsigned char *, DBFReadRecord(psDBF, hEntity));
+    if (pabyRec == SHPLIB_NULLPTR)
+        return SHPLIB_NULLPTR;
 
     /* -------------------------------------------------------------------- */
     /*      Ensure we have room to extract the target field.                */
@@ -984,14 +1799,22 @@ static void *DBFReadAttribute(DBFHandle psDBF, int hEntity, int iField,
     /* -------------------------------------------------------------------- */
     if (chReqType == 'I')
     {
-        psDBF->fieldValue.nIntField = atoi(psDBF->pszWorkField);
+        int64_t nValue;
+        if (DBFParseInteger(psDBF->pszWorkField, psDBF->panFieldSize[iField],
+                            &nValue) &&
+            nValue >= INT_MIN && nValue <= INT_MAX)
+            psDBF->fieldValue.nIntField = STATIC_CAST(int, nValue);
+        else
+            psDBF->fieldValue.nIntField = atoi(psDBF->pszWorkField);
 
         pReturnField = &(psDBF->fieldValue.nIntField);
     }
     else if (chReqType == 'N')
     {
-        psDBF->fieldValue.dfDoubleField =
-            psDBF->sHooks.Atof(psDBF->pszWorkField);
+        if (!DBFParseDouble(psDBF->pszWorkField, psDBF->panFieldSize[iField],
+                            &psDBF->fieldValue.dfDoubleField))
+            psDBF->fieldValue.dfDoubleField =
+                psDBF->sHooks.Atof(psDBF->pszWorkField);
 
         pReturnField = &(psDBF->fieldValue.dfDoubleField);
     }
@@ -1002,18 +1825,16 @@ static void *DBFReadAttribute(DBFHandle psDBF, int hEntity, int iField,
 #ifdef TRIM_DBF_WHITESPACE
     else
     {
-        char *pchSrc = psDBF->pszWorkField;
-        char *pchDst = pchSrc;
-
-        while (*pchSrc == ' ')
-            pchSrc++;
-
-        while (*pchSrc != '\0')
-            *(pchDst++) = *(pchSrc++);
-        *pchDst = '\0';
-
-        while (pchDst != psDBF->pszWorkField && *(--pchDst) == ' ')
-            *pchDst = '\0';
+        char *pszWorkField = psDBF->pszWorkField;
+        int nLength = STATIC_CAST(int, strlen(pszWorkField));
+        const int nLeading = DBFSpanChar(pszWorkField, nLength, ' ');
+
+        nLength -= nLeading;
+        nLength -=
+            DBFSpanCharReverse(pszWorkField + nLeading, nLength, ' ');
+        if (nLeading > 0)
+            memmove(pszWorkField, pszWorkField + nLeading, nLength);
+        pszWorkField[nLength] = '\0';
     }
 #endif
 
@@ -1136,12 +1957,8 @@ static bool DBFIsValueNULL(char chType, const char *pszValue, int size)
             if (pszValue[0] == '*')
                 return true;
 
-            for (int i = 0; pszValue[i] != '\0'; i++)
-            {
-                if (pszValue[i] != ' ')
-                    return false;
-            }
-            return true;
+            /* pszValue is NUL terminated at size at the latest */
+            return pszValue[DBFSpanChar(pszValue, size, ' ')] == '\0';
 
         case 'D':
         {
@@ -1155,10 +1972,7 @@ static bool DBFIsValueNULL(char chType, const char *pszValue, int size)
             if (pszValue[0] == 0 || strncmp(pszValue, "00000000", 8) == 0 ||
                 strcmp(pszValue, " ") == 0 || strcmp(pszValue, "0") == 0)
                 return true;
-            for (int i = 0; i < size; i++)
-                if (pszValue[i] != DIGIT_ZERO)
-                    return false;
-            return true;
+            return DBFSpanChar(pszValue, size, DIGIT_ZERO) == size;
         }
 
         case 'L':
@@ -1191,6 +2005,39 @@ int SHPAPI_CALL DBFIsAttributeNULL(const DBFHandle psDBF, int iRecord,
                           psDBF->panFieldSize[iField]);
 }
 
+/************************************************************************/
+/*                        DBFIsFieldValueNULL()                         */
+/*                                                                      */
+/*      Return TRUE if the trimmed text of a field, given by pointer    */
+/*      and length rather than NUL terminated, is NULL by the rules     */
+/*      of DBFIsAttributeNULL().                                        */
+/************************************************************************/
+
+int SHPAPI_CALL DBFIsFieldValueNULL(char chType, const char *pachValue,
+                                    int nLength, int nWidth)
+{
+    switch (chType)
+    {
+        case 'N':
+        case 'F':
+            return nLength == 0 || pachValue[0] == '*';
+
+        case 'D':
+            if (nLength == 0 || (nLength == 1 && pachValue[0] == '0') ||
+                (nLength >= 8 && strncmp(pachValue, "00000000", 8) == 0))
+                return TRUE;
+            if (nLength != nWidth)
+                return FALSE;
+            return DBFSpanChar(pachValue, nLength, '0') == nLength;
+
+        case 'L':
+            return nLength > 0 && pachValue[0] == '?';
+
+        default:
+            return nLength == 0;
+    }
+}
+
 /************************************************************************/
 /*                          DBFGetFieldCount()                          */
 /*                                                                      */
@@ -1337,27 +2184,18 @@ static bool DBFWriteAttribute(DBFHandle psDBF, int hEntity, int iField,
         case 'N':
         case 'F':
         {
-            int nWidth = psDBF->panFieldSize[iField];
-
             char szSField[XBASE_FLD_MAX_WIDTH + 1];
-            if (STATIC_CAST(int, sizeof(szSField)) - 2 < nWidth)
-                nWidth = sizeof(szSField) - 2;
-
-            char szFormat[20];
-            snprintf(szFormat, sizeof(szFormat), "%%%d.%df", nWidth,
-                     psDBF->panFieldDecimals[iField]);
-            CPLsnprintf(szSField, sizeof(szSField), szFormat,
-                        *STATIC_CAST(double *, pValue));
-            szSField[sizeof(szSField) - 1] = '\0';
-            if (STATIC_CAST(int, strlen(szSField)) >
-                psDBF->panFieldSize[iField])
+            int nLength = DBFFormatDouble(szSField, psDBF->panFieldSize[iField],
+                                          psDBF->panFieldDecimals[iField],
+                                          *STATIC_CAST(double *, pValue));
+            if (nLength > psDBF->panFieldSize[iField])
             {
-                szSField[psDBF->panFieldSize[iField]] = '\0';
+                nLength = psDBF->panFieldSize[iField];
                 nRetResult = false;
             }
             memcpy(REINTERPRET_CAST(char *,
                                     pabyRec + psDBF->panFieldOffset[iField]),
-                   szSField, strlen(szSField));
+                   szSField, nLength);
             break;
         }
 
@@ -1559,8 +2397,7 @@ int SHPAPI_CALL DBFWriteDateAttribute(DBFHandle psDBF, int iRecord, int iField,
     if (lValue->day < 0 || lValue->day > 99)
         return false;
     char dateValue[9]; /* "yyyyMMdd\0" */
-    snprintf(dateValue, sizeof(dateValue), "%04d%02d%02d", lValue->year,
-             lValue->month, lValue->day);
+    DBFFormatDate(dateValue, lValue);
     return (DBFWriteAttributeDirectly(psDBF, iRecord, iField, dateValue));
 }
 
@@ -1627,10 +2464,78 @@ const char SHPAPI_CALL1(*) DBFReadTuple(DBFHandle psDBF, int hEntity)
     if (hEntity < 0 || hEntity >= psDBF->nRecords)
         return SHPLIB_NULLPTR;
 
-    if (!DBFLoadRecord(psDBF, hEntity))
+    return DBFReadRecord(psDBF, hEntity);
+}
+
+/************************************************************************/
+/*                          DBFReadTupleRun()                           */
+/*                                                                      */
+/*      Read record hEntity and as many of the nCount - 1 after it as   */
+/*      lie next to it in the mapping of the file or in one block of    */
+/*      the cache, their number in *pnRun.  Otherwise, as with          */
+/*      DBFReadTuple(), *pnRun is 1.  Records in the append buffer,     */
+/*      and the current record, which may be modified, end a run.      */
+/************************************************************************/
+
+const char SHPAPI_CALL1(*)
+    DBFReadTupleRun(DBFHandle psDBF, int hEntity, int nCount, int *pnRun)
+{
+    if (hEntity < 0 || hEntity >= psDBF->nRecords || nCount < 1)
         return SHPLIB_NULLPTR;
 
-    return STATIC_CAST(const char *, psDBF->pszCurrentRecord);
+    if (nCount > psDBF->nRecords - hEntity)
+        nCount = psDBF->nRecords - hEntity;
+    if (psDBF->nCurrentRecord >= hEntity &&
+        psDBF->nCurrentRecord - hEntity < nCount)
+        nCount = psDBF->nCurrentRecord - hEntity;
+    if (psDBF->psAppend != SHPLIB_NULLPTR && psDBF->psAppend->nRecords > 0 &&
+        psDBF->psAppend->iFirst - hEntity < nCount)
+        nCount = psDBF->psAppend->iFirst > hEntity
+                     ? psDBF->psAppend->iFirst - hEntity
+                     : 0;
+
+    *pnRun = 1;
+    if (nCount > 1 && psDBF->pachMapped != SHPLIB_NULLPTR)
+    {
+        const SAOffset nRecordOffset =
+            psDBF->nRecordLength * STATIC_CAST(SAOffset, hEntity) +
+            psDBF->nHeaderLength;
+        const SAOffset nMapped =
+            nRecordOffset < psDBF->nMappedSize
+                ? (psDBF->nMappedSize - nRecordOffset) / psDBF->nRecordLength
+                : 0;
+
+        if (nMapped > 0)
+        {
+            if (nMapped < STATIC_CAST(SAOffset, nCount))
+                nCount = STATIC_CAST(int, nMapped);
+            psDBF->sStats.nRecordsBuffered += nCount;
+            *pnRun = nCount;
+            return psDBF->pachMapped + nRecordOffset;
+        }
+    }
+    else if (nCount > 1 && psDBF->psCache != SHPLIB_NULLPTR)
+    {
+        const char *pachCached = DBFCacheGetRecord(psDBF, hEntity, false);
+        if (pachCached != SHPLIB_NULLPTR)
+        {
+            /* The block of the record is the most recent one now */
+            const DBFCacheInfo *psCache = psDBF->psCache;
+            const DBFCacheBlock *psBlock =
+                psCache->pasBlocks + psCache->iMostRecent;
+            const int nInBlock =
+                psBlock->iBlock * psCache->nRecordsPerBlock +
+                psBlock->nRecords - hEntity;
+
+            if (nInBlock < nCount)
+                nCount = nInBlock;
+            psDBF->sStats.nRecordsBuffered += nCount - 1;
+            *pnRun = nCount;
+            return pachCached;
+        }
+    }
+
+    return DBFReadRecord(psDBF, hEntity);
 }
 
 /************************************************************************/
@@ -1722,13 +2627,27 @@ int SHPAPI_CALL DBFGetFieldIndex(const DBFHandle psDBF,
 {
     char name[XBASE_FLDNAME_LEN_READ + 1];
 
-    for (int i = 0; i < DBFGetFieldCount(psDBF); i++)
+    if (psDBF->panFieldHash == SHPLIB_NULLPTR && !DBFBuildFieldIndex(psDBF))
+    {
+        for (int i = 0; i < DBFGetFieldCount(psDBF); i++)
+        {
+            DBFGetFieldInfo(psDBF, i, name, SHPLIB_NULLPTR, SHPLIB_NULLPTR);
+            if (!STRCASECMP(pszFieldName, name))
+                return (i);
+        }
+        return (-1);
+    }
+
+    const int nMask = psDBF->nFieldHashSize - 1;
+    for (unsigned int nHash = DBFHashFieldName(pszFieldName);; nHash++)
     {
-        DBFGetFieldInfo(psDBF, i, name, SHPLIB_NULLPTR, SHPLIB_NULLPTR);
+        const int iField = psDBF->panFieldHash[nHash & nMask];
+        if (iField < 0)
+            return (-1);
+        DBFGetFieldInfo(psDBF, iField, name, SHPLIB_NULLPTR, SHPLIB_NULLPTR);
         if (!STRCASECMP(pszFieldName, name))
-            return (i);
+            return (iField);
     }
-    return (-1);
 }
 
 /************************************************************************/
@@ -1749,13 +2668,14 @@ int SHPAPI_CALL DBFIsRecordDeleted(const DBFHandle psDBF, int iShape)
     /* -------------------------------------------------------------------- */
     /*      Have we read the record?                                        */
     /* -------------------------------------------------------------------- */
-    if (!DBFLoadRecord(psDBF, iShape))
+    const char *pachRecord = DBFReadRecord(psDBF, iShape);
+    if (pachRecord == SHPLIB_NULLPTR)
         return FALSE;
 
     /* -------------------------------------------------------------------- */
     /*      '*' means deleted.                                              */
     /* -------------------------------------------------------------------- */
-    return psDBF->pszCurrentRecord[0] == '*';
+    return pachRecord[0] == '*';
 }
 
 /************************************************************************/
@@ -1797,6 +2717,551 @@ int SHPAPI_CALL DBFMarkRecordDeleted(DBFHandle psDBF, int iShape,
     return TRUE;
 }
 
+/************************************************************************/
+/*                              DBFPack()                               */
+/*                                                                      */
+/*      Remove the records marked deleted, moving the others down in    */
+/*      one pass over the file, a large block at a time.  If            */
+/*      pszFilename is given, the records kept go to a new file with    */
+/*      the same fields instead and this one is left as it is.          */
+/*      Returns the number of records kept, or -1 on failure.           */
+/*                                                                      */
+/*      Packed in place, the file keeps its former length: the io       */
+/*      hooks cannot truncate it, so that is left to the caller.        */
+/************************************************************************/
+
+#define DBF_PACK_BLOCK_SIZE (1024 * 1024)
+
+int SHPAPI_CALL DBFPack(DBFHandle psDBF, const char *pszFilename)
+{
+    /* make sure that everything is written in .dbf */
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, true) ||
+        !DBFCacheDiscard(psDBF))
+        return -1;
+
+    DBFHandle psOut = SHPLIB_NULLPTR;
+    if (pszFilename != SHPLIB_NULLPTR)
+    {
+        psOut = DBFCloneEmpty(psDBF, pszFilename);
+        if (psOut == SHPLIB_NULLPTR)
+            return -1;
+    }
+    DBFHandle psTarget = psOut != SHPLIB_NULLPTR ? psOut : psDBF;
+
+    const int nRecordLength = psDBF->nRecordLength;
+    int nPerBlock = DBF_PACK_BLOCK_SIZE / nRecordLength;
+    if (nPerBlock < 1)
+        nPerBlock = 1;
+    char *pachBlock = STATIC_CAST(
+        char *, malloc(STATIC_CAST(size_t, nPerBlock) * nRecordLength));
+    bool bOK = pachBlock != SHPLIB_NULLPTR;
+    int nKept = 0;
+
+    for (int iFirst = 0; bOK && iFirst < psDBF->nRecords; iFirst += nPerBlock)
+    {
+        const int nCount = psDBF->nRecords - iFirst < nPerBlock
+                               ? psDBF->nRecords - iFirst
+                               : nPerBlock;
+        const SAOffset nOffset =
+            nRecordLength * STATIC_CAST(SAOffset, iFirst) +
+            psDBF->nHeaderLength;
+        const char *pachRecords = pachBlock;
+
+        if (psDBF->pachMapped != SHPLIB_NULLPTR &&
+            nOffset + nRecordLength * STATIC_CAST(SAOffset, nCount) <=
+                psDBF->nMappedSize)
+            pachRecords = psDBF->pachMapped + nOffset;
+        else if (DBFSeek(psDBF, nOffset, 0) != 0 ||
+                 DBFRead(psDBF, pachBlock, nRecordLength, nCount) !=
+                     STATIC_CAST(SAOffset, nCount))
+        {
+            bOK = false;
+            break;
+        }
+
+        /* -------------------------------------------------------------------- */
+        /*      Gather the runs of records kept at the start of the block.     */
+        /* -------------------------------------------------------------------- */
+        int nKeptHere = 0;
+        for (int i = 0; i < nCount;)
+        {
+            if (pachRecords[STATIC_CAST(SAOffset, i) * nRecordLength] == '*')
+            {
+                i++;
+                continue;
+            }
+            int j = i + 1;
+            while (j < nCount &&
+                   pachRecords[STATIC_CAST(SAOffset, j) * nRecordLength] != '*')
+                j++;
+            if (pachRecords != pachBlock || i != nKeptHere)
+                memmove(pachBlock +
+                            STATIC_CAST(SAOffset, nKeptHere) * nRecordLength,
+                        pachRecords + STATIC_CAST(SAOffset, i) * nRecordLength,
+                        STATIC_CAST(size_t, j - i) * nRecordLength);
+            nKeptHere += j - i;
+            i = j;
+        }
+
+        /* -------------------------------------------------------------------- */
+        /*      In place, records before the first deleted one stay put.       */
+        /* -------------------------------------------------------------------- */
+        if (nKeptHere > 0 &&
+            (psOut != SHPLIB_NULLPTR || nKept != iFirst || nKeptHere != nCount))
+        {
+            const SAOffset nTarget =
+                nRecordLength * STATIC_CAST(SAOffset, nKept) +
+                psTarget->nHeaderLength;
+            if (DBFSeek(psTarget, nTarget, 0) != 0 ||
+                DBFWrite(psTarget, pachBlock, nRecordLength, nKeptHere) !=
+                    STATIC_CAST(SAOffset, nKeptHere))
+                bOK = false;
+        }
+        nKept += nKeptHere;
+    }
+
+    free(pachBlock);
+
+    /* -------------------------------------------------------------------- */
+    /*      Write the end of file mark and the record count once.           */
+    /* -------------------------------------------------------------------- */
+    if (bOK && (psOut != SHPLIB_NULLPTR || nKept < psDBF->nRecords))
+    {
+        psTarget->nRecords = nKept;
+        psTarget->nCurrentRecord = -1;
+        psTarget->bCurrentRecordModified = FALSE;
+        psTarget->bRequireNextWriteSeek = TRUE;
+        psTarget->bUpdated = TRUE;
+
+        if (psTarget->bWriteEndOfFileChar)
+        {
+            char ch = END_OF_FILE_CHARACTER;
+            SAOffset nEOFOffset =
+                nRecordLength * STATIC_CAST(SAOffset, nKept) +
+                psTarget->nHeaderLength;
+
+            DBFSeek(psTarget, nEOFOffset, 0);
+            DBFWrite(psTarget, &ch, 1, 1);
+        }
+        DBFUpdateHeader(psTarget);
+    }
+
+    if (psOut != SHPLIB_NULLPTR)
+        DBFClose(psOut);
+
+    return bOK ? nKept : -1;
+}
+
+/************************************************************************/
+/*                          DBFConvertField()                           */
+/*                                                                      */
+/*      Write a field value into a field of another type or size.       */
+/*      Returns false if it does not fit: text is cut short, and a      */
+/*      number or logical value is written as NULL instead.             */
+/*      pszWork must hold nFrom + 1 characters.                         */
+/************************************************************************/
+
+static bool DBFConvertField(char *pachTo, char chTo, int nTo, int nToDecimals,
+                            const char *pachFrom, char chFrom, int nFrom,
+                            int nFromDecimals, char *pszWork)
+{
+    if (chTo == chFrom && nTo == nFrom && nToDecimals == nFromDecimals)
+    {
+        memcpy(pachTo, pachFrom, nTo);
+        return true;
+    }
+
+    /* the value ends at a zero byte, if any, and before its padding */
+    const char *pachZero =
+        STATIC_CAST(const char *, memchr(pachFrom, '\0', nFrom));
+    int nLength =
+        pachZero != SHPLIB_NULLPTR ? STATIC_CAST(int, pachZero - pachFrom) : nFrom;
+    while (nLength > 0 && pachFrom[nLength - 1] == ' ')
+        nLength--;
+    memcpy(pszWork, pachFrom, nLength);
+    pszWork[nLength] = '\0';
+
+    if (DBFIsValueNULL(chFrom, pszWork, nLength))
+    {
+        memset(pachTo, DBFGetNullCharacter(chTo), nTo);
+        return true;
+    }
+
+    /* text keeps its leading spaces */
+    const char *pszText = pszWork;
+    if (chFrom != 'C')
+    {
+        while (*pszText == ' ')
+            pszText++;
+        nLength -= STATIC_CAST(int, pszText - pszWork);
+    }
+
+    if (chTo == 'N' || chTo == 'F')
+    {
+        /* fewer decimals, and those dropped are zeros: cut them off */
+        if ((chFrom == 'N' || chFrom == 'F') && nToDecimals < nFromDecimals &&
+            nLength > nFromDecimals &&
+            pszText[nLength - nFromDecimals - 1] == '.' &&
+            DBFSpanChar(pszText + nLength - nFromDecimals + nToDecimals,
+                        nFromDecimals - nToDecimals,
+                        '0') == nFromDecimals - nToDecimals)
+        {
+            nLength -= nFromDecimals - nToDecimals + (nToDecimals == 0);
+            nFromDecimals = nToDecimals;
+        }
+
+        if ((chFrom == 'N' || chFrom == 'F') && nToDecimals == nFromDecimals)
+        {
+            /* same decimals: the digits only move right or left */
+            if (nLength <= nTo)
+            {
+                memset(pachTo, ' ', nTo - nLength);
+                memcpy(pachTo + nTo - nLength, pszText, nLength);
+                return true;
+            }
+        }
+        else
+        {
+            double dfValue;
+
+            if (DBFParseDouble(pszText, nLength, &dfValue))
+            {
+                /* Padded to at most XBASE_FLD_MAX_WIDTH - 1 */
+                char szNumber[XBASE_FLD_MAX_WIDTH + 1];
+                const int nNumber =
+                    DBFFormatDouble(szNumber, nTo, nToDecimals, dfValue);
+
+                if (nNumber <= nTo)
+                {
+                    memset(pachTo, ' ', nTo - nNumber);
+                    memcpy(pachTo + nTo - nNumber, szNumber, nNumber);
+                    return true;
+                }
+            }
+        }
+        memset(pachTo, DBFGetNullCharacter(chTo), nTo);
+        return false;
+    }
+
+    if (chTo == 'L')
+    {
+        memset(pachTo, ' ', nTo);
+        if (*pszText != '\0' && strchr("TtFfYyNn", *pszText) != SHPLIB_NULLPTR)
+        {
+            pachTo[0] = *pszText;
+            return true;
+        }
+        pachTo[0] = DBFGetNullCharacter(chTo);
+        return false;
+    }
+
+    /* C, D and the others hold text, left justified */
+    if (nLength > nTo)
+    {
+        memcpy(pachTo, pszText, nTo);
+        return false;
+    }
+    memcpy(pachTo, pszText, nLength);
+    memset(pachTo + nLength, ' ', nTo - nLength);
+    return true;
+}
+
+/************************************************************************/
+/*                           DBFRestructure()                           */
+/*                                                                      */
+/*      Give the .dbf file a new list of fields in one pass over its    */
+/*      records, a large block at a time, where DBFDeleteField(),       */
+/*      DBFReorderFields() and DBFAlterFieldDefn() each rewrite the     */
+/*      whole file.  Field i of the result is field panSource[i] of     */
+/*      the file, with its name and the type, width and decimals given  */
+/*      for it; fields not named are dropped.  If pszFilename is        */
+/*      given, the records go to a new file instead and this one is     */
+/*      left as it is.                                                  */
+/*                                                                      */
+/*      Returns the number of values that did not fit their new        */
+/*      field (see DBFConvertField()), or -1 on failure.  Restructured  */
+/*      in place, a file that gets shorter keeps its former length:     */
+/*      the io hooks cannot truncate it, so that is left to the caller. */
+/************************************************************************/
+
+int SHPAPI_CALL DBFRestructure(DBFHandle psDBF, int nFields,
+                               const int *panSource, const char *pachType,
+                               const int *panWidth, const int *panDecimals,
+                               const char *pszFilename)
+{
+    if (nFields < 1)
+        return -1;
+
+    /* make sure that everything is written in .dbf */
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, true) ||
+        !DBFCacheDiscard(psDBF))
+        return -1;
+
+    /* -------------------------------------------------------------------- */
+    /*      Lay out the new fields, keeping the names of the old ones.      */
+    /* -------------------------------------------------------------------- */
+    int *panFieldOffset = STATIC_CAST(int *, malloc(sizeof(int) * nFields));
+    int *panFieldSize = STATIC_CAST(int *, malloc(sizeof(int) * nFields));
+    int *panFieldDecimals = STATIC_CAST(int *, malloc(sizeof(int) * nFields));
+    char *pachFieldType = STATIC_CAST(char *, malloc(sizeof(char) * nFields));
+    char *pszHeader =
+        STATIC_CAST(char *, malloc(sizeof(char) * XBASE_FLDHDR_SZ * nFields));
+    int nRecordLength = 1;
+    int nWorkLength = 1;
+    bool bOK = true;
+
+    for (int i = 0; i < nFields; i++)
+    {
+        const int iSource = panSource[i];
+        const int nWidth = panWidth[i];
+
+        if (iSource < 0 || iSource >= psDBF->nFields || nWidth < 1 ||
+            (pachType[i] != 'C' && nWidth > XBASE_FLD_MAX_WIDTH))
+        {
+            bOK = false;
+            break;
+        }
+
+        panFieldOffset[i] = nRecordLength;
+        panFieldSize[i] = nWidth;
+        panFieldDecimals[i] = panDecimals[i];
+        pachFieldType[i] = pachType[i];
+        nRecordLength += nWidth;
+        if (psDBF->panFieldSize[iSource] + 1 > nWorkLength)
+            nWorkLength = psDBF->panFieldSize[iSource] + 1;
+
+        char *pszFInfo = pszHeader + XBASE_FLDHDR_SZ * i;
+        memcpy(pszFInfo, psDBF->pszHeader + XBASE_FLDHDR_SZ * iSource,
+               XBASE_FLDHDR_SZ);
+        pszFInfo[11] = pachType[i];
+        if (pachType[i] == 'C')
+        {
+            pszFInfo[16] = STATIC_CAST(unsigned char, nWidth % 256);
+            pszFInfo[17] = STATIC_CAST(unsigned char, nWidth / 256);
+        }
+        else
+        {
+            pszFInfo[16] = STATIC_CAST(unsigned char, nWidth);
+            pszFInfo[17] = STATIC_CAST(unsigned char, panDecimals[i]);
+        }
+    }
+
+    const int nHeaderLength = XBASE_FLDHDR_SZ * (nFields + 1) + 1;
+
+    if (!bOK || nRecordLength > 65535 || nHeaderLength > 65535)
+    {
+        free(panFieldOffset);
+        free(panFieldSize);
+        free(panFieldDecimals);
+        free(pachFieldType);
+        free(pszHeader);
+        return -1;
+    }
+
+    /* -------------------------------------------------------------------- */
+    /*      A new file takes the new fields at once.                        */
+    /* -------------------------------------------------------------------- */
+    DBFHandle psOut = SHPLIB_NULLPTR;
+    if (pszFilename != SHPLIB_NULLPTR)
+    {
+        psOut = DBFCreateLL(pszFilename, psDBF->pszCodePage, &psDBF->sHooks);
+        if (psOut == SHPLIB_NULLPTR)
+        {
+            free(panFieldOffset);
+            free(panFieldSize);
+            free(panFieldDecimals);
+            free(pachFieldType);
+            free(pszHeader);
+            return -1;
+        }
+        psOut->nFields = nFields;
+        psOut->panFieldOffset = panFieldOffset;
+        psOut->panFieldSize = panFieldSize;
+        psOut->panFieldDecimals = panFieldDecimals;
+        psOut->pachFieldType = pachFieldType;
+        psOut->pszHeader = pszHeader;
+        psOut->nRecordLength = nRecordLength;
+        psOut->nHeaderLength = nHeaderLength;
+        psOut->bWriteEndOfFileChar = psDBF->bWriteEndOfFileChar;
+        DBFWriteHeader(psOut);
+    }
+    DBFHandle psTarget = psOut != SHPLIB_NULLPTR ? psOut : psDBF;
+
+    /* -------------------------------------------------------------------- */
+    /*      In place, records that move towards the end of the file go      */
+    /*      first, from the last one back, then the others from the        */
+    /*      first one on, so that none is written over before it is read.  */
+    /* -------------------------------------------------------------------- */
+    const int nOldRecordLength = psDBF->nRecordLength;
+    const int nOldHeaderLength = psDBF->nHeaderLength;
+    const int nRecords = psDBF->nRecords;
+    int nPerBlock = DBF_PACK_BLOCK_SIZE / (nOldRecordLength > nRecordLength
+                                               ? nOldRecordLength
+                                               : nRecordLength);
+    if (nPerBlock < 1)
+        nPerBlock = 1;
+
+    int iSplit = nRecords;
+    if (psOut == SHPLIB_NULLPTR && nRecordLength > nOldRecordLength)
+    {
+        const int nGap = nOldHeaderLength - nHeaderLength;
+        iSplit = nGap < 0 ? 0 : nGap / (nRecordLength - nOldRecordLength) + 1;
+        if (iSplit > nRecords)
+            iSplit = nRecords;
+    }
+    const int nBackward = (nRecords - iSplit + nPerBlock - 1) / nPerBlock;
+    const int nBlocks = nBackward + (iSplit + nPerBlock - 1) / nPerBlock;
+
+    char *pachIn = STATIC_CAST(
+        char *, malloc(STATIC_CAST(size_t, nPerBlock) * nOldRecordLength));
+    char *pachOut = STATIC_CAST(
+        char *, malloc(STATIC_CAST(size_t, nPerBlock) * nRecordLength));
+    char *pszWork = STATIC_CAST(char *, malloc(nWorkLength));
+    bOK = pachIn != SHPLIB_NULLPTR && pachOut != SHPLIB_NULLPTR &&
+          pszWork != SHPLIB_NULLPTR;
+    int nUnfit = 0;
+
+    for (int iBlock = 0; bOK && iBlock < nBlocks; iBlock++)
+    {
+        int iFirst;
+        int nCount;
+        if (iBlock < nBackward)
+        {
+            const int iEnd = nRecords - iBlock * nPerBlock;
+            iFirst = iEnd - nPerBlock > iSplit ? iEnd - nPerBlock : iSplit;
+            nCount = iEnd - iFirst;
+        }
+        else
+        {
+            iFirst = (iBlock - nBackward) * nPerBlock;
+            nCount = iSplit - iFirst < nPerBlock ? iSplit - iFirst : nPerBlock;
+        }
+
+        const SAOffset nOffset =
+            nOldRecordLength * STATIC_CAST(SAOffset, iFirst) +
+            nOldHeaderLength;
+        const char *pachRecords = pachIn;
+
+        if (psOut != SHPLIB_NULLPTR && psDBF->pachMapped != SHPLIB_NULLPTR &&
+            nOffset + nOldRecordLength * STATIC_CAST(SAOffset, nCount) <=
+                psDBF->nMappedSize)
+            pachRecords = psDBF->pachMapped + nOffset;
+        else if (DBFSeek(psDBF, nOffset, 0) != 0 ||
+                 DBFRead(psDBF, pachIn, nOldRecordLength, nCount) !=
+                     STATIC_CAST(SAOffset, nCount))
+        {
+            bOK = false;
+            break;
+        }
+
+        for (int i = 0; i < nCount; i++)
+        {
+            const char *pachFrom =
+                pachRecords + STATIC_CAST(SAOffset, i) * nOldRecordLength;
+            char *pachTo = pachOut + STATIC_CAST(SAOffset, i) * nRecordLength;
+
+            pachTo[0] = pachFrom[0];
+            for (int j = 0; j < nFields; j++)
+            {
+                const int iSource = panSource[j];
+                if (!DBFConvertField(
+                        pachTo + panFieldOffset[j], pachFieldType[j],
+                        panFieldSize[j], panFieldDecimals[j],
+                        pachFrom + psDBF->panFieldOffset[iSource],
+                        psDBF->pachFieldType[iSource],
+                        psDBF->panFieldSize[iSource],
+                        psDBF->panFieldDecimals[iSource], pszWork))
+                    nUnfit++;
+            }
+        }
+
+        const SAOffset nTarget =
+            nRecordLength * STATIC_CAST(SAOffset, iFirst) + nHeaderLength;
+        if (DBFSeek(psTarget, nTarget, 0) != 0 ||
+            DBFWrite(psTarget, pachOut, nRecordLength, nCount) !=
+                STATIC_CAST(SAOffset, nCount))
+            bOK = false;
+    }
+
+    free(pachIn);
+    free(pachOut);
+    free(pszWork);
+
+    /* -------------------------------------------------------------------- */
+    /*      Write the end of file mark and the header once.                 */
+    /* -------------------------------------------------------------------- */
+    if (bOK && nRecords > 0 && psTarget->bWriteEndOfFileChar)
+    {
+        char ch = END_OF_FILE_CHARACTER;
+        const SAOffset nEOFOffset =
+            nRecordLength * STATIC_CAST(SAOffset, nRecords) + nHeaderLength;
+
+        if (DBFSeek(psTarget, nEOFOffset, 0) != 0 ||
+            DBFWrite(psTarget, &ch, 1, 1) != 1)
+            bOK = false;
+    }
+
+    if (psOut != SHPLIB_NULLPTR)
+    {
+        psOut->nRecords = nRecords;
+        psOut->bUpdated = TRUE;
+        DBFClose(psOut);
+        return bOK ? nUnfit : -1;
+    }
+
+    if (!bOK)
+    {
+        free(panFieldOffset);
+        free(panFieldSize);
+        free(panFieldDecimals);
+        free(pachFieldType);
+        free(pszHeader);
+        return -1;
+    }
+
+    DBFInvalidateFieldIndex(psDBF);
+
+    free(psDBF->panFieldOffset);
+    free(psDBF->panFieldSize);
+    free(psDBF->panFieldDecimals);
+    free(psDBF->pachFieldType);
+    free(psDBF->pszHeader);
+
+    psDBF->nFields = nFields;
+    psDBF->panFieldOffset = panFieldOffset;
+    psDBF->panFieldSize = panFieldSize;
+    psDBF->panFieldDecimals = panFieldDecimals;
+    psDBF->pachFieldType = pachFieldType;
+    psDBF->pszHeader = pszHeader;
+    psDBF->nRecordLength = nRecordLength;
+    psDBF->nHeaderLength = nHeaderLength;
+
+    psDBF->pszCurrentRecord = STATIC_CAST(
+        char *, realloc(psDBF->pszCurrentRecord, psDBF->nRecordLength));
+    psDBF->nCurrentRecord = -1;
+    psDBF->bCurrentRecordModified = FALSE;
+    psDBF->bRequireNextWriteSeek = TRUE;
+
+    /* the cache blocks are laid out for the record length */
+    if (psDBF->psCache != SHPLIB_NULLPTR)
+    {
+        const SAOffset nCacheSize = psDBF->psCache->nSize;
+        DBFCacheDestroy(psDBF->psCache);
+        psDBF->psCache = DBFCacheCreate(nCacheSize, psDBF->nRecordLength);
+    }
+
+    /* we're done if we're dealing with not yet created .dbf */
+    if (psDBF->bNoHeader && nRecords == 0)
+        return 0;
+
+    /* force update of header with new header and record length */
+    psDBF->bNoHeader = TRUE;
+    psDBF->bUpdated = TRUE;
+    DBFUpdateHeader(psDBF);
+
+    return nUnfit;
+}
+
 /************************************************************************/
 /*                            DBFGetCodePage                            */
 /************************************************************************/
@@ -1820,9 +3285,12 @@ int SHPAPI_CALL DBFDeleteField(DBFHandle psDBF, int iField)
         return FALSE;
 
     /* make sure that everything is written in .dbf */
-    if (!DBFFlushRecord(psDBF))
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, false) ||
+        !DBFCacheDiscard(psDBF))
         return FALSE;
 
+    DBFInvalidateFieldIndex(psDBF);
+
     /* get information about field to be deleted */
     int nOldRecordLength = psDBF->nRecordLength;
     int nOldHeaderLength = psDBF->nHeaderLength;
@@ -1890,8 +3358,8 @@ int SHPAPI_CALL DBFDeleteField(DBFHandle psDBF, int iField)
             nOldHeaderLength;
 
         /* load record */
-        psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-        if (psDBF->sHooks.FRead(pszRecord, nOldRecordLength, 1, psDBF->fp) != 1)
+        DBFSeek(psDBF, nRecordOffset, 0);
+        if (DBFRead(psDBF, pszRecord, nOldRecordLength, 1) != 1)
         {
             free(pszRecord);
             return FALSE;
@@ -1901,12 +3369,11 @@ int SHPAPI_CALL DBFDeleteField(DBFHandle psDBF, int iField)
                         psDBF->nHeaderLength;
 
         /* move record in two steps */
-        psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-        psDBF->sHooks.FWrite(pszRecord, nDeletedFieldOffset, 1, psDBF->fp);
-        psDBF->sHooks.FWrite(
-            pszRecord + nDeletedFieldOffset + nDeletedFieldSize,
-            nOldRecordLength - nDeletedFieldOffset - nDeletedFieldSize, 1,
-            psDBF->fp);
+        DBFSeek(psDBF, nRecordOffset, 0);
+        DBFWrite(psDBF, pszRecord, nDeletedFieldOffset, 1);
+        DBFWrite(
+            psDBF, pszRecord + nDeletedFieldOffset + nDeletedFieldSize,
+            nOldRecordLength - nDeletedFieldOffset - nDeletedFieldSize, 1);
     }
 
     if (psDBF->bWriteEndOfFileChar)
@@ -1916,8 +3383,8 @@ int SHPAPI_CALL DBFDeleteField(DBFHandle psDBF, int iField)
             psDBF->nRecordLength * STATIC_CAST(SAOffset, psDBF->nRecords) +
             psDBF->nHeaderLength;
 
-        psDBF->sHooks.FSeek(psDBF->fp, nEOFOffset, 0);
-        psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+        DBFSeek(psDBF, nEOFOffset, 0);
+        DBFWrite(psDBF, &ch, 1, 1);
     }
 
     /* TODO: truncate file */
@@ -1948,9 +3415,12 @@ int SHPAPI_CALL DBFReorderFields(DBFHandle psDBF, const int *panMap)
         return TRUE;
 
     /* make sure that everything is written in .dbf */
-    if (!DBFFlushRecord(psDBF))
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, false) ||
+        !DBFCacheDiscard(psDBF))
         return FALSE;
 
+    DBFInvalidateFieldIndex(psDBF);
+
     /* a simple malloc() would be enough, but calloc() helps clang static
      * analyzer */
     int *panFieldOffsetNew =
@@ -2006,9 +3476,8 @@ int SHPAPI_CALL DBFReorderFields(DBFHandle psDBF, const int *panMap)
                 psDBF->nHeaderLength;
 
             /* load record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            if (psDBF->sHooks.FRead(pszRecord, psDBF->nRecordLength, 1,
-                                    psDBF->fp) != 1)
+            DBFSeek(psDBF, nRecordOffset, 0);
+            if (DBFRead(psDBF, pszRecord, psDBF->nRecordLength, 1) != 1)
             {
                 errorAbort = true;
                 break;
@@ -2024,9 +3493,8 @@ int SHPAPI_CALL DBFReorderFields(DBFHandle psDBF, const int *panMap)
             }
 
             /* write record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            psDBF->sHooks.FWrite(pszRecordNew, psDBF->nRecordLength, 1,
-                                 psDBF->fp);
+            DBFSeek(psDBF, nRecordOffset, 0);
+            DBFWrite(psDBF, pszRecordNew, psDBF->nRecordLength, 1);
         }
 
         /* free record */
@@ -2077,9 +3545,12 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
         return FALSE;
 
     /* make sure that everything is written in .dbf */
-    if (!DBFFlushRecord(psDBF))
+    if (!DBFFlushRecord(psDBF) || !DBFAppendFlush(psDBF, false) ||
+        !DBFCacheDiscard(psDBF))
         return FALSE;
 
+    DBFInvalidateFieldIndex(psDBF);
+
     const char chFieldFill = DBFGetNullCharacter(chType);
 
     const char chOldType = psDBF->pachFieldType[iField];
@@ -2166,9 +3637,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nHeaderLength;
 
             /* load record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            if (psDBF->sHooks.FRead(pszRecord, nOldRecordLength, 1,
-                                    psDBF->fp) != 1)
+            DBFSeek(psDBF, nRecordOffset, 0);
+            if (DBFRead(psDBF, pszRecord, nOldRecordLength, 1) != 1)
             {
                 errorAbort = true;
                 break;
@@ -2207,8 +3677,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nHeaderLength;
 
             /* write record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            psDBF->sHooks.FWrite(pszRecord, psDBF->nRecordLength, 1, psDBF->fp);
+            DBFSeek(psDBF, nRecordOffset, 0);
+            DBFWrite(psDBF, pszRecord, psDBF->nRecordLength, 1);
         }
 
         if (!errorAbort && psDBF->bWriteEndOfFileChar)
@@ -2219,8 +3689,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nRecordLength * STATIC_CAST(SAOffset, psDBF->nRecords) +
                 psDBF->nHeaderLength;
 
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+            DBFSeek(psDBF, nRecordOffset, 0);
+            DBFWrite(psDBF, &ch, 1, 1);
         }
         /* TODO: truncate file */
 
@@ -2244,9 +3714,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nHeaderLength;
 
             /* load record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            if (psDBF->sHooks.FRead(pszRecord, nOldRecordLength, 1,
-                                    psDBF->fp) != 1)
+            DBFSeek(psDBF, nRecordOffset, 0);
+            if (DBFRead(psDBF, pszRecord, nOldRecordLength, 1) != 1)
             {
                 errorAbort = true;
                 break;
@@ -2290,8 +3759,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nHeaderLength;
 
             /* write record */
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            psDBF->sHooks.FWrite(pszRecord, psDBF->nRecordLength, 1, psDBF->fp);
+            DBFSeek(psDBF, nRecordOffset, 0);
+            DBFWrite(psDBF, pszRecord, psDBF->nRecordLength, 1);
         }
 
         if (!errorAbort && psDBF->bWriteEndOfFileChar)
@@ -2302,8 +3771,8 @@ int SHPAPI_CALL DBFAlterFieldDefn(DBFHandle psDBF, int iField,
                 psDBF->nRecordLength * STATIC_CAST(SAOffset, psDBF->nRecords) +
                 psDBF->nHeaderLength;
 
-            psDBF->sHooks.FSeek(psDBF->fp, nRecordOffset, 0);
-            psDBF->sHooks.FWrite(&ch, 1, 1, psDBF->fp);
+            DBFSeek(psDBF, nRecordOffset, 0);
+            DBFWrite(psDBF, &ch, 1, 1);
         }
 
         free(pszRecord);
@@ -0,0 +1,459 @@
+/*----------------------------------------------------------------------*\
+ | $d restructure: drop, reorder and alter fields at once.  The fields	|
+ | of the result are worked out first, then DBFRestructure rewrites the	|
+ | records in a single pass, in place or into a new file with -output.	|
+ | Values are converted to their new type and width as they move;		|
+ | those that do not fit are counted and returned: text is cut short,	|
+ | numbers and logical values become NULL.								|
+ |																		|
+ | $d optimize works out the fields from the values themselves: one		|
+ | pass over the raw records finds the widest text, the widest integer	|
+ | part and the most decimals used in each field, and fields that are	|
+ | NULL throughout are dropped.											|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+struct layout {
+	int count;			/* fields of the result */
+	int *source;		/* field of the dbf each one comes from */
+	char *type;			/* native type, width and decimals of each */
+	int *width;
+	int *decimals;
+	int *place;			/* number in the result of each field of the dbf, or -1 */
+	};
+
+/* The fields of the dbf as they are */
+
+static struct layout *layout_new (DBFHandle df) {
+	struct layout *l = (struct layout *) ckalloc (sizeof (struct layout));
+	int nf = DBFGetFieldCount (df), n = nf > 0 ? nf : 1, j;
+
+	l->count = nf;
+	l->source = (int *) ckalloc (n * sizeof (int));
+	l->type = ckalloc (n);
+	l->width = (int *) ckalloc (n * sizeof (int));
+	l->decimals = (int *) ckalloc (n * sizeof (int));
+	l->place = (int *) ckalloc (n * sizeof (int));
+	for (j=0; j < nf; j++) {
+		l->source[j] = l->place[j] = j;
+		l->type[j] = df->pachFieldType[j];
+		l->width[j] = df->panFieldSize[j];
+		l->decimals[j] = df->panFieldDecimals[j];
+		}
+	return (l);
+	}
+
+static void layout_free (struct layout *l) {
+	ckfree ((char *) l->source);
+	ckfree (l->type);
+	ckfree ((char *) l->width);
+	ckfree ((char *) l->decimals);
+	ckfree ((char *) l->place);
+	ckfree ((char *) l);
+	}
+
+/*----------------------------------------------------------------------*\
+ | -drop and -order: the fields named in order come first, in that		|
+ | order, and the others follow as they were, less those dropped.		|
+\*----------------------------------------------------------------------*/
+
+static int layout_fields (Tcl_Interp *interp, struct dbf_info *di, struct layout *l, Tcl_Obj *drop, Tcl_Obj *order) {
+	int nf = DBFGetFieldCount (di->df), count = 0, n, j, k;
+	Tcl_Obj **names;
+
+	for (j=0; j < nf; j++)
+		l->place[j] = 0;	/* 0 kept, -1 dropped, 1 placed by -order */
+
+	if (drop) {
+		if (Tcl_ListObjGetElements (interp,drop,&n,&names) == TCL_ERROR)
+			return (TCL_ERROR);
+		for (k=0; k < n; k++) {
+			if ((j = get_field_index (di,names[k])) == -1) {
+				Tcl_SetResult (interp,"restructure: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(names[k])," does not match a field name in this dbf file",NULL);
+				return (TCL_ERROR);
+				}
+			l->place[j] = -1;
+			}
+		}
+
+	if (order) {
+		if (Tcl_ListObjGetElements (interp,order,&n,&names) == TCL_ERROR)
+			return (TCL_ERROR);
+		for (k=0; k < n; k++) {
+			if ((j = get_field_index (di,names[k])) == -1) {
+				Tcl_SetResult (interp,"restructure: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(names[k])," does not match a field name in this dbf file",NULL);
+				return (TCL_ERROR);
+				}
+			if (l->place[j] != 0) {
+				Tcl_SetResult (interp,"restructure: ",TCL_STATIC);
+				Tcl_AppendResult (interp,Tcl_GetString(names[k]),l->place[j] < 0 ? " is dropped" : " is named twice in -order",NULL);
+				return (TCL_ERROR);
+				}
+			l->place[j] = 1;
+			l->source[count++] = j;
+			}
+		}
+
+	for (j=0; j < nf; j++)
+		if (l->place[j] == 0)
+			l->source[count++] = j;
+	if (count == 0) {
+		Tcl_SetResult (interp,"restructure: the dbf must keep at least one field",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+
+	l->count = count;
+	for (j=0; j < nf; j++)
+		l->place[j] = -1;
+	for (k=0; k < count; k++) {
+		j = l->source[k];
+		l->place[j] = k;
+		l->type[k] = di->df->pachFieldType[j];
+		l->width[k] = di->df->panFieldSize[j];
+		l->decimals[k] = di->df->panFieldDecimals[j];
+		}
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | -alter {field {type width ?prec?} ...}, type as add takes it			|
+\*----------------------------------------------------------------------*/
+
+static int layout_alter (Tcl_Interp *interp, struct dbf_info *di, struct layout *l, Tcl_Obj *alter) {
+	Tcl_Obj **pairs, **spec;
+	int n, m, j, k;
+
+	if (Tcl_ListObjGetElements (interp,alter,&n,&pairs) == TCL_ERROR)
+		return (TCL_ERROR);
+	if (n % 2) {
+		Tcl_SetResult (interp,"restructure: -alter expects a list of field names, each followed by {type width ?prec?}",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+
+	for (k=0; k < n; k += 2) {
+		DBFFieldType type;
+		int width, prec = 0;
+
+		if ((j = get_field_index (di,pairs[k])) == -1) {
+			Tcl_SetResult (interp,"restructure: ",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(pairs[k])," does not match a field name in this dbf file",NULL);
+			return (TCL_ERROR);
+			}
+		if (l->place[j] < 0) {
+			Tcl_SetResult (interp,"restructure: ",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(pairs[k])," is dropped",NULL);
+			return (TCL_ERROR);
+			}
+		if (Tcl_ListObjGetElements (interp,pairs[k+1],&m,&spec) == TCL_ERROR)
+			return (TCL_ERROR);
+		if (m < 2 || m > 3) {
+			Tcl_SetResult (interp,"restructure: -alter expects a list of field names, each followed by {type width ?prec?}",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		if ((type = dbf_get_type (Tcl_GetString(spec[0]))) == FTInvalid) {
+			Tcl_SetResult (interp,"restructure: type of field must be String, Integer, Logical, Date, or Double",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		if (Tcl_GetIntFromObj (NULL,spec[1],&width) == TCL_ERROR || width < 1 || width > 255) {
+			Tcl_SetResult (interp,"restructure: field width must be greater than zero and less than 256",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		if (type == FTDouble && m == 3) {
+			if (Tcl_GetIntFromObj (NULL,spec[2],&prec) == TCL_ERROR || prec < 0 || prec > width) {
+				Tcl_SetResult (interp,"restructure: field prec must not be greater than field width",TCL_STATIC);
+				return (TCL_ERROR);
+				}
+			}
+
+		/* The native types DBFAddField gives them */
+
+		j = l->place[j];
+		l->type[j] = type == FTString ? 'C' : type == FTLogical ? 'L' : type == FTDate ? 'D' : 'N';
+		l->width[j] = width;
+		l->decimals[j] = prec;
+		}
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Give the dbf, or a copy of it at output, the fields of the layout.	|
+ | The result is the number of values that did not fit.					|
+\*----------------------------------------------------------------------*/
+
+static int layout_apply (Tcl_Interp *interp, struct dbf_info *di, const char *command, struct layout *l, Tcl_Obj *output) {
+	DBFHandle df = di->df;
+	int unfit;
+
+	if (output) {
+		Tcl_DString native;
+
+		if (!(output = Tcl_FSGetNormalizedPath (interp,output)))
+			return (TCL_ERROR);
+		if (strcmp (Tcl_GetString(output),di->path) == 0) {
+			Tcl_AppendResult (interp,command,": -output must be another file than the dbf",NULL);
+			return (TCL_ERROR);
+			}
+		unfit = DBFRestructure (df,l->count,l->source,l->type,l->width,l->decimals,Tcl_UtfToExternalDString (NULL,Tcl_GetString(output),-1,&native));
+		Tcl_DStringFree (&native);
+		if (unfit < 0) {
+			Tcl_AppendResult (interp,command,": could not write ",Tcl_GetString(output),NULL);
+			return (TCL_ERROR);
+			}
+		Tcl_SetObjResult (interp,Tcl_NewIntObj (unfit));
+		return (TCL_OK);
+		}
+
+	if (di->iterating) {
+		Tcl_AppendResult (interp,command,": cannot change the fields inside a foreach",NULL);
+		return (TCL_ERROR);
+		}
+	if (check_writable (interp,di,command) == TCL_ERROR)
+		return (TCL_ERROR);
+
+	/* In place, field numbers change: the sidecars follow them */
+
+	index_settle (di);
+	columnar_forget (di);
+	if ((unfit = DBFRestructure (df,l->count,l->source,l->type,l->width,l->decimals,NULL)) < 0) {
+		Tcl_AppendResult (interp,command,": could not write ",di->path,NULL);
+		return (TCL_ERROR);
+		}
+	new_field_tag (di);
+	index_restructure (di,l->place);
+	if (!df->bNoHeader && truncate_dbf (interp,di,command) == TCL_ERROR)
+		return (TCL_ERROR);
+	Tcl_SetObjResult (interp,Tcl_NewIntObj (unfit));
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | restructure [-drop <list>] [-order <list>] [-alter <list>]			|
+ |	[-output <path>]													|
+\*----------------------------------------------------------------------*/
+
+int restructure_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	Tcl_Obj *drop = NULL, *order = NULL, *alter = NULL, *output = NULL;
+	struct layout *l;
+	int result, k;
+
+	for (k=2; k < objc; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-drop") == 0 && k+1 < objc)
+			drop = objv[++k];
+		else if (strcmp (option,"-order") == 0 && k+1 < objc)
+			order = objv[++k];
+		else if (strcmp (option,"-alter") == 0 && k+1 < objc)
+			alter = objv[++k];
+		else if (strcmp (option,"-output") == 0 && k+1 < objc)
+			output = objv[++k];
+		else {
+			Tcl_SetResult (interp,"restructure: expected -drop list, -order list, -alter list or -output path",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		}
+
+	l = layout_new (di->df);
+	result = layout_fields (interp,di,l,drop,order);
+	if (result == TCL_OK && alter)
+		result = layout_alter (interp,di,l,alter);
+	if (result == TCL_OK)
+		result = layout_apply (interp,di,"restructure",l,output);
+	layout_free (l);
+	return (result);
+	}
+
+/*----------------------------------------------------------------------*\
+ | What the values of each field need, measured on the raw records		|
+\*----------------------------------------------------------------------*/
+
+struct extent {
+	int used;			/* a value that is not NULL was seen */
+	int odd;			/* a number not written as plain digits: keep the field */
+	int width;			/* widest text, or integer part of a number */
+	int decimals;		/* most decimals a number needs */
+	};
+
+struct measure {
+	DBFHandle df;
+	struct extent *extents;
+	};
+
+static void measure_number (struct extent *e, const char *t, int n, int declared) {
+	int k = 0, point = n, digits = 0, last = n, width;
+
+	if (t[0] == '-' || t[0] == '+')
+		k++;
+	for (; k < n; k++)
+		if (t[k] == '.' && point == n)
+			point = k;
+		else if (t[k] >= '0' && t[k] <= '9')
+			digits++;
+		else {
+			e->odd = 1;
+			return;
+			}
+	if (!digits) {
+		e->odd = 1;
+		return;
+		}
+
+	/* Trailing zeros are not needed; an integer part of just a sign is written with a 0 */
+
+	while (last > point + 1 && t[last-1] == '0')
+		last--;
+	if (last > point + 1 && last - point - 1 > e->decimals)
+		e->decimals = last - point - 1;
+	if (e->decimals > declared)
+		e->odd = 1;
+	width = point;
+	if (width == 0 || (width == 1 && (t[0] == '-' || t[0] == '+')))
+		width++;
+	if (width > e->width)
+		e->width = width;
+	}
+
+static int measure_kernel (void *data, int i, const char *record) {
+	struct measure *m = (struct measure *) data;
+	DBFHandle df = m->df;
+	int j, n;
+	(void) i;
+
+	for (j=0; j < df->nFields; j++) {
+		struct extent *e = m->extents + j;
+		char type = df->pachFieldType[j];
+		const char *cell = record + df->panFieldOffset[j];
+		const char *t = field_text (df,record,j,&n);
+
+		if (DBFIsFieldValueNULL (type,t,n,df->panFieldSize[j]))
+			continue;
+		e->used = 1;
+		if (type == 'N' || type == 'F') {
+			if (!e->odd)
+				measure_number (e,t,n,df->panFieldDecimals[j]);
+			}
+		else if (type == 'C' && (int) (t - cell) + n > e->width)
+			e->width = (int) (t - cell) + n;	/* leading blanks are kept */
+		}
+	return (1);
+	}
+
+/* The fields of a layout as the fields command lists them */
+
+static Tcl_Obj *layout_obj (DBFHandle df, struct layout *l) {
+	Tcl_Obj *obj = Tcl_NewListObj (0,NULL);
+	int k;
+
+	for (k=0; k < l->count; k++) {
+		char name[XBASE_FLDNAME_LEN_READ + 1];
+		char native = l->type[k];
+		DBFFieldType type;
+		Tcl_Obj *sub = Tcl_NewListObj (0,NULL);
+
+		if (native == 'L')
+			type = FTLogical;
+		else if (native == 'D')
+			type = FTDate;
+		else if (native == 'N' || native == 'F')
+			type = l->decimals[k] > 0 || l->width[k] >= 10 ? FTDouble : FTInteger;
+		else
+			type = FTString;
+		DBFGetFieldInfo (df,l->source[k],name,NULL,NULL);
+		Tcl_ListObjAppendElement (NULL,sub,Tcl_NewStringObj (name,-1));
+		Tcl_ListObjAppendElement (NULL,sub,Tcl_NewStringObj (dbf_type_of (type),-1));
+		Tcl_ListObjAppendElement (NULL,sub,Tcl_NewStringObj (&native,1));
+		Tcl_ListObjAppendElement (NULL,sub,Tcl_NewIntObj (l->width[k]));
+		Tcl_ListObjAppendElement (NULL,sub,Tcl_NewIntObj (l->decimals[k]));
+		Tcl_ListObjAppendElement (NULL,obj,sub);
+		}
+	return (obj);
+	}
+
+/*----------------------------------------------------------------------*\
+ | optimize [-fields] [-output <path>]									|
+ | Returns the fields of the result; with -fields nothing is written.	|
+\*----------------------------------------------------------------------*/
+
+int optimize_command (Tcl_Interp *interp, struct dbf_info *di, int objc, Tcl_Obj * CONST objv[]) {
+	DBFHandle df = di->df;
+	Tcl_Obj *output = NULL, *fields;
+	struct measure m;
+	struct layout *l;
+	void *data[1];
+	int report = 0, nf = DBFGetFieldCount (df), rc = DBFGetRecordCount (df), count = 0, result, j, k;
+
+	for (k=2; k < objc; k++) {
+		char *option = Tcl_GetString(objv[k]);
+		if (strcmp (option,"-fields") == 0)
+			report = 1;
+		else if (strcmp (option,"-output") == 0 && k+1 < objc)
+			output = objv[++k];
+		else {
+			Tcl_SetResult (interp,"optimize: expected -fields or -output path",TCL_STATIC);
+			return (TCL_ERROR);
+			}
+		}
+	if (report && output) {
+		Tcl_SetResult (interp,"optimize: -fields writes nothing, so it takes no -output",TCL_STATIC);
+		return (TCL_ERROR);
+		}
+
+	m.df = df;
+	m.extents = (struct extent *) ckalloc ((nf > 0 ? nf : 1) * sizeof (struct extent));
+	memset (m.extents,0,(nf > 0 ? nf : 1) * sizeof (struct extent));
+	data[0] = &m;
+	if (rc > 0 && scan_records (interp,di,1,0,rc,measure_kernel,data) < 0) {
+		ckfree ((char *) m.extents);
+		return (TCL_ERROR);
+		}
+
+	/* Fields NULL throughout go, unless none would be left */
+
+	l = layout_new (df);
+	for (j=0; j < nf; j++)
+		if (m.extents[j].used)
+			count++;
+	if (count > 0) {
+		for (j=0, k=0; j < nf; j++) {
+			l->place[j] = m.extents[j].used ? k : -1;
+			if (m.extents[j].used)
+				l->source[k++] = j;
+			}
+		l->count = count;
+		}
+
+	for (k=0; k < l->count; k++) {
+		struct extent *e = m.extents + l->source[k];
+		char type = df->pachFieldType[l->source[k]];
+
+		l->type[k] = type;
+		l->width[k] = df->panFieldSize[l->source[k]];
+		l->decimals[k] = df->panFieldDecimals[l->source[k]];
+		if (!e->used)
+			continue;
+		if ((type == 'N' || type == 'F') && !e->odd) {
+			l->decimals[k] = e->decimals;
+			l->width[k] = e->width + (e->decimals > 0 ? e->decimals + 1 : 0);
+			}
+		else if (type == 'C')
+			l->width[k] = e->width;
+		}
+	ckfree ((char *) m.extents);
+
+	fields = layout_obj (df,l);
+	Tcl_IncrRefCount (fields);
+	result = report ? TCL_OK : layout_apply (interp,di,"optimize",l,output);
+	if (result == TCL_OK)
+		Tcl_SetObjResult (interp,fields);
+	Tcl_DecrRefCount (fields);
+	layout_free (l);
+	return (result);
+	}
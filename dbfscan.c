@@ -0,0 +1,183 @@
+/*----------------------------------------------------------------------*\
+ | Parallel scans for -threads n on select, aggregate and column.  The	|
+ | records are split into n contiguous ranges, one per thread.  Each	|
+ | thread reads its range in blocks through a file handle of its own,	|
+ | or straight from the mapping of a -mmap dbf, so the single file		|
+ | position and current record of the DBFHandle are never touched, and	|
+ | calls the kernel on every record with a state of its own.  Callers	|
+ | merge those states in thread order, which is record order.			|
+ |																		|
+ | Kernels run outside the thread of the interpreter: they may read the	|
+ | field tables of the DBFHandle and compiled predicates, and allocate	|
+ | memory, but must not create Tcl objects or touch the interpreter.	|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+#define SCAN_BLOCK_SIZE 65536	/* bytes each thread reads at a time */
+#define SCAN_MAX_THREADS 256
+
+struct scan_worker {
+	DBFHandle df;
+	SAFile fp;				/* NULL when the dbf is mapped */
+	int first;
+	int count;
+	scan_kernel *kernel;
+	void *data;
+	DBFStats stats;			/* added to those of the DBFHandle after */
+	};
+
+/*----------------------------------------------------------------------*\
+ | Run the kernel over the records of one range.  Records that cannot	|
+ | be read are skipped, as DBFReadTuple makes the serial scans do.		|
+\*----------------------------------------------------------------------*/
+
+static void scan_range (struct scan_worker *w) {
+	DBFHandle df = w->df;
+	int length = df->nRecordLength;
+	int block = SCAN_BLOCK_SIZE / length > 0 ? SCAN_BLOCK_SIZE / length : 1;
+	char *buffer = w->fp ? ckalloc (block * length) : NULL;
+	int i, k, n, got;
+
+	for (i=0; i < w->count; i += n) {
+		SAOffset offset = (SAOffset) df->nHeaderLength + (SAOffset) (w->first + i) * length;
+		const char *records;
+
+		n = w->count - i < block ? w->count - i : block;
+		if (w->fp) {
+			df->sHooks.FSeek (w->fp,offset,0);
+			got = (int) df->sHooks.FRead (buffer,length,n,w->fp);
+			records = buffer;
+			w->stats.nSeeks++;
+			w->stats.nReads++;
+			w->stats.nBytesRead += (SAOffset) got * length;
+			w->stats.nRecordsLoaded += got;
+			}
+		else {
+			got = offset >= df->nMappedSize ? 0 : (int) ((df->nMappedSize - offset) / length);
+			if (got > n)
+				got = n;
+			records = df->pachMapped + offset;
+			w->stats.nRecordsBuffered += got;
+			}
+		for (k=0; k < got; k++)
+			if (!w->kernel (w->data,w->first + i + k,records + k * length)) {
+				got = -1;
+				break;
+				}
+		if (got < n)
+			break;
+		}
+
+	if (buffer)
+		ckfree (buffer);
+	}
+
+static Tcl_ThreadCreateType scan_thread (ClientData client_data) {
+	scan_range ((struct scan_worker *) client_data);
+	Tcl_ExitThread (TCL_OK);
+	TCL_THREAD_CREATE_RETURN;
+	}
+
+/*----------------------------------------------------------------------*\
+ | -threads n: the number of threads, at least one.						|
+\*----------------------------------------------------------------------*/
+
+int scan_threads (Tcl_Interp *interp, const char *command, Tcl_Obj *obj, int *threads) {
+	if (Tcl_GetIntFromObj (NULL,obj,threads) == TCL_ERROR || *threads < 1) {
+		Tcl_ResetResult (interp);
+		Tcl_AppendResult (interp,command,": -threads expects a number of threads of at least 1",NULL);
+		return (TCL_ERROR);
+		}
+	if (*threads > SCAN_MAX_THREADS)
+		*threads = SCAN_MAX_THREADS;
+	return (TCL_OK);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Run kernel over count records from from, in at most threads ranges;	|
+ | data[t] is the state of range t.  Returns the number of ranges used,	|
+ | or -1 with a message in interp if the dbf could not be opened again.	|
+ | A range whose thread cannot be started runs in this thread.			|
+\*----------------------------------------------------------------------*/
+
+int scan_records (Tcl_Interp *interp, struct dbf_info *di, int threads, int from, int count, scan_kernel *kernel, void **data) {
+	DBFHandle df = di->df;
+	struct scan_worker *workers;
+	Tcl_ThreadId *ids;
+	int *started;
+	int t, status;
+
+	if (threads > count)
+		threads = count > 0 ? count : 1;
+
+	/* The threads read the file, which has to hold what the handle buffers */
+
+	if (df->bUpdated && !df->pachMapped)
+		DBFUpdateHeader (df);
+
+	workers = (struct scan_worker *) ckalloc (threads * sizeof (struct scan_worker));
+	ids = (Tcl_ThreadId *) ckalloc (threads * sizeof (Tcl_ThreadId));
+	started = (int *) ckalloc (threads * sizeof (int));
+
+	for (t=0; t < threads; t++) {
+		struct scan_worker *w = workers + t;
+		w->df = df;
+		w->fp = NULL;
+		w->first = from + (int) ((Tcl_WideInt) count * t / threads);
+		w->count = from + (int) ((Tcl_WideInt) count * (t + 1) / threads) - w->first;
+		w->kernel = kernel;
+		w->data = data[t];
+		memset (&w->stats,0,sizeof (DBFStats));
+		started[t] = 0;
+		}
+
+	if (!df->pachMapped) {
+		Tcl_DString native;
+		const char *path = Tcl_UtfToExternalDString (NULL,di->path,-1,&native);
+		for (t=0; t < threads; t++)
+			if (!(workers[t].fp = df->sHooks.FOpen (path,"rb",df->sHooks.pvUserData))) {
+				Tcl_ResetResult (interp);
+				Tcl_AppendResult (interp,"cannot open ",di->path," again to read it in threads",NULL);
+				while (t-- > 0)
+					df->sHooks.FClose (workers[t].fp);
+				Tcl_DStringFree (&native);
+				ckfree ((char *) started);
+				ckfree ((char *) ids);
+				ckfree ((char *) workers);
+				return (-1);
+				}
+		Tcl_DStringFree (&native);
+		}
+
+	/* The first range runs here while the others run in their threads */
+
+	for (t=1; t < threads; t++)
+		started[t] = Tcl_CreateThread (ids + t,scan_thread,(ClientData) (workers + t),TCL_THREAD_STACK_DEFAULT,TCL_THREAD_JOINABLE) == TCL_OK;
+	scan_range (workers);
+	for (t=1; t < threads; t++)
+		if (started[t])
+			Tcl_JoinThread (ids[t],&status);
+		else
+			scan_range (workers + t);
+
+	for (t=0; t < threads; t++) {
+		if (workers[t].fp)
+			df->sHooks.FClose (workers[t].fp);
+		df->sStats.nSeeks += workers[t].stats.nSeeks;
+		df->sStats.nReads += workers[t].stats.nReads;
+		df->sStats.nBytesRead += workers[t].stats.nBytesRead;
+		df->sStats.nRecordsLoaded += workers[t].stats.nRecordsLoaded;
+		df->sStats.nRecordsBuffered += workers[t].stats.nRecordsBuffered;
+		}
+	ckfree ((char *) started);
+	ckfree ((char *) ids);
+	ckfree ((char *) workers);
+	return (threads);
+	}
@@ -0,0 +1,327 @@
+/******************************************************************************
+ *
+ * Project:  Shapelib
+ * Purpose:  Scans over the bytes of .dbf fields (runs of one character,
+ *           pure ASCII) with SSE2 and AVX2 versions chosen at run time.
+ *
+ ******************************************************************************
+ *
+ * SPDX-License-Identifier: MIT OR LGPL-2.0-or-later
+ ******************************************************************************/
+
+#include "shapefil_private.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) &&         \
+    (defined(__clang__) || __GNUC__ >= 5)
+#define DBF_HAVE_SSE2
+#define DBF_HAVE_AVX2
+#define DBF_TARGET_AVX2 __attribute__((target("avx2")))
+/* Inlined into the AVX2 versions, so that their tails are VEX encoded too */
+#define DBF_INLINE inline __attribute__((always_inline))
+#define DBF_CTZ(x) __builtin_ctz(x)
+#define DBF_CLZ(x) __builtin_clz(x)
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || _M_IX86_FP >= 2)
+#define DBF_HAVE_SSE2
+#include <intrin.h>
+#include <emmintrin.h>
+static int DBF_CTZ(unsigned int x)
+{
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return STATIC_CAST(int, i);
+}
+static int DBF_CLZ(unsigned int x)
+{
+    unsigned long i;
+    _BitScanReverse(&i, x);
+    return 31 - STATIC_CAST(int, i);
+}
+#endif
+
+#if defined(DBF_HAVE_SSE2) && !defined(__SSE2__) && !defined(_MSC_VER)
+/* 32 bit builds without -msse2 */
+#undef DBF_HAVE_SSE2
+#undef DBF_HAVE_AVX2
+#endif
+
+#ifndef DBF_INLINE
+#define DBF_INLINE
+#endif
+
+/************************************************************************/
+/*                          Scalar versions                             */
+/*                                                                      */
+/*      Eight bytes at a time where they can be compared as a word.     */
+/************************************************************************/
+
+static DBF_INLINE int DBFSpanCharScalar(const char *pachValue, int nLength,
+                                        char chValue)
+{
+    const uint64_t nPattern =
+        0x0101010101010101ULL * STATIC_CAST(unsigned char, chValue);
+    int i = 0;
+
+    for (; i + 8 <= nLength; i += 8)
+    {
+        uint64_t nWord;
+        memcpy(&nWord, pachValue + i, 8);
+        if (nWord != nPattern)
+            break;
+    }
+    while (i < nLength && pachValue[i] == chValue)
+        i++;
+    return i;
+}
+
+static DBF_INLINE int DBFSpanCharReverseScalar(const char *pachValue,
+                                               int nLength, char chValue)
+{
+    const uint64_t nPattern =
+        0x0101010101010101ULL * STATIC_CAST(unsigned char, chValue);
+    int i = nLength;
+
+    for (; i >= 8; i -= 8)
+    {
+        uint64_t nWord;
+        memcpy(&nWord, pachValue + i - 8, 8);
+        if (nWord != nPattern)
+            break;
+    }
+    while (i > 0 && pachValue[i - 1] == chValue)
+        i--;
+    return nLength - i;
+}
+
+static DBF_INLINE int DBFIsASCIIScalar(const char *pachValue, int nLength)
+{
+    int i = 0;
+
+    for (; i + 8 <= nLength; i += 8)
+    {
+        uint64_t nWord;
+        memcpy(&nWord, pachValue + i, 8);
+        if (nWord & 0x8080808080808080ULL)
+            return 0;
+    }
+    for (; i < nLength; i++)
+        if (pachValue[i] & 0x80)
+            return 0;
+    return 1;
+}
+
+/************************************************************************/
+/*                           SSE2 versions                              */
+/************************************************************************/
+
+#ifdef DBF_HAVE_SSE2
+
+static DBF_INLINE int DBFSpanCharSSE2(const char *pachValue, int nLength,
+                                      char chValue)
+{
+    const __m128i vPattern = _mm_set1_epi8(chValue);
+    int i = 0;
+
+    for (; i + 16 <= nLength; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(
+            REINTERPRET_CAST(const __m128i *, pachValue + i));
+        const unsigned int nMask = STATIC_CAST(
+            unsigned int, _mm_movemask_epi8(_mm_cmpeq_epi8(v, vPattern)));
+        if (nMask != 0xFFFF)
+            return i + DBF_CTZ(~nMask);
+    }
+    return i + DBFSpanCharScalar(pachValue + i, nLength - i, chValue);
+}
+
+static DBF_INLINE int DBFSpanCharReverseSSE2(const char *pachValue,
+                                             int nLength, char chValue)
+{
+    const __m128i vPattern = _mm_set1_epi8(chValue);
+    int i = nLength;
+
+    for (; i >= 16; i -= 16)
+    {
+        const __m128i v = _mm_loadu_si128(
+            REINTERPRET_CAST(const __m128i *, pachValue + i - 16));
+        const unsigned int nMask = STATIC_CAST(
+            unsigned int, _mm_movemask_epi8(_mm_cmpeq_epi8(v, vPattern)));
+        if (nMask != 0xFFFF)
+            return nLength - i + (DBF_CLZ(~nMask & 0xFFFF) - 16);
+    }
+    return nLength - i + DBFSpanCharReverseScalar(pachValue, i, chValue);
+}
+
+static DBF_INLINE int DBFIsASCIISSE2(const char *pachValue, int nLength)
+{
+    int i = 0;
+
+    for (; i + 16 <= nLength; i += 16)
+    {
+        const __m128i v = _mm_loadu_si128(
+            REINTERPRET_CAST(const __m128i *, pachValue + i));
+        if (_mm_movemask_epi8(v))
+            return 0;
+    }
+    return DBFIsASCIIScalar(pachValue + i, nLength - i);
+}
+
+#endif /* DBF_HAVE_SSE2 */
+
+/************************************************************************/
+/*                           AVX2 versions                              */
+/************************************************************************/
+
+#ifdef DBF_HAVE_AVX2
+
+DBF_TARGET_AVX2 static int DBFSpanCharAVX2(const char *pachValue, int nLength,
+                                           char chValue)
+{
+    const __m256i vPattern = _mm256_set1_epi8(chValue);
+    int i = 0;
+
+    for (; i + 32 <= nLength; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(
+            REINTERPRET_CAST(const __m256i *, pachValue + i));
+        const unsigned int nMask = STATIC_CAST(
+            unsigned int, _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vPattern)));
+        if (nMask != 0xFFFFFFFFU)
+            return i + DBF_CTZ(~nMask);
+    }
+    return i + DBFSpanCharSSE2(pachValue + i, nLength - i, chValue);
+}
+
+DBF_TARGET_AVX2 static int DBFSpanCharReverseAVX2(const char *pachValue,
+                                                  int nLength, char chValue)
+{
+    const __m256i vPattern = _mm256_set1_epi8(chValue);
+    int i = nLength;
+
+    for (; i >= 32; i -= 32)
+    {
+        const __m256i v = _mm256_loadu_si256(
+            REINTERPRET_CAST(const __m256i *, pachValue + i - 32));
+        const unsigned int nMask = STATIC_CAST(
+            unsigned int, _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vPattern)));
+        if (nMask != 0xFFFFFFFFU)
+            return nLength - i + DBF_CLZ(~nMask);
+    }
+    return nLength - i + DBFSpanCharReverseSSE2(pachValue, i, chValue);
+}
+
+DBF_TARGET_AVX2 static int DBFIsASCIIAVX2(const char *pachValue, int nLength)
+{
+    int i = 0;
+
+    for (; i + 32 <= nLength; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(
+            REINTERPRET_CAST(const __m256i *, pachValue + i));
+        if (_mm256_movemask_epi8(v))
+            return 0;
+    }
+    return DBFIsASCIISSE2(pachValue + i, nLength - i);
+}
+
+#endif /* DBF_HAVE_AVX2 */
+
+/************************************************************************/
+/*                          Run time dispatch                           */
+/*                                                                      */
+/*      The first call picks the best version the processor runs and    */
+/*      later calls go straight to it.  Every thread that races on the  */
+/*      first call stores the same pointers.                            */
+/************************************************************************/
+
+typedef int (*DBFSpanCharFunc)(const char *, int, char);
+typedef int (*DBFIsASCIIFunc)(const char *, int);
+
+static int DBFSpanCharInit(const char *pachValue, int nLength, char chValue);
+static int DBFSpanCharReverseInit(const char *pachValue, int nLength,
+                                  char chValue);
+static int DBFIsASCIIInit(const char *pachValue, int nLength);
+
+static DBFSpanCharFunc pfnSpanChar = DBFSpanCharInit;
+static DBFSpanCharFunc pfnSpanCharReverse = DBFSpanCharReverseInit;
+static DBFIsASCIIFunc pfnIsASCII = DBFIsASCIIInit;
+
+static void DBFSelectKernels(void)
+{
+#if defined(DBF_HAVE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        pfnSpanCharReverse = DBFSpanCharReverseAVX2;
+        pfnIsASCII = DBFIsASCIIAVX2;
+        pfnSpanChar = DBFSpanCharAVX2;
+        return;
+    }
+#endif
+#if defined(DBF_HAVE_SSE2)
+    pfnSpanCharReverse = DBFSpanCharReverseSSE2;
+    pfnIsASCII = DBFIsASCIISSE2;
+    pfnSpanChar = DBFSpanCharSSE2;
+#else
+    pfnSpanCharReverse = DBFSpanCharReverseScalar;
+    pfnIsASCII = DBFIsASCIIScalar;
+    pfnSpanChar = DBFSpanCharScalar;
+#endif
+}
+
+static int DBFSpanCharInit(const char *pachValue, int nLength, char chValue)
+{
+    DBFSelectKernels();
+    return pfnSpanChar(pachValue, nLength, chValue);
+}
+
+static int DBFSpanCharReverseInit(const char *pachValue, int nLength,
+                                  char chValue)
+{
+    DBFSelectKernels();
+    return pfnSpanCharReverse(pachValue, nLength, chValue);
+}
+
+static int DBFIsASCIIInit(const char *pachValue, int nLength)
+{
+    DBFSelectKernels();
+    return pfnIsASCII(pachValue, nLength);
+}
+
+/************************************************************************/
+/*                            DBFSpanChar()                             */
+/*                                                                      */
+/*      Return the number of bytes at the start of pachValue that are   */
+/*      chValue, e.g. nLength if a field is all blanks.                 */
+/************************************************************************/
+
+int SHPAPI_CALL DBFSpanChar(const char *pachValue, int nLength, char chValue)
+{
+    return pfnSpanChar(pachValue, nLength, chValue);
+}
+
+/************************************************************************/
+/*                        DBFSpanCharReverse()                          */
+/*                                                                      */
+/*      Return the number of bytes at the end of pachValue that are     */
+/*      chValue.                                                        */
+/************************************************************************/
+
+int SHPAPI_CALL DBFSpanCharReverse(const char *pachValue, int nLength,
+                                   char chValue)
+{
+    return pfnSpanCharReverse(pachValue, nLength, chValue);
+}
+
+/************************************************************************/
+/*                             DBFIsASCII()                             */
+/*                                                                      */
+/*      Return 1 if no byte of pachValue has its high bit set, else 0.  */
+/************************************************************************/
+
+int SHPAPI_CALL DBFIsASCII(const char *pachValue, int nLength)
+{
+    return pfnIsASCII(pachValue, nLength);
+}
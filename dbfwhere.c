@@ -0,0 +1,446 @@
+/*----------------------------------------------------------------------*\
+ | Predicates for select and foreach -where.  A predicate is a Tcl list	|
+ | compiled once into a tree of tests that run on the raw bytes of each	|
+ | record, without making Tcl objects for the fields.					|
+ |																		|
+ | {field op value}		op is one of == != < <= > >=					|
+ | {field between low high}												|
+ | {field in {value ...}}												|
+ | {field prefix text}													|
+ | {field glob pattern}													|
+ | {field null} {field notnull}											|
+ | {deleted}															|
+ | {and pred ...} {or pred ...} {not pred}								|
+ |																		|
+ | N and F fields compare as numbers, L fields as booleans and all		|
+ | other fields as text, dates as YYYYMMDD.  A NULL value matches only	|
+ | null.  Text is compared byte by byte in the encoding of the file.	|
+\*----------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tcl.h>
+
+#include "dbf_private.h"
+
+enum where_op { W_AND, W_OR, W_NOT, W_DELETED, W_NULL, W_NOTNULL, W_COMPARE, W_BETWEEN, W_IN, W_PREFIX, W_GLOB };
+enum where_cmp { C_EQ, C_NE, C_LT, C_LE, C_GT, C_GE };
+enum where_kind { K_NUMBER, K_TEXT, K_LOGICAL };
+
+struct text {
+	char *bytes;
+	int length;
+	};
+
+struct where {
+	enum where_op op;
+	enum where_cmp cmp;
+	enum where_kind kind;
+	DBFHandle df;
+	int field;
+	double number[2];		/* compare and between */
+	struct text text[2];
+	int count;				/* values of in, children of and, or, not */
+	double *numbers;		/* in, sorted */
+	struct text *texts;		/* in, sorted */
+	struct where **children;
+	};
+
+static char *cmp_names[] = {"==", "!=", "<", "<=", ">", ">=", NULL};
+
+static int compare_text (const char *a, int a_length, const char *b, int b_length) {
+	int c = memcmp (a,b,a_length < b_length ? a_length : b_length);
+	return (c ? c : a_length - b_length);
+	}
+
+static int sort_text (const void *a, const void *b) {
+	const struct text *x = (const struct text *) a;
+	const struct text *y = (const struct text *) b;
+	return (compare_text (x->bytes,x->length,y->bytes,y->length));
+	}
+
+static int sort_number (const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x < y ? -1 : x > y);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Trimmed text of the field, "T" or "F" for logical fields, or NULL	|
+ | if the value is NULL.												|
+\*----------------------------------------------------------------------*/
+
+static const char *where_text (struct where *w, const char *record, int *length) {
+	DBFHandle df = w->df;
+	char type = df->pachFieldType[w->field];
+	const char *t = field_text (df,record,w->field,length);
+
+	if (DBFIsFieldValueNULL (type,t,*length,df->panFieldSize[w->field]))
+		return (NULL);
+	if (w->kind == K_LOGICAL) {
+		*length = 1;
+		if (*t && strchr ("TtYy",*t)) return ("T");
+		if (*t && strchr ("FfNn",*t)) return ("F");
+		return (NULL);
+		}
+	return (t);
+	}
+
+static int where_number (struct where *w, const char *record, double *value) {
+	int n;
+	const char *t = where_text (w,record,&n);
+
+	return (t && DBFParseDouble (t,n,value));
+	}
+
+static int compare_result (enum where_cmp cmp, int c) {
+	switch (cmp) {
+		case C_EQ: return (c == 0);
+		case C_NE: return (c != 0);
+		case C_LT: return (c < 0);
+		case C_LE: return (c <= 0);
+		case C_GT: return (c > 0);
+		case C_GE: return (c >= 0);
+		}
+	return (0);
+	}
+
+int where_match (struct where *w, const char *record) {
+	const char *t;
+	double d;
+	int i, n;
+
+	switch (w->op) {
+		case W_AND:
+			for (i=0; i < w->count; i++)
+				if (!where_match (w->children[i],record))
+					return (0);
+			return (1);
+		case W_OR:
+			for (i=0; i < w->count; i++)
+				if (where_match (w->children[i],record))
+					return (1);
+			return (0);
+		case W_NOT:
+			return (!where_match (w->children[0],record));
+		case W_DELETED:
+			return (record[0] == '*');
+		case W_NULL:
+			return (where_text (w,record,&n) == NULL);
+		case W_NOTNULL:
+			return (where_text (w,record,&n) != NULL);
+		case W_PREFIX:
+			t = where_text (w,record,&n);
+			return (t && n >= w->text[0].length && memcmp (t,w->text[0].bytes,w->text[0].length) == 0);
+		case W_GLOB:
+			{
+			Tcl_DString value;	/* C fields may be wider than 255 bytes */
+			int match;
+			if (!(t = where_text (w,record,&n)))
+				return (0);
+			Tcl_DStringInit (&value);
+			match = Tcl_StringCaseMatch (Tcl_DStringAppend (&value,t,n),w->text[0].bytes,0);
+			Tcl_DStringFree (&value);
+			return (match);
+			}
+		case W_COMPARE:
+		case W_BETWEEN:
+		case W_IN:
+			break;
+		}
+
+	if (w->kind == K_NUMBER) {
+		if (!where_number (w,record,&d))
+			return (0);
+		if (w->op == W_COMPARE)
+			return (compare_result (w->cmp,(d > w->number[0]) - (d < w->number[0])));
+		if (w->op == W_BETWEEN)
+			return (d >= w->number[0] && d <= w->number[1]);
+		{
+		int low = 0, high = w->count - 1;
+		while (low <= high) {
+			int middle = (low + high) / 2;
+			if (w->numbers[middle] == d) return (1);
+			if (w->numbers[middle] < d) low = middle + 1;
+			else high = middle - 1;
+			}
+		return (0);
+		}
+		}
+
+	if (!(t = where_text (w,record,&n)))
+		return (0);
+	if (w->op == W_COMPARE)
+		return (compare_result (w->cmp,compare_text (t,n,w->text[0].bytes,w->text[0].length)));
+	if (w->op == W_BETWEEN)
+		return (compare_text (t,n,w->text[0].bytes,w->text[0].length) >= 0 && compare_text (t,n,w->text[1].bytes,w->text[1].length) <= 0);
+	{
+	int low = 0, high = w->count - 1;
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		int c = compare_text (w->texts[middle].bytes,w->texts[middle].length,t,n);
+		if (c == 0) return (1);
+		if (c < 0) low = middle + 1;
+		else high = middle - 1;
+		}
+	return (0);
+	}
+	}
+
+/*----------------------------------------------------------------------*\
+ | 1 if no record can match whose numeric fields hold values within		|
+ | the bounds zone gives for them: from low to high, or none at all		|
+ | (zone returns 0), or unknown (zone returns -1).  NULL values and		|
+ | values that are not numbers never match a numeric test, so only the	|
+ | numbers count.  Used to skip blocks of records by their zone maps.	|
+\*----------------------------------------------------------------------*/
+
+int where_excludes (struct where *w, where_zone *zone, void *data) {
+	double low, high;
+	int i, known;
+
+	switch (w->op) {
+		case W_AND:
+			for (i=0; i < w->count; i++)
+				if (where_excludes (w->children[i],zone,data))
+					return (1);
+			return (0);
+		case W_OR:
+			for (i=0; i < w->count; i++)
+				if (!where_excludes (w->children[i],zone,data))
+					return (0);
+			return (1);
+		case W_COMPARE:
+		case W_BETWEEN:
+		case W_IN:
+			if (w->kind == K_NUMBER)
+				break;
+			return (0);
+		default:
+			return (0);
+		}
+
+	if ((known = zone (data,w->field,&low,&high)) <= 0)
+		return (known == 0);
+
+	if (w->op == W_COMPARE)
+		switch (w->cmp) {
+			case C_EQ: return (w->number[0] < low || w->number[0] > high);
+			case C_NE: return (low == w->number[0] && high == w->number[0]);
+			case C_LT: return (low >= w->number[0]);
+			case C_LE: return (low > w->number[0]);
+			case C_GT: return (high <= w->number[0]);
+			case C_GE: return (high < w->number[0]);
+			}
+	if (w->op == W_BETWEEN)
+		return (high < w->number[0] || low > w->number[1]);
+	for (i=0; i < w->count; i++)
+		if (w->numbers[i] >= low && w->numbers[i] <= high)
+			return (0);
+	return (1);
+	}
+
+void where_free (struct where *w) {
+	int i;
+
+	if (!w)
+		return;
+	if (w->children) {
+		for (i=0; i < w->count; i++)
+			where_free (w->children[i]);
+		ckfree ((char *) w->children);
+		}
+	if (w->texts) {
+		for (i=0; i < w->count; i++)
+			ckfree (w->texts[i].bytes);
+		ckfree ((char *) w->texts);
+		}
+	if (w->numbers)
+		ckfree ((char *) w->numbers);
+	for (i=0; i < 2; i++)
+		if (w->text[i].bytes)
+			ckfree (w->text[i].bytes);
+	ckfree ((char *) w);
+	}
+
+/*----------------------------------------------------------------------*\
+ | Convert a value of the predicate to the form it is compared in.		|
+\*----------------------------------------------------------------------*/
+
+static int where_value (Tcl_Interp *interp, struct dbf_info *di, struct where *w, Tcl_Obj *obj, double *number, struct text *text) {
+	if (w->kind == K_NUMBER) {
+		if (Tcl_GetDoubleFromObj (NULL,obj,number) == TCL_OK)
+			return (TCL_OK);
+		Tcl_SetResult (interp,"where: expected a number but got \"",TCL_STATIC);
+		Tcl_AppendResult (interp,Tcl_GetString(obj),"\"",NULL);
+		return (TCL_ERROR);
+		}
+
+	if (w->kind == K_LOGICAL) {
+		int b;
+		if (Tcl_GetBooleanFromObj (NULL,obj,&b) != TCL_OK) {
+			Tcl_SetResult (interp,"where: expected a boolean but got \"",TCL_STATIC);
+			Tcl_AppendResult (interp,Tcl_GetString(obj),"\"",NULL);
+			return (TCL_ERROR);
+			}
+		text->bytes = ckalloc (2);
+		strcpy (text->bytes,b ? "T" : "F");
+		text->length = 1;
+		return (TCL_OK);
+		}
+
+	{
+	Tcl_DString e;
+	int length;
+	char *value = Tcl_GetStringFromObj (obj,&length);
+	utf_to_external (di,value,length,&e);
+	text->length = Tcl_DStringLength(&e);
+	text->bytes = ckalloc (text->length + 1);
+	memcpy (text->bytes,Tcl_DStringValue(&e),text->length + 1);
+	Tcl_DStringFree(&e);
+	}
+	return (TCL_OK);
+	}
+
+static int where_error (Tcl_Interp *interp, const char *message, Tcl_Obj *predicate) {
+	Tcl_SetResult (interp,"where: ",TCL_STATIC);
+	Tcl_AppendResult (interp,message," in {",Tcl_GetString(predicate),"}",NULL);
+	return (TCL_ERROR);
+	}
+
+static int compile (Tcl_Interp *interp, struct dbf_info *di, Tcl_Obj *predicate, struct where *w) {
+	DBFHandle df = di->df;
+	Tcl_Obj **objv;
+	char *word, *op;
+	char type;
+	int objc, i;
+
+	if (Tcl_ListObjGetElements (interp,predicate,&objc,&objv) == TCL_ERROR)
+		return (TCL_ERROR);
+	if (objc == 0)
+		return (where_error (interp,"empty predicate",predicate));
+
+	word = Tcl_GetString(objv[0]);
+	w->df = df;
+
+	/* and, or, not */
+
+	if (strcmp (word,"and") == 0 || strcmp (word,"or") == 0 || strcmp (word,"not") == 0) {
+		w->op = *word == 'a' ? W_AND : *word == 'o' ? W_OR : W_NOT;
+		if (w->op == W_NOT && objc != 2)
+			return (where_error (interp,"not expects one predicate",predicate));
+		w->children = (struct where **) ckalloc ((objc > 1 ? objc - 1 : 1) * sizeof (struct where *));
+		for (i=1; i < objc; i++) {
+			w->children[i-1] = (struct where *) ckalloc (sizeof (struct where));
+			memset (w->children[i-1],0,sizeof (struct where));
+			w->count = i;
+			if (compile (interp,di,objv[i],w->children[i-1]) == TCL_ERROR)
+				return (TCL_ERROR);
+			}
+		return (TCL_OK);
+		}
+
+	if (strcmp (word,"deleted") == 0 && objc == 1) {
+		w->op = W_DELETED;
+		return (TCL_OK);
+		}
+
+	/* field tests */
+
+	if ((w->field = get_field_index (di,objv[0])) == -1) {
+		Tcl_SetResult (interp,"where: ",TCL_STATIC);
+		Tcl_AppendResult (interp,word," does not match a field name in this dbf file",NULL);
+		return (TCL_ERROR);
+		}
+	if (objc < 2)
+		return (where_error (interp,"expected an operator after the field name",predicate));
+
+	type = df->pachFieldType[w->field];
+	w->kind = (type == 'N' || type == 'F') ? K_NUMBER : type == 'L' ? K_LOGICAL : K_TEXT;
+	op = Tcl_GetString(objv[1]);
+
+	if (strcmp (op,"null") == 0 || strcmp (op,"notnull") == 0) {
+		if (objc != 2)
+			return (where_error (interp,"null and notnull take no value",predicate));
+		w->op = *op == 'n' && op[1] == 'u' ? W_NULL : W_NOTNULL;
+		return (TCL_OK);
+		}
+
+	if (strcmp (op,"prefix") == 0 || strcmp (op,"glob") == 0) {
+		if (objc != 3)
+			return (where_error (interp,"prefix and glob take one value",predicate));
+		w->op = *op == 'p' ? W_PREFIX : W_GLOB;
+		w->kind = K_TEXT;
+		if (type == 'L')
+			w->kind = K_LOGICAL;
+		return (where_value (interp,di,w,objv[2],NULL,&w->text[0]));
+		}
+
+	if (w->kind == K_LOGICAL && strcmp (op,"==") && strcmp (op,"!=") && strcmp (op,"in"))
+		return (where_error (interp,"logical fields take only ==, !=, in, null and notnull",predicate));
+
+	if (strcmp (op,"between") == 0) {
+		if (objc != 4)
+			return (where_error (interp,"between takes a low and a high value",predicate));
+		w->op = W_BETWEEN;
+		for (i=0; i < 2; i++)
+			if (where_value (interp,di,w,objv[2+i],&w->number[i],&w->text[i]) == TCL_ERROR)
+				return (TCL_ERROR);
+		return (TCL_OK);
+		}
+
+	if (strcmp (op,"in") == 0) {
+		Tcl_Obj **value_objv;
+		int value_objc;
+
+		if (objc != 3)
+			return (where_error (interp,"in takes a list of values",predicate));
+		if (Tcl_ListObjGetElements (interp,objv[2],&value_objc,&value_objv) == TCL_ERROR)
+			return (TCL_ERROR);
+		w->op = W_IN;
+		if (w->kind == K_NUMBER) {
+			w->numbers = (double *) ckalloc ((value_objc > 0 ? value_objc : 1) * sizeof (double));
+			for (i=0; i < value_objc; i++)
+				if (where_value (interp,di,w,value_objv[i],&w->numbers[i],NULL) == TCL_ERROR)
+					return (TCL_ERROR);
+			w->count = value_objc;
+			qsort (w->numbers,w->count,sizeof (double),sort_number);
+			}
+		else {
+			w->texts = (struct text *) ckalloc ((value_objc > 0 ? value_objc : 1) * sizeof (struct text));
+			for (i=0; i < value_objc; i++) {
+				if (where_value (interp,di,w,value_objv[i],NULL,&w->texts[i]) == TCL_ERROR)
+					return (TCL_ERROR);
+				w->count = i + 1;
+				}
+			qsort (w->texts,w->count,sizeof (struct text),sort_text);
+			}
+		return (TCL_OK);
+		}
+
+	for (i=0; cmp_names[i]; i++)
+		if (strcmp (op,cmp_names[i]) == 0) {
+			if (objc != 3)
+				return (where_error (interp,"comparisons take one value",predicate));
+			w->op = W_COMPARE;
+			w->cmp = (enum where_cmp) i;
+			return (where_value (interp,di,w,objv[2],&w->number[0],&w->text[0]));
+			}
+
+	return (where_error (interp,"unknown operator",predicate));
+	}
+
+int where_compile (Tcl_Interp *interp, struct dbf_info *di, Tcl_Obj *predicate, struct where **where) {
+	struct where *w = (struct where *) ckalloc (sizeof (struct where));
+
+	memset (w,0,sizeof (struct where));
+	if (compile (interp,di,predicate,w) == TCL_ERROR) {
+		where_free (w);
+		*where = NULL;
+		return (TCL_ERROR);
+		}
+	*where = w;
+	return (TCL_OK);
+	}
@@ -31,6 +31,13 @@
 #endif
 #endif
 
+#ifndef SHPAPI_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static SAFile SADFOpen(const char *pszFilename, const char *pszAccess,
                        void *pvUserData)
 {
@@ -102,6 +109,188 @@ void SASetupDefaultHooks(SAHooks *psHooks)
     psHooks->Error = SADError;
     psHooks->Atof = atof;
     psHooks->pvUserData = SHPLIB_NULLPTR;
+    psHooks->FMap = SHPLIB_NULLPTR;
+}
+
+/************************************************************************/
+/*                        Memory mapped file io.                        */
+/*                                                                      */
+/*      The whole file is mapped read-only when it is opened, reads     */
+/*      are served by copying from the mapping, and FMap() exposes      */
+/*      the mapping so that callers can avoid even that copy.           */
+/************************************************************************/
+
+typedef struct
+{
+    char *pabyData;
+    SAOffset nSize;
+    SAOffset nOffset;
+} SAMappedFile;
+
+static SAFile SAMFOpen(const char *pszFilename, const char *pszAccess,
+                       void *pvUserData)
+{
+    (void)pvUserData;
+
+    if (strchr(pszAccess, 'w') != SHPLIB_NULLPTR ||
+        strchr(pszAccess, 'a') != SHPLIB_NULLPTR ||
+        strchr(pszAccess, '+') != SHPLIB_NULLPTR)
+        return SHPLIB_NULLPTR;
+
+    SAMappedFile *psFile =
+        STATIC_CAST(SAMappedFile *, calloc(1, sizeof(SAMappedFile)));
+    if (psFile == SHPLIB_NULLPTR)
+        return SHPLIB_NULLPTR;
+
+#ifdef SHPAPI_WINDOWS
+    HANDLE hFile = CreateFileA(pszFilename, GENERIC_READ,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE,
+                               SHPLIB_NULLPTR, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, SHPLIB_NULLPTR);
+    LARGE_INTEGER nSize;
+    if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &nSize))
+    {
+        if (hFile != INVALID_HANDLE_VALUE)
+            CloseHandle(hFile);
+        free(psFile);
+        return SHPLIB_NULLPTR;
+    }
+    psFile->nSize = STATIC_CAST(SAOffset, nSize.QuadPart);
+    if (psFile->nSize > 0)
+    {
+        HANDLE hMapping = CreateFileMappingA(hFile, SHPLIB_NULLPTR,
+                                             PAGE_READONLY, 0, 0,
+                                             SHPLIB_NULLPTR);
+        if (hMapping != SHPLIB_NULLPTR)
+        {
+            psFile->pabyData = STATIC_CAST(
+                char *, MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(hMapping);
+        }
+    }
+    CloseHandle(hFile);
+#else
+    const int fd = open(pszFilename, O_RDONLY);
+    struct stat sStat;
+    if (fd < 0 || fstat(fd, &sStat) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        free(psFile);
+        return SHPLIB_NULLPTR;
+    }
+    psFile->nSize = STATIC_CAST(SAOffset, sStat.st_size);
+    if (psFile->nSize > 0)
+    {
+        void *pData = mmap(SHPLIB_NULLPTR, STATIC_CAST(size_t, psFile->nSize),
+                           PROT_READ, MAP_SHARED, fd, 0);
+        if (pData != MAP_FAILED)
+            psFile->pabyData = STATIC_CAST(char *, pData);
+    }
+    close(fd);
+#endif
+
+    if (psFile->nSize > 0 && psFile->pabyData == SHPLIB_NULLPTR)
+    {
+        free(psFile);
+        return SHPLIB_NULLPTR;
+    }
+
+    return REINTERPRET_CAST(SAFile, psFile);
+}
+
+static SAOffset SAMFRead(void *p, SAOffset size, SAOffset nmemb, SAFile file)
+{
+    SAMappedFile *psFile = REINTERPRET_CAST(SAMappedFile *, file);
+
+    if (size == 0 || psFile->nOffset >= psFile->nSize)
+        return 0;
+
+    SAOffset nCount = (psFile->nSize - psFile->nOffset) / size;
+    if (nCount > nmemb)
+        nCount = nmemb;
+
+    memcpy(p, psFile->pabyData + psFile->nOffset,
+           STATIC_CAST(size_t, size * nCount));
+    psFile->nOffset += size * nCount;
+
+    return nCount;
+}
+
+static SAOffset SAMFWrite(const void *p, SAOffset size, SAOffset nmemb,
+                          SAFile file)
+{
+    (void)p;
+    (void)size;
+    (void)nmemb;
+    (void)file;
+    return 0;
+}
+
+static SAOffset SAMFSeek(SAFile file, SAOffset offset, int whence)
+{
+    SAMappedFile *psFile = REINTERPRET_CAST(SAMappedFile *, file);
+
+    if (whence == SEEK_SET)
+        psFile->nOffset = offset;
+    else if (whence == SEEK_CUR)
+        psFile->nOffset += offset;
+    else if (whence == SEEK_END)
+        psFile->nOffset = psFile->nSize + offset;
+    else
+        return STATIC_CAST(SAOffset, -1);
+
+    return 0;
+}
+
+static SAOffset SAMFTell(SAFile file)
+{
+    return REINTERPRET_CAST(SAMappedFile *, file)->nOffset;
+}
+
+static int SAMFFlush(SAFile file)
+{
+    (void)file;
+    return 0;
+}
+
+static int SAMFClose(SAFile file)
+{
+    SAMappedFile *psFile = REINTERPRET_CAST(SAMappedFile *, file);
+
+    if (psFile->pabyData != SHPLIB_NULLPTR)
+    {
+#ifdef SHPAPI_WINDOWS
+        UnmapViewOfFile(psFile->pabyData);
+#else
+        munmap(psFile->pabyData, STATIC_CAST(size_t, psFile->nSize));
+#endif
+    }
+    free(psFile);
+
+    return 0;
+}
+
+static const char *SAMFMap(SAFile file, SAOffset *pnSize)
+{
+    SAMappedFile *psFile = REINTERPRET_CAST(SAMappedFile *, file);
+
+    *pnSize = psFile->nSize;
+    return psFile->pabyData;
+}
+
+void SASetupMmapHooks(SAHooks *psHooks)
+{
+    SASetupDefaultHooks(psHooks);
+
+    psHooks->FOpen = SAMFOpen;
+    psHooks->FRead = SAMFRead;
+    psHooks->FWrite = SAMFWrite;
+    psHooks->FSeek = SAMFSeek;
+    psHooks->FTell = SAMFTell;
+    psHooks->FFlush = SAMFFlush;
+    psHooks->FClose = SAMFClose;
+    psHooks->FMap = SAMFMap;
 }
 
 #ifdef SHPAPI_WINDOWS
@@ -183,5 +372,6 @@ void SASetupUtf8Hooks(SAHooks *psHooks)
     psHooks->Error = SADError;
     psHooks->Atof = atof;
     psHooks->pvUserData = SHPLIB_NULLPTR;
+    psHooks->FMap = SHPLIB_NULLPTR;
 }
 #endif
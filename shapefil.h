@@ -17,6 +17,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef USE_CPL
 #include "cpl_conv.h"
@@ -149,9 +150,15 @@ extern "C"
         void (*Error)(const char *message);
         double (*Atof)(const char *str);
         void *pvUserData;
+
+        /* Optional: return the read-only memory image of an open file */
+        /* and its size, or NULL if the file is not mapped. */
+        const char *(*FMap)(SAFile file, SAOffset *pnSize);
     } SAHooks;
 
     void SHPAPI_CALL SASetupDefaultHooks(SAHooks *psHooks);
+    /* Read-only hooks serving reads from a memory mapping of the file */
+    void SHPAPI_CALL SASetupMmapHooks(SAHooks *psHooks);
 #ifdef SHPAPI_UTF8_HOOKS
     void SHPAPI_CALL SASetupUtf8Hooks(SAHooks *psHooks);
 #endif
@@ -419,6 +426,23 @@ extern "C"
     /************************************************************************/
     /*                             DBF Support.                             */
     /************************************************************************/
+    typedef struct DBFCacheInfo DBFCacheInfo;
+    typedef struct DBFAppendInfo DBFAppendInfo;
+
+    /* Counters of the work done on a handle, since it was opened or the */
+    /* caller last cleared them. */
+    typedef struct
+    {
+        SAOffset nSeeks;
+        SAOffset nReads;
+        SAOffset nWrites;
+        SAOffset nBytesRead;
+        SAOffset nBytesWritten;
+        SAOffset nRecordsLoaded;   /* record reads that went to the file */
+        SAOffset nRecordsBuffered; /* record reads served from memory */
+        SAOffset nFlushes;         /* buffered changes written out */
+    } DBFStats;
+
     typedef struct
     {
         SAHooks sHooks;
@@ -465,6 +489,18 @@ extern "C"
         int bWriteEndOfFileChar; /* defaults to TRUE */
 
         int bRequireNextWriteSeek;
+
+        const char *pachMapped; /* File image if the hooks mapped it */
+        SAOffset nMappedSize;
+
+        DBFCacheInfo *psCache; /* Record block cache, NULL if disabled */
+
+        int *panFieldHash; /* Field name index, built on first lookup */
+        int nFieldHashSize;
+
+        DBFAppendInfo *psAppend; /* Append buffer, NULL if disabled */
+
+        DBFStats sStats;
     } DBFInfo;
 
     typedef DBFInfo *DBFHandle;
@@ -536,6 +572,28 @@ extern "C"
                                              int iField);
     int SHPAPI_CALL DBFIsAttributeNULL(const DBFHandle hDBF, int iShape,
                                        int iField);
+    int SHPAPI_CALL DBFIsFieldValueNULL(char chType, const char *pachValue,
+                                        int nLength, int nWidth);
+    int SHPAPI_CALL DBFSpanChar(const char *pachValue, int nLength,
+                                char chValue);
+    int SHPAPI_CALL DBFSpanCharReverse(const char *pachValue, int nLength,
+                                       char chValue);
+    int SHPAPI_CALL DBFIsASCII(const char *pachValue, int nLength);
+    int SHPAPI_CALL DBFFormatDouble(char *pszBuffer, int nWidth, int nDecimals,
+                                    double dValue);
+    void SHPAPI_CALL DBFFormatDate(char *pszBuffer, const SHPDate *psDate);
+    int SHPAPI_CALL DBFParseDouble(const char *pachValue, int nLength,
+                                   double *pdfValue);
+    int SHPAPI_CALL DBFParseInteger(const char *pachValue, int nLength,
+                                    int64_t *pnValue);
+    int SHPAPI_CALL DBFReadDoubleColumn(DBFHandle hDBF, int iField,
+                                        int iFirstRecord, int nCount,
+                                        double *padfValues,
+                                        unsigned char *pabyNoValue);
+    int SHPAPI_CALL DBFReadInteger64Column(DBFHandle hDBF, int iField,
+                                           int iFirstRecord, int nCount,
+                                           int64_t *panValues,
+                                           unsigned char *pabyNoValue);
 
     int SHPAPI_CALL DBFWriteIntegerAttribute(DBFHandle hDBF, int iShape,
                                              int iField, int nFieldValue);
@@ -556,12 +614,19 @@ extern "C"
     int SHPAPI_CALL DBFWriteAttributeDirectly(DBFHandle psDBF, int hEntity,
                                               int iField, const void *pValue);
     const char SHPAPI_CALL1(*) DBFReadTuple(DBFHandle psDBF, int hEntity);
+    const char SHPAPI_CALL1(*)
+        DBFReadTupleRun(DBFHandle psDBF, int hEntity, int nCount, int *pnRun);
     int SHPAPI_CALL DBFWriteTuple(DBFHandle psDBF, int hEntity,
                                   const void *pRawTuple);
 
     int SHPAPI_CALL DBFIsRecordDeleted(const DBFHandle psDBF, int iShape);
     int SHPAPI_CALL DBFMarkRecordDeleted(DBFHandle psDBF, int iShape,
                                          int bIsDeleted);
+    int SHPAPI_CALL DBFPack(DBFHandle psDBF, const char *pszFilename);
+    int SHPAPI_CALL DBFRestructure(DBFHandle psDBF, int nFields,
+                                   const int *panSource, const char *pachType,
+                                   const int *panWidth, const int *panDecimals,
+                                   const char *pszFilename);
 
     DBFHandle SHPAPI_CALL DBFCloneEmpty(const DBFHandle psDBF,
                                         const char *pszFilename);
@@ -577,6 +642,9 @@ extern "C"
 
     void SHPAPI_CALL DBFSetWriteEndOfFileChar(DBFHandle psDBF, int bWriteFlag);
 
+    int SHPAPI_CALL DBFSetCacheSize(DBFHandle psDBF, SAOffset nBytes);
+    int SHPAPI_CALL DBFSetAppendBufferSize(DBFHandle psDBF, SAOffset nBytes);
+
 #ifdef __cplusplus
 }
 #endif